@@ -0,0 +1,47 @@
+/*
+ Content pack baker
+
+ Builds the level geometry and interface layout from the tables in the code, converts every
+ image they use from a BMP to its texture's format (packing the sprite sheet and the toolbar into
+ the atlas), and writes it all to one content pack for the game to memory-map at startup (see
+ pack.h). Build and run with `make pack`.
+ */
+
+#include "../headers/constants.h"
+#include "../headers/sprite.h"
+#include "../headers/level.h"
+#include "../headers/interface.h"
+#include "../headers/pack.h"
+#include "../headers/atlas.h"
+
+// Globals the game's modules expect from main.c - there is no window, renderer, or debug mode
+SDL_Window* window = NULL;
+SDL_Renderer* renderer = NULL;
+bool debug = false;
+
+int main(int argc, char** argv)
+{
+    // The pack is written to the file given, or the default
+    const char* path = argc > 1 ? argv[1] : PACK_PATH;
+
+    // Build the game data from the tables in the code (no pack is open, and nothing is drawn)
+    if(SDL_Init(SDL_INIT_TIMER) < 0) return 1;
+    loadLevels();
+    loadSpriteInfo();
+    loadInterface();
+
+    // Bake it, along with the level images and the atlas packed from the sprite sheet and the toolbar
+    bakeLevels();
+    bakeInterface();
+    bakeAtlas();
+    bool succ = writePack(path);
+    if(succ) printf("Content pack written to %s\n", path);
+    else     fprintf(stderr, "Error: Could not write %s\n", path);
+
+    freeLevels();
+    freeInterface();
+    freeAtlas();
+    closePack();
+    SDL_Quit();
+    return succ ? 0 : 1;
+}
@@ -0,0 +1,234 @@
+/*
+ Sprite benchmarks
+
+ Drives the sprite and level updates through scripted scenarios with no window,
+ timing each phase of the simulation. Reports nanoseconds per sprite per phase,
+ heap allocations per tick, and the worst tick, and writes the results as JSON.
+ Build and run with `make bench`.
+ */
+
+#include "../headers/constants.h"
+#include "../headers/sound.h"
+#include "../headers/sprite.h"
+#include "../headers/level.h"
+#include "../headers/interface.h"
+#include "../headers/random.h"
+#include "../headers/jobs.h"
+
+// Default file the results are written to
+#define BENCH_PATH "bench.json"
+
+// Phases of a simulation tick, in the order they run
+enum phases
+{ MOVE_BACKGROUND, MOVE_SPRITES, TERRAIN_COLLISIONS, SPRITE_COLLISIONS, LAUNCH_SPELLS, ADVANCE_TIMERS,
+  UNLOAD_SPRITES, UPDATE_ANIMATION_FRAMES, NUM_PHASES };
+
+const char* phase_names[NUM_PHASES] =
+{ "moveBackground", "moveSprites", "terrainCollisions", "spriteCollisions", "launchSpells", "advanceTimers",
+  "unloadSprites", "updateAnimationFrames" };
+
+// A scripted scenario - setup runs once, and script runs before every tick
+typedef struct scenario
+{
+    const char* name;           // name of the scenario in the results
+    long long ticks;            // number of ticks to simulate
+    bool no_cooldowns;          // let the guys cast as fast as they can
+    void (*script)(long long tick);
+} Scenario;
+
+// Results of running one scenario
+typedef struct results
+{
+    double phase_ns[NUM_PHASES];  // total time spent in each phase
+    double worst_tick_ns;         // longest single tick
+    long long sprite_ticks;       // active sprites summed over every tick
+    long long allocations;        // heap allocations made while simulating
+} Results;
+
+// Globals the game's modules expect from main.c - there is no window, renderer, or debug mode
+SDL_Window* window = NULL;
+SDL_Renderer* renderer = NULL;
+bool debug = false;
+
+// Every heap allocation the game makes is counted (see constants.h)
+SDL_atomic_t allocation_count;
+
+// Random stream for the scripts, so every run of the benchmarks does the same work
+Rng bench_rng;
+
+/* SCENARIOS */
+
+// Spawn a burst of particles at a point, flying out like an arcsurge's
+static void spawnBurst(int id, double x, double y, int count, int lifetime)
+{
+    for(int i = 0; i < count; i++)
+    {
+        double xv = (nextRand(&bench_rng) - 0.5) * 10;
+        double yv = (nextRand(&bench_rng) - 0.5) * 10;
+        spawnSprite(id, x, y, xv, yv, RIGHT, 0, 0, lifetime + nextRand(&bench_rng) * lifetime);
+    }
+}
+
+// Both guys cast arcsurge as fast as they can, while more arcsurge bursts go off around the stage
+static void arcsurgeStorm(long long tick)
+{
+    cast(0, ARCSURGE);
+    cast(1, ARCSURGE);
+    for(int i = 0; i < 6; i++)
+    {
+        spawnBurst(ARCSURGE_P1, nextRand(&bench_rng) * SCREEN_WIDTH, nextRand(&bench_rng) * SCREEN_HEIGHT / 2, 30, 10);
+    }
+}
+
+// Both guys cast rockfall as fast as they can, while more rocks fall all over the stage and shatter
+static void rockfallRain(long long tick)
+{
+    cast(0, ROCKFALL);
+    cast(1, ROCKFALL);
+    if(tick % 2 == 0) spawnSprite(ROCKFALL, nextRand(&bench_rng) * (SCREEN_WIDTH - 100) + 50, -100, 0, 0, RIGHT, 0, 0, 0);
+}
+
+// Thousands of long-lived particles wobble around the screen
+static void particleSwarm(long long tick)
+{
+    double x = nextRand(&bench_rng) * SCREEN_WIDTH, y = nextRand(&bench_rng) * SCREEN_HEIGHT;
+    spawnBurst(FIREBALL_P1, x, y, 100, 20);
+    spawnBurst(DARKEDGE_P1, SCREEN_WIDTH - x, SCREEN_HEIGHT - y, 100, 20);
+}
+
+// Both guys are controlled by the CPU, as in a long AI-mode session
+static void aiMarathon(long long tick)
+{
+    Uint8 inputs[2] = { decideCPUAction(0), decideCPUAction(1) };
+    takeCPUAction(0, inputs[0]);
+    takeCPUAction(1, inputs[1]);
+}
+
+Scenario scenarios[] =
+{
+    { "arcsurge_storm", 20000, true, arcsurgeStorm },
+    { "rockfall_rain", 20000, true, rockfallRain },
+    { "particle_swarm", 20000, false, particleSwarm },
+    { "ai_marathon", 200000, false, aiMarathon },
+};
+
+/* RUNNING */
+
+// Run a scenario from a fresh match, timing each phase of every tick
+static Results runScenario(Scenario* sc)
+{
+    Results r;
+    memset(&r, 0, sizeof(Results));
+
+    // Start a fresh match on the first level
+    freeActiveSprites();
+    seedMatch(DEFAULT_SEED);
+    seedRng(&bench_rng, DEFAULT_SEED);
+    switchLevel(FOREST);
+    int* starts = getStartingPositions(FOREST);
+    spawnSprite(GUY, starts[0], starts[1], 0, 0, RIGHT, 0, 0, 0);
+    spawnSprite(GUY, starts[2], starts[3], 0, 0, LEFT, 0, 0, 0);
+    debug = sc->no_cooldowns;
+
+    double ns_per_count = 1e9 / SDL_GetPerformanceFrequency();
+    long long allocations = SDL_AtomicGet(&allocation_count);
+    for(long long tick = 0; tick < sc->ticks; tick++)
+    {
+        sc->script(tick);
+        r.sprite_ticks += getSpriteCount();
+
+        // The same phases as the game's simulation tick, each timed separately
+        Uint64 t[NUM_PHASES + 1];
+        t[MOVE_BACKGROUND] = SDL_GetPerformanceCounter();
+        moveBackground();
+        t[MOVE_SPRITES] = SDL_GetPerformanceCounter();
+        moveSprites();
+        t[TERRAIN_COLLISIONS] = SDL_GetPerformanceCounter();
+        terrainCollisions(getTerrain());
+        t[SPRITE_COLLISIONS] = SDL_GetPerformanceCounter();
+        spriteCollisions();
+        t[LAUNCH_SPELLS] = SDL_GetPerformanceCounter();
+        launchSpells();
+        t[ADVANCE_TIMERS] = SDL_GetPerformanceCounter();
+        advanceTimers();
+        t[UNLOAD_SPRITES] = SDL_GetPerformanceCounter();
+        int signal = unloadSprites();
+        t[UPDATE_ANIMATION_FRAMES] = SDL_GetPerformanceCounter();
+        updateAnimationFrames();
+        t[NUM_PHASES] = SDL_GetPerformanceCounter();
+
+        for(int p = 0; p < NUM_PHASES; p++) r.phase_ns[p] += (t[p + 1] - t[p]) * ns_per_count;
+        r.worst_tick_ns = fmax(r.worst_tick_ns, (t[NUM_PHASES] - t[0]) * ns_per_count);
+
+        // A guy who dies comes straight back
+        if(signal) resetGuy(signal - 1, starts[2 * (signal - 1)], -100);
+    }
+    r.allocations = SDL_AtomicGet(&allocation_count) - allocations;
+    debug = false;
+    return r;
+}
+
+// Print a scenario's results, and write them to the JSON file
+static void reportScenario(FILE* json, Scenario* sc, Results* r, bool last)
+{
+    double total_ns = 0;
+    for(int p = 0; p < NUM_PHASES; p++) total_ns += r->phase_ns[p];
+    double sprites = r->sprite_ticks ? r->sprite_ticks : 1;
+
+    printf("\n%s: %lld ticks, %.1f sprites on average\n", sc->name, sc->ticks, r->sprite_ticks / (double) sc->ticks);
+    for(int p = 0; p < NUM_PHASES; p++)
+    {
+        printf("  %-24s %9.2f ns/sprite %10.0f ns/tick\n", phase_names[p], r->phase_ns[p] / sprites,
+               r->phase_ns[p] / sc->ticks);
+    }
+    printf("  %-24s %9.2f ns/sprite %10.0f ns/tick\n", "total", total_ns / sprites, total_ns / sc->ticks);
+    printf("  worst tick %.1f us, %.3f allocations per tick\n", r->worst_tick_ns / 1000,
+           r->allocations / (double) sc->ticks);
+
+    fprintf(json, "    {\n      \"name\": \"%s\",\n      \"ticks\": %lld,\n", sc->name, sc->ticks);
+    fprintf(json, "      \"average_sprites\": %.2f,\n", r->sprite_ticks / (double) sc->ticks);
+    fprintf(json, "      \"ns_per_sprite\": {");
+    for(int p = 0; p < NUM_PHASES; p++) fprintf(json, "\"%s\": %.3f, ", phase_names[p], r->phase_ns[p] / sprites);
+    fprintf(json, "\"total\": %.3f},\n", total_ns / sprites);
+    fprintf(json, "      \"ns_per_tick\": %.1f,\n", total_ns / sc->ticks);
+    fprintf(json, "      \"worst_tick_ns\": %.1f,\n", r->worst_tick_ns);
+    fprintf(json, "      \"allocations_per_tick\": %.4f\n    }%s\n", r->allocations / (double) sc->ticks, last ? "" : ",");
+}
+
+int main(int argc, char** argv)
+{
+    // Results go to the file given, or the default
+    const char* path = argc > 1 ? argv[1] : BENCH_PATH;
+    FILE* json = fopen(path, "w");
+    if(!json)
+    {
+        fprintf(stderr, "Error: Could not open %s\n", path);
+        return 1;
+    }
+
+    // Load the game data without a window or audio
+    if(SDL_Init(SDL_INIT_TIMER) < 0) return 1;
+    startJobs();
+    setMute();
+    loadLevels();
+    loadSpriteInfo();
+
+    // Run every scenario
+    int num_scenarios = sizeof(scenarios) / sizeof(Scenario);
+    printf("Sprite updates split across %d threads\n", jobThreads());
+    fprintf(json, "{\n  \"threads\": %d,\n  \"scenarios\": [\n", jobThreads());
+    for(int i = 0; i < num_scenarios; i++)
+    {
+        Results r = runScenario(&scenarios[i]);
+        reportScenario(json, &scenarios[i], &r, i == num_scenarios - 1);
+    }
+    fprintf(json, "  ]\n}\n");
+    fclose(json);
+    printf("\nResults written to %s\n", path);
+
+    freeActiveSprites();
+    freeLevels();
+    stopJobs();
+    SDL_Quit();
+    return 0;
+}
@@ -0,0 +1,20 @@
+/*
+ Frame arena
+
+ Memory for data which only lives for one rendered frame (HUD values, strings, etc)
+ is bump-allocated from a fixed block, and the whole block is released at once when
+ the arena is reset at the top of the game loop. A steady-state frame makes no heap
+ allocations at all.
+ */
+
+// Size of the arena's fixed block, in bytes
+#define FRAME_ARENA_SIZE (64 * 1024)
+
+// Alignment of every allocation, in bytes (enough for any basic type)
+#define FRAME_ARENA_ALIGN 16
+
+// Allocate memory which is valid until the next resetFrameArena
+void* frameAlloc(size_t size);
+
+// Release everything allocated since the last reset
+void resetFrameArena(void);
@@ -0,0 +1,44 @@
+/*
+ Texture atlas
+
+ The sprite sheet and the toolbar are packed into one texture, so that every sprite, toolbar
+ element, and glyph on screen is drawn from the same texture. The modules add the images they draw
+ (animation frames, toolbar elements, glyphs) as they load, and the atlas trims the transparent
+ border off each one and packs the trimmed images onto shelves, on a worker thread as the game
+ starts (or takes the packed atlas from the content pack). Images are then drawn by index, through
+ clipAtlas, which finds part of an image in the atlas and moves its quad to where the trimmed
+ pixels belong.
+ */
+
+// Most images the atlas holds
+#define MAX_ATLAS_IMAGES 256
+
+// Most sheets the images are taken from
+#define MAX_ATLAS_SHEETS 4
+
+// Transparent pixels left between the images in the atlas, so that rotated quads never sample a neighbour
+#define ATLAS_PADDING 1
+
+// Add a row of count images of the same size from a sheet to the atlas, side by side from (x, y), returning
+// the index of the first (the rest follow in order). Images must be added before the atlas is loaded.
+int addAtlasImages(const char* sheet, int x, int y, int width, int height, int count);
+
+// Queue the atlas to be packed from the sheets (or taken from the content pack) and made into a texture
+void loadAtlas(void);
+
+// Get the atlas texture (NULL until it's loaded)
+SDL_Texture* getAtlas(void);
+
+// Get the size of the atlas texture, for texture coordinates
+void getAtlasSize(int* width, int* height);
+
+// Find part of an image in the atlas, to be drawn at its own size: clip is given relative to the image's
+// upper-left corner and quad is where it's drawn (mirrored horizontally if flip is set), and both are cut
+// down to the part of it which wasn't trimmed away. Returns false if there's nothing left to draw.
+bool clipAtlas(int image, SDL_Rect* clip, SDL_Rect* quad, bool flip);
+
+// Pack the atlas and bake it, along with where each image is in it, into the content pack being baked (pack.h)
+void bakeAtlas(void);
+
+// Free the atlas texture, and forget the images added to it
+void freeAtlas(void);
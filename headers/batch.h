@@ -0,0 +1,23 @@
+/*
+ Sprite batching
+
+ Textured quads are collected into one vertex and index buffer and submitted with a
+ single SDL_RenderGeometry call per texture, instead of one SDL_RenderCopyEx each.
+ Rotation and flipping are done on the CPU while the quad is added, so thousands of
+ particles cost the same number of draw calls as one. A batch is flushed when its
+ texture changes, when it fills up, or when flushBatch is called.
+ */
+
+// Most quads a batch holds before it is flushed
+#define MAX_BATCH_QUADS 8192
+
+// Start batching quads from a texture (flushes the current batch if it uses another texture)
+void beginBatch(SDL_Texture* texture);
+
+// Add a quad, drawing the clip of the batch's texture to the rect given, rotated clockwise by angle
+// degrees about center (relative to the rect's upper-left corner, or the rect's center if NULL) and
+// mirrored horizontally if flip is set
+void batchQuad(const SDL_Rect* clip, const SDL_Rect* quad, int angle, const SDL_FPoint* center, bool flip);
+
+// Draw every quad in the batch
+void flushBatch(void);
@@ -7,31 +7,42 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <math.h>
+#include <limits.h>
 
 // Screen size
 #define SCREEN_WIDTH 1024
 #define SCREEN_HEIGHT 768
 
-// Frame rate constants
+// Frame rate constants - the game is simulated in fixed ticks (all physics are tuned per tick),
+// and rendered as often as the display allows, up to MAX_FPS
 #define ANIMATION_SPEED 1
-#define MAX_FPS 60
+#define MAX_FPS 240
+#define TICKS_PER_SECOND 60
+#define MS_PER_TICK (1000.0 / TICKS_PER_SECOND)
+#define MAX_FRAME_LAG 250 // the most real time (ms) a single slow frame can add to the simulation
+#define HEADLESS_TICKS 100000 // default number of ticks simulated in headless mode
+
+// Benchmark builds count every heap allocation the game's modules make (see bench/bench.c). Every module
+// includes this header, and the count is atomic since loader workers and job threads allocate too.
+#ifdef COUNT_ALLOCATIONS
+extern SDL_atomic_t allocation_count;
+#define malloc(size) (SDL_AtomicAdd(&allocation_count, 1), malloc(size))
+#define calloc(num, size) (SDL_AtomicAdd(&allocation_count, 1), calloc(num, size))
+#define realloc(ptr, size) (SDL_AtomicAdd(&allocation_count, 1), realloc(ptr, size))
+#endif
 
 // Cardinal directions
 enum directions
 { LEFT, RIGHT, UP, DOWN };
 
-// Get random number in [0, 1)
-static inline double get_rand(void) { return (double) rand() / (double) RAND_MAX; }
-
 // Convert (0,1) to (-1,1)
 static inline int convert(bool c) { return (c - (c == 0)); }
 
 // External constants initialized in main.c
-// Rendering, display, texture loading
+// Rendering and display (textures are loaded by the asset loader, see loader.h)
 extern SDL_Window* window;
 extern SDL_Renderer* renderer;
-SDL_Texture* loadTexture(const char* path);
 
-// In debug mode, the framerate is lowered, the opening scene is skipped, there are no cooldowns,
+// In debug mode, the simulation runs in slow motion, the opening scene is skipped, there are no cooldowns,
 // music is muted, and sprite origins and bounding boxes are rendered
 extern bool debug;
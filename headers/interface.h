@@ -8,6 +8,9 @@
 #define NUM_ELEMENTS 4      // Total number of toolbar elements
 #define NUM_MENU_OPTIONS 5  // Total number of menu options (across all menus)
 #define FONT_SIZE 30        // Size in pixels of a letter
+#define FONT_ROWS 4         // Rows of ten letters on the toolbar sheet
+#define MAX_TEXT_LENGTH 32  // Most letters in one piece of text
+#define TEXT_CACHE_SIZE 32  // Pieces of text whose layout is kept between frames
 
 // List of game states
 enum modes
@@ -30,11 +33,18 @@ void setScore(int new_score);
 // Add points to score
 void updateScore(int points);
 
-// Render all of the current mode's toolbar and text elements to the screen
+// Get the current score
+int getScore(void);
+
+// Render all of the current mode's toolbar and text elements to the screen (the cooldown arrays are
+// -1 terminated, and owned by the caller)
 void renderInterface(int mode, long long frame, int guy_hp, int guy2_hp, double* guy_cds, double* guy2_cds);
 
-// Load the toolbar texture, toolbar elements, and selection text into memory
+// Load the toolbar elements and selection text into memory, and add their images to the atlas
 void loadInterface(void);
 
-// Free the toolbar elements, toolbar texture, and selection text from memory
+// Bake the toolbar elements and menu options into the content pack being baked (pack.h)
+void bakeInterface(void);
+
+// Free the toolbar elements and selection text from memory
 void freeInterface(void);
@@ -0,0 +1,31 @@
+/*
+ Job system
+
+ A small pool of worker threads (one per core, counting the main thread) for splitting a loop over
+ independent items across cores. A parallel-for deals the items out in one contiguous run per
+ thread, and each thread works through its own run from the front, then steals items from the back
+ of the others' runs once its own is done, so a thread which falls behind is helped out. The items
+ must be independent - the order they're worked in, and which thread works them, isn't fixed.
+ */
+
+// Most threads which work on a parallel-for, including the one which starts it
+#define MAX_JOB_THREADS 8
+
+// Most items one parallel-for can hand out to the threads (any more are worked through on one thread)
+#define MAX_JOB_ITEMS 32767
+
+// Work done for one item of a parallel-for, on whichever thread takes it
+typedef void (*JobWork)(void* data, int item);
+
+// Start the worker threads
+void startJobs(void);
+
+// Get the number of threads which work on a parallel-for, including the one which starts it
+int jobThreads(void);
+
+// Do work for every item in [0, count) across the threads, returning once every item is done (only the main
+// thread starts parallel-fors, and without workers the items are just worked through in order)
+void parallelFor(int count, JobWork work, void* data);
+
+// Stop the worker threads
+void stopJobs(void);
@@ -3,12 +3,44 @@
 
  This encompasses backgrounds (non-interactive, lightly animated),
  and foregrounds (interactive level ground, platforms, and walls)
+
+ A level's images are only loaded when it's switched to (or prefetched, when it's about to be), and
+ the least recently used levels' images are freed whenever the levels resident take up more than
+ LEVEL_IMAGE_BUDGET, so memory doesn't grow with the number of levels.
  */
 
 // Number of existing backgrounds and foregrounds
 #define NUM_BACKGROUNDS 2
 #define NUM_FOREGROUNDS 2
 
+// Largest level that can be built, in pixels (levels can be larger than the screen, and the camera follows the guys)
+#define MAX_LEVEL_WIDTH 8192
+#define MAX_LEVEL_HEIGHT 4096
+
+// Memory, in bytes, the levels' images are kept under (the current level's images are never freed)
+#define LEVEL_IMAGE_BUDGET (24 * 1024 * 1024)
+
+// Size in pixels of the square tiles a foreground is split into (only tiles in view are kept as textures)
+#define FOREGROUND_TILE_SIZE 256
+
+// Width in pixels of a column of the terrain index
+#define TERRAIN_COLUMN_WIDTH 64
+
+// Index of a foreground's platforms and walls by x-column, so that a sprite only checks the terrain near it.
+// Each column lists (as offsets into platforms / walls, in their original order) the platforms spanning it
+// and the walls standing in it, with the columns' lists stored back to back.
+typedef struct terrain_index
+{
+    int* platforms;             // { num_platforms, pf1_y, pf1_x1, pf1_x2, pf2_y, ... } pf1 is the ground
+    int* walls;                 // { num_walls, wall1_x, wall1_y1, wall1_y2, wall2_x, ... }
+    int min_x;                  // x-coord of the left edge of the first column
+    int num_columns;            // number of columns, covering every platform and wall
+    int* platform_start;        // offset of each column's first platform entry (the last is the total)
+    int* platform_entries;      // platforms spanning each column, column by column
+    int* wall_start;            // offset of each column's first wall entry (the last is the total)
+    int* wall_entries;          // walls standing in each column, column by column
+}* Terrain;
+
 // Background / Foreground list
 enum levels
 { FOREST, VOLCANO };
@@ -16,6 +48,9 @@ enum levels
 // Switch the level to a new one
 void switchLevel(int new_level);
 
+// Start loading a level's images in the background, so that switching to it doesn't wait (if it exists)
+void prefetchLevel(int level);
+
 // Returns current level
 int getLevel(void);
 
@@ -25,17 +60,46 @@ int* getPlatforms(void);
 // Return the walls on the current foreground
 int* getWalls(void);
 
+// Return the width of the current level, in pixels
+int getLevelWidth(void);
+
+// Return the height of the current level, in pixels
+int getLevelHeight(void);
+
+// Return the part of the current level on screen
+SDL_Rect getView(void);
+
+// Return the terrain index of the current foreground
+Terrain getTerrain(void);
+
+// Return the column of the terrain index an x-coord falls in (clamped to the columns that exist)
+int terrainColumn(Terrain terrain, double x);
+
 // Return the starting positions of both guys for the given foreground
 int* getStartingPositions(int fg);
 
+// Save the level state (current level and background positions) to buf, returning its size in bytes
+// (if buf is NULL, just return the size)
+size_t saveLevelState(char* buf);
+
+// Restore the level state from buf, returning the number of bytes read (0 if it names a level that doesn't exist)
+size_t loadLevelState(const char* buf);
+
+// Center the camera on a point in the level, as far as it can go without showing past the level's edges
+void moveCamera(double x, double y);
+
 // Animate the background
 void moveBackground(void);
 
-// Render the current level
-void renderLevel(void);
+// Render the current level, with the background interpolated a fraction alpha of the way
+// from its position at the previous tick to its position at the current tick
+void renderLevel(double alpha);
+
+// Load all backgrounds and foregrounds, returning false if the content pack's levels are corrupt
+bool loadLevels(void);
 
-// Load all backgrounds and foregrounds
-void loadLevels(void);
+// Bake all backgrounds and foregrounds, and their images, into the content pack being baked (pack.h)
+void bakeLevels(void);
 
 // Free all backgrounds and foregrounds
 void freeLevels(void);
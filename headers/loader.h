@@ -0,0 +1,51 @@
+/*
+ Asset loader
+
+ Assets are decoded in parallel on a pool of worker threads (one per core), while anything which
+ touches the renderer (making textures) is done on the main thread as each decode finishes. Loads
+ are queued by the modules which own the assets, and are finished in any order as they complete,
+ so the game can start once the loads it needs first are done while the rest finish in the
+ background. Without worker threads (in headless mode), loads are done immediately when queued.
+ */
+
+// Most worker threads the loader starts, however many cores there are
+#define MAX_LOADER_THREADS 8
+
+// Work done for a load on a worker thread (must not touch the renderer), returning its result
+typedef void* (*LoadWork)(const void* input);
+
+// Work done with a load's result on the main thread, such as storing it in target
+typedef void (*LoadFinish)(void* result, void* target);
+
+// Decode a bitmap into a surface, or take its pixels from the content pack (work for loads which make
+// something else of the pixels)
+void* decodeBitmap(const void* path);
+
+// Make a texture of a decoded surface (on the main thread)
+SDL_Texture* makeTexture(SDL_Surface* surface);
+
+// Start the worker threads
+void startLoader(void);
+
+// Queue a load, to be worked on by a worker thread and finished on the main thread, returning its ticket
+// (the number of loads queued before it) for waitForLoad
+int queueLoad(LoadWork work, const void* input, LoadFinish finish, void* target);
+
+// Queue a bitmap to be decoded and made into a texture, stored in *texture when it's finished
+void queueTexture(const char* path, SDL_Texture** texture);
+
+// Return the number of loads ever queued (loads queued before this are waited for by waitForLoads)
+int loadsQueued(void);
+
+// Finish the first count loads ever queued, waiting for any which are still being worked on
+void waitForLoads(int count);
+
+// Finish the load with the given ticket, waiting for it if it's still being worked on (any other loads
+// already done are finished too, but none are waited for)
+void waitForLoad(int ticket);
+
+// Finish any loads whose work is done, without waiting (once per frame)
+void updateLoader(void);
+
+// Finish every load, and stop the worker threads
+void stopLoader(void);
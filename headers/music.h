@@ -0,0 +1,39 @@
+/*
+ Music streaming
+
+ Music is streamed from a WAV file, either IMA ADPCM (4:1 compressed) or plain 16-bit PCM, a small
+ block at a time. A background thread decodes blocks into a lock-free ring buffer, and SDL_mixer's
+ music hook drains it on the audio thread, so neither the main loop nor the audio callback ever waits
+ on the disk or the decoder. The track loops seamlessly between the loop points in the file's sampler
+ chunk (or over the whole track if it has none). Only the ring buffer and one block are ever resident.
+ */
+
+// Frames of decoded music buffered ahead of the audio callback (a power of 2)
+#define MUSIC_RING_FRAMES 16384
+
+// Frames read at a time from an uncompressed track
+#define PCM_BLOCK_FRAMES 1024
+
+// Largest ADPCM block accepted, in bytes
+#define MAX_ADPCM_BLOCK 8192
+
+// How long the decode thread sleeps when the ring buffer is full, in milliseconds
+#define MUSIC_POLL_MS 20
+
+// Volume of the music, out of 128
+#define MUSIC_VOLUME 100
+
+// Open a track for streaming, at the given device sample rate (returns false if it can't be played)
+bool openMusic(const char* path, int sample_rate);
+
+// Start the decode thread and feed the track to the audio device, looping forever
+void playMusic(void);
+
+// Hook the music back into the audio device after it's been reopened
+void resumeMusic(void);
+
+// Get the number of times the audio device has asked for music the decoder hadn't decoded yet
+int getMusicUnderruns(void);
+
+// Stop the music and close the track
+void closeMusic(void);
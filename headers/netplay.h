@@ -0,0 +1,59 @@
+/*
+ Rollback netplay
+
+ Two instances of the game play a VS match over UDP. Each instance simulates
+ immediately using its own guy's input and a prediction of the other guy's
+ (his last known input). When the real input arrives and differs from the
+ prediction, the world is rolled back to the tick it was mispredicted at and
+ re-simulated up to the present. The instances compare checksums of the world
+ every so often to detect desyncs.
+ */
+
+// The most ticks an instance can simulate ahead of the other guy's known inputs (it waits for
+// them beyond this), and so the most ticks a rollback ever re-simulates
+#define MAX_ROLLBACK 8
+
+// Netplay tuning
+#define NET_CHECK_INTERVAL 60        // ticks between world checksums sent to the other instance
+#define NET_SYNC_INTERVAL 10         // the fewest ticks between ticks given up to let the other instance catch up
+#define NET_CONNECT_TIMEOUT 30000    // how long to wait for the other instance to connect, in ms
+#define NET_TIMEOUT 5000             // how long without hearing from the other instance before disconnecting, in ms
+
+// Function which simulates one tick of the match, given the inputs of both guys, returning whether the
+// match ended on that tick
+typedef bool (*TickFunction)(int* mode, const Uint8* inputs);
+
+// Host a match on a port, or join the match hosted at address:port (if address is given), waiting for
+// the other instance to connect. Outgoing packets can be delayed by delay ms and dropped with probability
+// loss percent, to test on one machine. Returns whether the instances connected.
+bool startNetplay(const char* address, int port, int delay, int loss, TickFunction tick);
+
+// Get the guy controlled by this instance (the host is guy 0)
+int getLocalGuy(void);
+
+// Get the seed of the match, chosen by the host
+unsigned long long getNetSeed(void);
+
+// Send and receive any pending packets, returning whether the other instance is still connected
+bool pollNetplay(void);
+
+// Check whether this instance is running ahead of the other one, and should give up a tick to let it catch up
+bool netplayAhead(void);
+
+// Simulate the next tick with this instance's input, rolling back first if a misprediction was found.
+// Returns false (and simulates nothing) if this instance is too far ahead of the other one's inputs.
+bool advanceNetplay(Uint8 input, int* mode);
+
+// Check whether the match has ended on a tick every input up to which is known, so both instances agree on it.
+// If so, the world is taken back to just after that tick (it may have been simulated further on predictions),
+// and the tick it ends on is returned, or else -1.
+long long netplayEnd(int* mode);
+
+// Wait until both instances have every input up to the current tick, to end the match in sync
+void finishNetplay(int* mode);
+
+// Print statistics about the match: rollbacks, re-simulation times, and desyncs
+void printNetStats(void);
+
+// Close the connection and free netplay data
+void stopNetplay(void);
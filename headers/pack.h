@@ -0,0 +1,46 @@
+/*
+ Content pack
+
+ Level geometry, the interface layout, and every image's pixels (already converted to the format
+ their textures use) are baked offline into one versioned pack file by `make pack`. At startup the
+ pack is memory-mapped with a single open, and the game reads its data straight out of the
+ mapping: geometry is used in place, and textures are uploaded from the mapped pixels. Without a
+ pack (or with one baked by a different version of the game), everything is built from the
+ tables in the code and the BMPs in art/ instead.
+ */
+
+// Default file the pack is baked to and loaded from
+#define PACK_PATH "content.gbp"
+
+// Longest name of an entry in the pack (such as an image's path), including the terminator
+#define PACK_NAME_LENGTH 48
+
+// Alignment of each entry's data in the pack, in bytes
+#define PACK_ALIGN 16
+
+// Map a content pack into memory, returning whether it's a pack this version of the game can read
+bool openPack(const char* path);
+
+// Find a block of baked data in the pack by name, setting size to its size in bytes (returns NULL if there's
+// no pack, or no such entry)
+const void* findPackData(const char* name, size_t* size);
+
+// Make a surface of an image's pixels in the pack, which point into the mapping so nothing is copied
+// (returns NULL if there's no pack, or no such image)
+SDL_Surface* findPackImage(const char* name);
+
+// Unmap the pack, and free the pack being baked
+void closePack(void);
+
+// Add a block of data to the pack being baked
+void bakeData(const char* name, const void* data, size_t size);
+
+// Add an image's pixels to the pack being baked as they are in the surface, which must already be in the
+// format its texture will use (ARGB8888 or RGB888)
+void bakeSurface(const char* name, SDL_Surface* surface);
+
+// Add an image to the pack being baked, converted from a BMP to the format its texture will use
+void bakeImage(const char* path);
+
+// Write the pack being baked to a file, returning whether it was written successfully
+bool writePack(const char* path);
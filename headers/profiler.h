@@ -0,0 +1,37 @@
+/*
+ Frame profiler
+
+ Named zones of code are timed and written to a ring buffer, which keeps the
+ most recent PROFILE_RING_SIZE zones. Profiling can be switched on and off while
+ the game runs (F3), and the captured zones are exported as Chrome trace-event
+ JSON, which can be loaded into chrome://tracing or Perfetto.
+ */
+
+// Number of zones the ring buffer holds (older zones are overwritten)
+#define PROFILE_RING_SIZE (1 << 16)
+
+// Default file the trace is exported to
+#define PROFILE_PATH "profile.json"
+
+// Is profiling on (zones cost one branch each while it's off)
+extern bool profiling;
+
+// Start timing a zone, returning its start time (or 1 if profiling is off)
+static inline Uint64 beginZone(void)
+{
+    return profiling ? SDL_GetPerformanceCounter() : 1;
+}
+
+// Finish timing a zone that started at start, recording it in the ring buffer. Always returns 0.
+Uint64 endZone(const char* name, Uint64 start);
+
+// Time the statement or block that follows as a zone with the given name (the name must be a
+// string literal or otherwise outlive the profiler). The block must not break or return out.
+#define PROFILE_ZONE(name) for(Uint64 zone_start = beginZone(); zone_start; zone_start = endZone((name), zone_start))
+
+// Switch profiling on or off
+void setProfiling(bool on);
+
+// Write the zones in the ring buffer to a file as Chrome trace-event JSON, returning whether it was written
+// (if profiling was never switched on, no file is written)
+bool exportProfile(const char* path);
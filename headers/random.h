@@ -0,0 +1,38 @@
+/*
+ Random number generation
+
+ A small, fast generator (xoshiro256+) whose state is kept explicitly, so that
+ each match owns its own random streams and a match is reproducible from its seed.
+ */
+
+#include <stdint.h>
+
+// State of one random number stream
+typedef struct rng_state
+{
+    uint64_t s[4];
+} Rng;
+
+// Seed a stream (any seed, including 0, gives a valid state)
+void seedRng(Rng* rng, uint64_t seed);
+
+// Fill an array with n random numbers in [0, 1), for spawning bursts of particles
+void fillRand(Rng* rng, double* out, int n);
+
+// Get the next random number in [0, 1) from a stream
+static inline double nextRand(Rng* rng)
+{
+    uint64_t* s = rng->s;
+    uint64_t result = s[0] + s[3];
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 45) | (s[3] >> 19);
+
+    // The top 53 bits fill a double's mantissa exactly
+    return (result >> 11) * 0x1.0p-53;
+}
@@ -0,0 +1,61 @@
+/*
+ Match replays
+
+ A replay records the inputs of both guys on every tick of a match, along with
+ keyframes of the whole world state every few seconds. Since the simulation is
+ deterministic, playback can seek to any tick by restoring the nearest earlier
+ keyframe and re-simulating the recorded inputs from there.
+ */
+
+// Number of ticks between keyframes (a larger interval means a smaller file, but slower seeking)
+#define KEYFRAME_INTERVAL 300
+
+// Playback controls - speeds double up to the maximum, and seeking jumps a fixed number of ticks
+#define MAX_REPLAY_SPEED 64
+#define REPLAY_SEEK_STEP (10 * TICKS_PER_SECOND)
+
+// Save the whole world state (the mode, score, level, and sprites) to buf, returning its size in bytes
+// (if buf is NULL, just return the size)
+size_t saveWorld(char* buf, int mode);
+
+// Restore the whole world state from the size bytes at buf, returning the number of bytes read (0 if the state
+// is invalid)
+size_t loadWorld(const char* buf, size_t size, int* mode);
+
+// Start recording a new match, which is in the given mode and seeded with the given seed
+// (demo is set if both guys are controlled by the CPU)
+void startRecording(int mode, bool demo, unsigned long long seed);
+
+// Record the inputs of both guys for the next tick, taking a keyframe first if one is due
+void recordTick(int mode, const Uint8* inputs);
+
+// Check whether a match is being recorded
+bool isRecording(void);
+
+// Stop recording and write the replay to a file, returning whether it was written successfully
+bool stopRecording(const char* path);
+
+// Load a replay from a file for playback, returning whether it was read successfully
+bool loadReplay(const char* path);
+
+// Get the number of ticks in the loaded replay
+long long getReplayLength(void);
+
+// Get the seed of the match in the loaded replay
+unsigned long long getReplaySeed(void);
+
+// Check whether both guys were controlled by the CPU in the loaded replay
+bool getReplayDemo(void);
+
+// Get the inputs of both guys for a tick of the loaded replay
+void getReplayInputs(long long tick, Uint8* inputs);
+
+// Check whether the world matches the loaded replay's keyframe at a tick (true if there's no keyframe there)
+bool matchesKeyframe(long long tick, int mode);
+
+// Restore the world to the nearest keyframe at or before a tick, returning the keyframe's tick (-1 if the
+// keyframe's world state is invalid)
+long long restoreKeyframe(long long tick, int* mode);
+
+// Free the replay being recorded or played back
+void freeReplay(void);
@@ -1,5 +1,15 @@
 /*
  Music and sound effects control
+
+ SDL_mixer plays the music. Sound effects are played by our own mixer, which adds a fixed pool of
+ voices into SDL_mixer's output on the audio thread. When every voice is busy, a new sound steals
+ the voice playing the oldest sound of the lowest priority (or is dropped, if every voice is playing
+ something more important), so a busy fight costs the audio thread a bounded amount of work. Spell
+ sounds are panned and attenuated by where they happen relative to the view.
+
+ In low-latency mode, the device starts with a small buffer. The mixer notes when each callback
+ arrives, and a callback that comes more than two buffers after the last one means the device ran
+ dry; if that keeps happening, the buffer is doubled (up to the normal size) by reopening the device.
  */
 
 #include <SDL2/SDL_mixer.h>
@@ -9,22 +19,74 @@
 #define NUM_CHANNELS 2
 #define CHUNK_SIZE 2048
 
+// Buffer size low-latency mode starts from, in frames (a power of 2, doubled up to CHUNK_SIZE)
+#define LOW_LATENCY_CHUNK 256
+
+// Underruns within UNDERRUN_WINDOW milliseconds which make low-latency mode grow its buffer
+#define UNDERRUN_LIMIT 3
+#define UNDERRUN_WINDOW 2000
+
+// Time after the device opens before underruns are counted, while it settles, in milliseconds
+#define UNDERRUN_GRACE 500
+
+// Number of sound effects which can play at once
+#define MAX_VOICES 16
+
+// Frames mixed at a time on the audio thread
+#define MIX_BLOCK 512
+
 // Number of unique sound effects in the game
-#define NUM_SOUND_EFFECTS 3
+#define NUM_SOUND_EFFECTS 13
 
-// List of sound effects
+// List of sound effects - the spell sounds are in the same order as the spells (sprite.h)
 enum sound_effects
-{ SFX_HOVER, SFX_SELECT, SFX_BACK };
+{ SFX_HOVER, SFX_SELECT, SFX_BACK,
+  SFX_CAST_FIREBALL, SFX_CAST_ICESHOCK, SFX_CAST_ROCKFALL, SFX_CAST_DARKEDGE, SFX_CAST_ARCSURGE,
+  SFX_HIT_FIREBALL, SFX_HIT_ICESHOCK, SFX_HIT_ROCKFALL, SFX_HIT_DARKEDGE, SFX_HIT_ARCSURGE };
+
+// Sound effects made by a spell when it's launched, and when it collides
+#define SFX_CAST(spell) (SFX_CAST_FIREBALL + (spell))
+#define SFX_HIT(spell) (SFX_HIT_FIREBALL + (spell))
+
+// Measured performance of the audio device
+typedef struct audio_stats
+{
+    int chunk_size;             // frames per buffer the device is currently using
+    double buffer_ms;           // length of one buffer, in milliseconds
+    double average_latency;     // average time from a sound effect being played to being heard, in ms
+    double worst_latency;       // longest time from a sound effect being played to being heard, in ms
+    int underruns;              // times the device ran out of audio
+    int music_underruns;        // times the music decoder fell behind
+    int resizes;                // times the buffer has grown
+} AudioStats;
 
 // Mute the game's audio
 void setMute(void);
 
+// Stop sound effects from starting while set (for re-simulating ticks which were already heard)
+void suppressSoundEffects(bool suppress);
+
+// Open the audio device with a small buffer, which grows if the machine can't keep it filled
+void setLowLatency(void);
+
 // Start the game's main theme
 void startMusic(void);
 
 // Play a sound effect
 void playSoundEffect(int sfx_id);
 
+// Play a sound effect which happens at an x-coord in the level, panned by where it is relative to the view
+void playSoundEffectAt(int sfx_id, double x);
+
+// Grow the audio buffer if it keeps running dry (in low-latency mode, once per frame)
+void updateAudio(void);
+
+// Get the audio device's measured latency and underruns
+AudioStats getAudioStats(void);
+
+// Print the audio device's measured latency and underruns (in low-latency mode)
+void printAudioStats(void);
+
 // Load audio elements
 void loadSound(void);
 
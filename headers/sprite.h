@@ -10,11 +10,20 @@
 #define NUM_SPRITES 12
 #define NUM_SPELLS 5
 
+// Maximum number of simultaneously active sprites of one identity (all sprite storage is preallocated)
+#define MAX_SPRITES 4096
+
+// Seed for the match's random streams if none is given
+#define DEFAULT_SEED 1
+
 // Sprite list - doubles as the spell list, so spells must come first
 enum identities
 { FIREBALL,    ICESHOCK,    ROCKFALL,                 DARKEDGE,    ARCSURGE,
   FIREBALL_P1, ICESHOCK_P1, ROCKFALL_P1, ROCKFALL_P2, DARKEDGE_P1, ARCSURGE_P1, GUY };
 
+// Platforms and walls of a level, indexed by x-column (level.h)
+struct terrain_index;
+
 // Possible action states for a sprite
 enum action_types
 { SPAWN, MOVE, COLLIDE, IDLE, JUMP, CAST_FIREBALL, CAST_ICESHOCK, CAST_ROCKFALL, CAST_DARKEDGE, CAST_ARCSURGE, DIE };
@@ -23,8 +32,19 @@ enum action_types
 enum types
 { HUMANOID, PARTICLE, SPELL };
 
-// Allow main to pass around Guy sprites
-typedef struct sprite* Sprite;
+// Inputs a guy can give in one tick, as bits of a mask (the first NUM_SPELLS bits cast each spell)
+#define INPUT_CAST(spell) (1 << (spell))
+#define INPUT_JUMP (1 << NUM_SPELLS)
+#define INPUT_LEFT (1 << (NUM_SPELLS + 1))
+#define INPUT_RIGHT (1 << (NUM_SPELLS + 2))
+
+// Handle to a sprite - its identity and its index in that identity's bucket. Unloading a sprite
+// moves another one into its place, so handles are only valid until the next unloadSprites.
+typedef struct sprite_handle
+{
+    int id;                     // identity of the sprite (and so which bucket it lives in)
+    int idx;                    // position of the sprite in its bucket
+} Sprite;
 
 // Spawn (construct) a sprite with the given fields
 void spawnSprite(int id, double x, double y, double xv, double yv, bool dir, int angle, int spawning, int life);
@@ -38,7 +58,11 @@ void resetGuy(int guy, int x, int y);
 // Get a guy's health remaining
 int getHealth(int guy);
 
-// Get an array of percentages of a guy's cooldowns
+// Get the number of active sprites, across every bucket
+int getSpriteCount(void);
+
+// Get an array of percentages of a guy's cooldowns, terminated by -1 (allocated from the frame arena,
+// so it's only valid for the current frame)
 double* getCooldowns(int guy);
 
 // Attempt to walk in a direction after a keyboard input
@@ -50,14 +74,17 @@ bool jump(int guy);
 // Attempt to cast a spell after a keyboard input
 bool cast(int guy, int spell);
 
-// In 1-player mode, process AI decisions
-void takeCPUAction(void);
+// Decide what a CPU-controlled guy does this tick, as a mask of inputs
+Uint8 decideCPUAction(int cpu);
+
+// Carry out the decisions of a CPU-controlled guy, who fights the other guy
+void takeCPUAction(int cpu, Uint8 input);
 
 // Check if its time to spawn new spells, and spawn them, returning the change in score
 void launchSpells(void);
 
-// Check for and handle terrain collisions for all active sprites
-void terrainCollisions(int* platforms, int* walls);
+// Check for and handle terrain collisions for all active sprites, against the terrain index (level.h)
+void terrainCollisions(struct terrain_index* terrain);
 
 // Check for and handle collisions between all active sprites
 void spriteCollisions(void);
@@ -68,20 +95,33 @@ void updateAnimationFrames(void);
 // Update position/orientation/velocity of all active sprites
 void moveSprites(void);
 
-// Advance timed sprite variables which update every frame
+// Advance the tick sprite timers count towards, firing the lifetimes and collisions which run out on it
 void advanceTimers(void);
 
-// Render all active sprites to the screen
-void renderSprites(void);
+// Get the point the camera should follow - midway between the guys in the level, interpolated a fraction
+// alpha of the way from the previous tick (returns false if neither guy is in the level)
+bool getFocus(double alpha, double* x, double* y);
 
-// Load sprite and spell data
+// Render all active sprites in view to the screen, interpolated a fraction alpha of the way from
+// their positions at the previous tick to their positions at the current tick
+void renderSprites(double alpha);
+
+// Seed the random streams used by the current match - the same seed and inputs always play out the same way
+void seedMatch(unsigned long long seed);
+
+// Save the state of all active sprites to buf, returning its size in bytes (if buf is NULL, just return the size)
+size_t saveSprites(char* buf);
+
+// Restore the state of all active sprites from the size bytes at buf, returning the number of bytes read
+// (0 if the state is invalid - a bucket's count is out of range, or the state runs past size)
+size_t loadSprites(const char* buf, size_t size);
+
+// Add the sprites' animation frames to the atlas (sprite and spell data is compiled in, and the match is
+// seeded with DEFAULT_SEED until seedMatch is called)
 void loadSpriteInfo(void);
 
 // Unload any active sprites which have died
 int unloadSprites(void);
 
-// Destroy all active sprites
+// Destroy all active sprites, emptying every bucket and cancelling their timers
 void freeActiveSprites(void);
-
-// Free sprite and spell data
-void freeSpriteInfo(void);
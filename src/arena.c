@@ -0,0 +1,54 @@
+#include "../headers/constants.h"
+#include "../headers/arena.h"
+
+// Header of an allocation which didn't fit in the arena, and was made on the heap instead
+typedef struct overflow_block
+{
+    struct overflow_block* next;  // the previous overflow block this frame
+    char pad[FRAME_ARENA_ALIGN - sizeof(void*)];
+}* Overflow;
+
+// The arena's fixed block (the union keeps it aligned for any basic type)
+union
+{
+    char bytes[FRAME_ARENA_SIZE];
+    long double align_ld;
+    void* align_ptr;
+    long long align_ll;
+} arena;
+
+size_t arena_used = 0;           // bytes of the block handed out since the last reset
+Overflow overflow = NULL;        // allocations made on the heap since the last reset, newest first
+
+// Allocate memory which is valid until the next resetFrameArena
+void* frameAlloc(size_t size)
+{
+    // Round the size up so that the next allocation stays aligned
+    size = (size + FRAME_ARENA_ALIGN - 1) & ~(size_t) (FRAME_ARENA_ALIGN - 1);
+
+    // Bump-allocate from the block
+    if(arena_used + size <= FRAME_ARENA_SIZE)
+    {
+        void* ptr = arena.bytes + arena_used;
+        arena_used += size;
+        return ptr;
+    }
+
+    // A frame which needs more than the whole block still works, it just touches the heap
+    Overflow block = (Overflow) malloc(sizeof(struct overflow_block) + size);
+    block->next = overflow;
+    overflow = block;
+    return block + 1;
+}
+
+// Release everything allocated since the last reset
+void resetFrameArena(void)
+{
+    while(overflow)
+    {
+        Overflow next = overflow->next;
+        free(overflow);
+        overflow = next;
+    }
+    arena_used = 0;
+}
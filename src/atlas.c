@@ -0,0 +1,318 @@
+#include "../headers/constants.h"
+#include "../headers/atlas.h"
+#include "../headers/loader.h"
+#include "../headers/pack.h"
+
+// Widths the atlas is tried at (the powers of two between these), keeping whichever packs into the least area
+#define MIN_ATLAS_WIDTH 256
+#define MAX_ATLAS_WIDTH 4096
+
+// Struct for an image in the atlas
+struct atlas_image
+{
+    int sheet;                  // which sheet the image is taken from
+    SDL_Rect source;            // where the image is on its sheet
+    SDL_Rect clip;              // where its trimmed pixels are in the atlas (empty if it's entirely transparent)
+    int trim_x;                 // offset of the trimmed pixels from the image's upper-left corner
+    int trim_y;
+};
+
+// The atlas as it's baked into a content pack (its pixels are baked as the image "atlas pixels")
+struct baked_atlas
+{
+    int num_images;                                  // to tell apart a pack baked with different images
+    struct atlas_image images[MAX_ATLAS_IMAGES];
+};
+
+// An atlas packed on a worker thread, handed over to the main thread to be made into a texture
+struct packed_atlas
+{
+    SDL_Surface* surface;                            // the atlas's pixels, in ARGB8888
+    struct atlas_image images[MAX_ATLAS_IMAGES];
+};
+
+const char* atlas_sheets[MAX_ATLAS_SHEETS];          // Paths of the sheets the images are taken from
+int num_atlas_sheets = 0;
+struct atlas_image atlas_images[MAX_ATLAS_IMAGES];   // Every image added, in the order they were added
+int num_atlas_images = 0;
+SDL_Texture* atlas = NULL;                           // The atlas texture, once it's loaded
+int atlas_width = 1, atlas_height = 1;               // Size of the atlas texture
+
+/* SETTERS */
+
+// Add a row of count images of the same size from a sheet to the atlas, side by side from (x, y), returning
+// the index of the first (the rest follow in order). Images must be added before the atlas is loaded.
+int addAtlasImages(const char* sheet, int x, int y, int width, int height, int count)
+{
+    // Find the sheet, or add it if it's new
+    int s = 0;
+    while(s < num_atlas_sheets && strcmp(atlas_sheets[s], sheet)) s++;
+    if(s == num_atlas_sheets && s < MAX_ATLAS_SHEETS) atlas_sheets[num_atlas_sheets++] = sheet;
+    if(s == MAX_ATLAS_SHEETS || num_atlas_images + count > MAX_ATLAS_IMAGES)
+    {
+        fprintf(stderr, "Error: The atlas is full, so images from %s aren't drawn\n", sheet);
+        return MAX_ATLAS_IMAGES;
+    }
+
+    int first = num_atlas_images;
+    for(int i = 0; i < count; i++)
+    {
+        struct atlas_image* image = &atlas_images[num_atlas_images++];
+        memset(image, 0, sizeof(struct atlas_image));
+        image->sheet = s;
+        image->source = (SDL_Rect) {x + width * i, y, width, height};
+    }
+    return first;
+}
+
+/* GETTERS */
+
+// Get the atlas texture (NULL until it's loaded)
+SDL_Texture* getAtlas(void)
+{
+    return atlas;
+}
+
+// Get the size of the atlas texture, for texture coordinates
+void getAtlasSize(int* width, int* height)
+{
+    *width = atlas_width;
+    *height = atlas_height;
+}
+
+// Find part of an image in the atlas, to be drawn at its own size: clip is given relative to the image's
+// upper-left corner and quad is where it's drawn (mirrored horizontally if flip is set), and both are cut
+// down to the part of it which wasn't trimmed away. Returns false if there's nothing left to draw.
+bool clipAtlas(int image, SDL_Rect* clip, SDL_Rect* quad, bool flip)
+{
+    // Until the atlas is loaded, every image is empty
+    if(image < 0 || image >= num_atlas_images) return false;
+    const struct atlas_image* img = &atlas_images[image];
+    SDL_Rect trimmed = {img->trim_x, img->trim_y, img->clip.w, img->clip.h};
+    SDL_Rect part;
+    if(!SDL_IntersectRect(clip, &trimmed, &part)) return false;
+
+    // Move the quad over by as much as was cut off the clip (off the right, if the image is mirrored)
+    quad->x += flip ? clip->x + clip->w - part.x - part.w : part.x - clip->x;
+    quad->y += part.y - clip->y;
+    quad->w = part.w;
+    quad->h = part.h;
+    *clip = (SDL_Rect) {img->clip.x + part.x - trimmed.x, img->clip.y + part.y - trimmed.y, part.w, part.h};
+    return true;
+}
+
+/* PACKING */
+
+// Trim the transparent border off an image, noting where the rest of it starts and how big it is
+static void trimImage(SDL_Surface* sheet, struct atlas_image* image)
+{
+    image->clip = (SDL_Rect) {0, 0, 0, 0};
+    image->trim_x = image->trim_y = 0;
+    SDL_Rect bounds = {0, 0, sheet ? sheet->w : 0, sheet ? sheet->h : 0};
+    SDL_Rect area;
+    if(!SDL_IntersectRect(&image->source, &bounds, &area)) return;
+
+    // Find the opaque pixels' bounding box (the sheets are in ARGB8888, so alpha is the top byte)
+    int left = area.x + area.w, right = area.x - 1;
+    int top = area.y + area.h, bottom = area.y - 1;
+    for(int y = area.y; y < area.y + area.h; y++)
+    {
+        const Uint32* row = (const Uint32*) ((const char*) sheet->pixels + (size_t) y * sheet->pitch);
+        for(int x = area.x; x < area.x + area.w; x++)
+        {
+            if(!(row[x] >> 24)) continue;
+            if(x < left)   left = x;
+            if(x > right)  right = x;
+            if(y < top)    top = y;
+            if(y > bottom) bottom = y;
+        }
+    }
+    if(right < left) return;
+
+    image->trim_x = left - image->source.x;
+    image->trim_y = top - image->source.y;
+    image->clip.w = right - left + 1;
+    image->clip.h = bottom - top + 1;
+}
+
+// Whether a trimmed image goes on the shelves before another (tallest first, then widest)
+static bool shelvedBefore(const struct atlas_image* a, const struct atlas_image* b)
+{
+    return a->clip.h > b->clip.h || (a->clip.h == b->clip.h && a->clip.w > b->clip.w);
+}
+
+// Lay the trimmed images out on shelves across an atlas of the given width, in order, returning how tall the
+// atlas has to be
+static int shelveImages(struct atlas_image* images, const int* order, int n, int width)
+{
+    int x = ATLAS_PADDING, y = ATLAS_PADDING, shelf_height = 0;
+    for(int i = 0; i < n; i++)
+    {
+        SDL_Rect* clip = &images[order[i]].clip;
+        if(!clip->w || !clip->h) continue;
+
+        // Start a new shelf when the image doesn't fit on the current one
+        if(x + clip->w + ATLAS_PADDING > width)
+        {
+            x = ATLAS_PADDING;
+            y += shelf_height + ATLAS_PADDING;
+            shelf_height = 0;
+        }
+        clip->x = x;
+        clip->y = y;
+        x += clip->w + ATLAS_PADDING;
+        if(clip->h > shelf_height) shelf_height = clip->h;
+    }
+    return y + shelf_height + ATLAS_PADDING;
+}
+
+// Pack the images into an atlas, or take the packed atlas from the content pack if baked is given (work for a
+// load, which runs on a worker thread)
+static void* packAtlas(const void* baked)
+{
+    struct packed_atlas* packed = (struct packed_atlas*) malloc(sizeof(struct packed_atlas));
+    struct atlas_image* images = packed->images;
+    int n = num_atlas_images;
+    memcpy(images, atlas_images, sizeof(struct atlas_image) * n);
+
+    // The content pack's atlas is already packed
+    packed->surface = baked ? findPackImage("atlas pixels") : NULL;
+    if(packed->surface)
+    {
+        memcpy(images, ((const struct baked_atlas*) baked)->images, sizeof(struct atlas_image) * n);
+        return packed;
+    }
+
+    // Decode each sheet, in the format the atlas is made in
+    SDL_Surface* sheets[MAX_ATLAS_SHEETS];
+    for(int s = 0; s < num_atlas_sheets; s++)
+    {
+        sheets[s] = (SDL_Surface*) decodeBitmap(atlas_sheets[s]);
+        if(sheets[s] && sheets[s]->format->format != SDL_PIXELFORMAT_ARGB8888)
+        {
+            SDL_Surface* converted = SDL_ConvertSurfaceFormat(sheets[s], SDL_PIXELFORMAT_ARGB8888, 0);
+            SDL_FreeSurface(sheets[s]);
+            sheets[s] = converted;
+        }
+    }
+
+    // Trim every image, and sort them onto the shelves tallest first
+    int order[MAX_ATLAS_IMAGES];
+    int widest = 0;
+    for(int i = 0; i < n; i++)
+    {
+        trimImage(sheets[images[i].sheet], &images[i]);
+        if(images[i].clip.w > widest) widest = images[i].clip.w;
+
+        int j = i;
+        for(; j > 0 && shelvedBefore(&images[i], &images[order[j - 1]]); j--) order[j] = order[j - 1];
+        order[j] = i;
+    }
+
+    // Shelve them across each width the atlas could be, and keep whichever takes the least area
+    int width = MAX_ATLAS_WIDTH;
+    long long least_area = -1;
+    for(int w = MIN_ATLAS_WIDTH; w <= MAX_ATLAS_WIDTH; w *= 2)
+    {
+        if(widest + 2 * ATLAS_PADDING > w) continue;
+        long long area = (long long) w * shelveImages(images, order, n, w);
+        if(least_area < 0 || area < least_area)
+        {
+            least_area = area;
+            width = w;
+        }
+    }
+    int height = shelveImages(images, order, n, width);
+
+    // Copy each trimmed image into place (row by row, rather than blitting, which would blend the edges
+    // with the atlas's empty pixels)
+    packed->surface = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_ARGB8888);
+    for(int i = 0; i < n && packed->surface; i++)
+    {
+        const struct atlas_image* image = &images[i];
+        SDL_Surface* sheet = sheets[image->sheet];
+        for(int y = 0; y < image->clip.h; y++)
+        {
+            char* to = (char*) packed->surface->pixels + (size_t) (image->clip.y + y) * packed->surface->pitch;
+            const char* from = (const char*) sheet->pixels +
+                               (size_t) (image->source.y + image->trim_y + y) * sheet->pitch;
+            memcpy(to + image->clip.x * 4, from + (image->source.x + image->trim_x) * 4, image->clip.w * 4);
+        }
+    }
+
+    for(int s = 0; s < num_atlas_sheets; s++) SDL_FreeSurface(sheets[s]);
+    return packed;
+}
+
+/* DATA ALLOCATION / INITIALIZATION */
+
+// Make the packed atlas into a texture, and note where each image is in it
+static void finishAtlas(void* result, void* target)
+{
+    struct packed_atlas* packed = (struct packed_atlas*) result;
+    memcpy(atlas_images, packed->images, sizeof(struct atlas_image) * num_atlas_images);
+    atlas = makeTexture(packed->surface);
+    if(packed->surface)
+    {
+        atlas_width = packed->surface->w;
+        atlas_height = packed->surface->h;
+    }
+    SDL_FreeSurface(packed->surface);
+    free(packed);
+}
+
+// Check that an atlas in the content pack was baked with the same images as have been added
+static bool matchAtlas(const struct baked_atlas* baked)
+{
+    if(baked->num_images != num_atlas_images) return false;
+    for(int i = 0; i < num_atlas_images; i++)
+    {
+        const struct atlas_image* a = &baked->images[i];
+        const struct atlas_image* b = &atlas_images[i];
+        if(a->sheet != b->sheet || a->source.x != b->source.x || a->source.y != b->source.y ||
+           a->source.w != b->source.w || a->source.h != b->source.h) return false;
+    }
+    return true;
+}
+
+// Queue the atlas to be packed from the sheets (or taken from the content pack) and made into a texture
+void loadAtlas(void)
+{
+    // Without a renderer (in headless mode) there's nothing to draw the atlas with
+    if(!renderer) return;
+
+    // The content pack's atlas is only used if it was baked with the same images
+    size_t size;
+    const struct baked_atlas* baked = (const struct baked_atlas*) findPackData("atlas", &size);
+    if(baked && (size < sizeof(struct baked_atlas) || !matchAtlas(baked))) baked = NULL;
+    queueLoad(packAtlas, baked, finishAtlas, NULL);
+}
+
+/* CONTENT PACK */
+
+// Pack the atlas and bake it, along with where each image is in it, into the content pack being baked
+void bakeAtlas(void)
+{
+    struct packed_atlas* packed = (struct packed_atlas*) packAtlas(NULL);
+    struct baked_atlas* baked = (struct baked_atlas*) calloc(1, sizeof(struct baked_atlas));
+    baked->num_images = num_atlas_images;
+    memcpy(baked->images, packed->images, sizeof(struct atlas_image) * num_atlas_images);
+    bakeData("atlas", baked, sizeof(struct baked_atlas));
+    if(packed->surface) bakeSurface("atlas pixels", packed->surface);
+
+    free(baked);
+    SDL_FreeSurface(packed->surface);
+    free(packed);
+}
+
+/* DATA UNLOADING */
+
+// Free the atlas texture, and forget the images added to it
+void freeAtlas(void)
+{
+    SDL_DestroyTexture(atlas);
+    atlas = NULL;
+    atlas_width = atlas_height = 1;
+    num_atlas_images = 0;
+    num_atlas_sheets = 0;
+}
@@ -0,0 +1,92 @@
+#include "../headers/constants.h"
+#include "../headers/batch.h"
+
+SDL_Texture* batch_texture = NULL;                 // texture every quad in the batch samples
+float batch_width, batch_height;                   // size of the batch's texture, for texture coordinates
+int batch_quads = 0;                               // quads in the batch so far
+SDL_Vertex batch_vertices[MAX_BATCH_QUADS * 4];    // four corners per quad, clockwise from the upper-left
+int batch_indices[MAX_BATCH_QUADS * 6];            // two triangles per quad (never changes once built)
+float sines[360], cosines[360];                    // sine and cosine of each whole angle, in degrees
+bool tables_built = false;                         // whether the index buffer and trig tables are filled in
+
+// Fill in the index buffer and trig tables, which are the same for every batch
+static void buildTables(void)
+{
+    for(int i = 0; i < MAX_BATCH_QUADS; i++)
+    {
+        int* idx = batch_indices + 6 * i;
+        int v = 4 * i;
+        idx[0] = v; idx[1] = v + 1; idx[2] = v + 2;
+        idx[3] = v; idx[4] = v + 2; idx[5] = v + 3;
+    }
+    for(int a = 0; a < 360; a++)
+    {
+        sines[a] = (float) sin(a / 57.29578);
+        cosines[a] = (float) cos(a / 57.29578);
+    }
+    tables_built = true;
+}
+
+// Start batching quads from a texture (flushes the current batch if it uses another texture)
+void beginBatch(SDL_Texture* texture)
+{
+    if(!tables_built) buildTables();
+    if(texture == batch_texture) return;
+    flushBatch();
+    batch_texture = texture;
+    int w = 1, h = 1;
+    if(texture) SDL_QueryTexture(texture, NULL, NULL, &w, &h);
+    batch_width = w;
+    batch_height = h;
+}
+
+// Add a quad, drawing the clip of the batch's texture to the rect given, rotated clockwise by angle
+// degrees about center (relative to the rect's upper-left corner, or the rect's center if NULL) and
+// mirrored horizontally if flip is set
+void batchQuad(const SDL_Rect* clip, const SDL_Rect* quad, int angle, const SDL_FPoint* center, bool flip)
+{
+    if(!batch_texture) return;
+    if(batch_quads == MAX_BATCH_QUADS) flushBatch();
+
+    // Texture coordinates of the clip, with left and right swapped to mirror it
+    float u0 = clip->x / batch_width, u1 = (clip->x + clip->w) / batch_width;
+    float v0 = clip->y / batch_height, v1 = (clip->y + clip->h) / batch_height;
+    if(flip)
+    {
+        float u = u0;
+        u0 = u1;
+        u1 = u;
+    }
+
+    // Corners of the quad relative to the center of rotation
+    float px = center ? center->x : quad->w / 2.0f, py = center ? center->y : quad->h / 2.0f;
+    float cx = quad->x + px, cy = quad->y + py;
+    float dx[4] = {-px, quad->w - px, quad->w - px, -px};
+    float dy[4] = {-py, -py, quad->h - py, quad->h - py};
+    float u[4] = {u0, u1, u1, u0};
+    float v[4] = {v0, v0, v1, v1};
+
+    // Rotate the corners about the center (y points down, so positive angles turn clockwise)
+    int a = ((angle % 360) + 360) % 360;
+    float s = sines[a], c = cosines[a];
+    SDL_Vertex* vert = batch_vertices + 4 * batch_quads;
+    for(int i = 0; i < 4; i++)
+    {
+        vert[i].position.x = cx + dx[i] * c - dy[i] * s;
+        vert[i].position.y = cy + dx[i] * s + dy[i] * c;
+        vert[i].color = (SDL_Color) {255, 255, 255, 255};
+        vert[i].tex_coord.x = u[i];
+        vert[i].tex_coord.y = v[i];
+    }
+    batch_quads++;
+}
+
+// Draw every quad in the batch
+void flushBatch(void)
+{
+    if(batch_quads && batch_texture)
+    {
+        SDL_RenderGeometry(renderer, batch_texture, batch_vertices, 4 * batch_quads, batch_indices, 6 * batch_quads);
+    }
+    batch_quads = 0;
+}
@@ -1,13 +1,15 @@
 #include "../headers/constants.h"
 #include "../headers/sound.h"
 #include "../headers/interface.h"
+#include "../headers/atlas.h"
+#include "../headers/pack.h"
 
 // Struct for a toolbar element
 typedef struct toolbar_element
 {
     int id;            // which toolbar element is this (LOGO, HEALTH_BAR, etc)
-    int sheet_pos_x;   // x location on the sprite sheet
-    int sheet_pos_y;   // y location on the sprite sheet
+    int sheet_pos_x;   // x location on the toolbar sheet
+    int sheet_pos_y;   // y location on the toolbar sheet
     int width;         // width in pixels
     int height;        // height in pixels
     double x;          // x position to render to
@@ -23,11 +25,40 @@ typedef struct menu_selection
     int mode_out;      // mode this option redirects to
 }* Selection;
 
-SDL_Texture* toolbar;       // Texture containing all toolbar elements
+// The toolbar elements and menu options as they're baked into a content pack
+struct baked_interface
+{
+    int num_elements;                                       // NUM_ELEMENTS and NUM_MENU_OPTIONS when baked, to
+    int num_menu_options;                                   // tell apart a pack baked with a different layout
+    struct toolbar_element elements[NUM_ELEMENTS];
+    struct menu_selection menu_options[NUM_MENU_OPTIONS];
+};
+
+// Struct for a piece of text whose glyph quads have already been laid out
+typedef struct cached_text
+{
+    Uint32 hash;                                 // hash of the text, position, and alignment
+    char text[MAX_TEXT_LENGTH + 1];              // the text itself
+    int x, y, align;                             // where the text was laid out, and how
+    int len;                                     // number of glyphs
+    int fade;                                    // alpha the vertices are currently colored with
+    long long last_used;                         // render call the text was last drawn in, for eviction
+    SDL_Vertex vertices[MAX_TEXT_LENGTH * 4];    // four corners per glyph
+} CachedText;
+
 Tool* element_list;         // Array of all toolbar elements
 Selection* menu_selections; // Array containing locations and return values of select arrows
 int score = 0;              // The score, for 1-player games
 
+CachedText text_cache[TEXT_CACHE_SIZE];        // Laid out text, reused for as long as it keeps being drawn
+int text_indices[MAX_TEXT_LENGTH * 6];         // Two triangles per glyph (the same for every piece of text)
+int element_images[NUM_ELEMENTS];              // Atlas image of each toolbar element (the health bar's is followed
+                                               // by its fill)
+int glyph_images;                              // Atlas image of the first glyph (the rest follow in order)
+long long text_clock = 0;                      // Number of times the interface has been rendered
+char score_text[7];                            // The score as renderText reads it
+int score_text_value = -1;                     // Score that score_text currently holds
+
 /* SETTERS */
 
 // Move the text selection arrow
@@ -88,33 +119,49 @@ void updateScore(int points)
 
 /* GETTERS */
 
-// Convert an integer score into a string readable by renderText
-static char* stringScore(int score)
+// Get the current score
+int getScore(void)
 {
-    // Copy number into buffer
-    char* str = (char*) malloc(sizeof(char) * 7);
-    sprintf(str, "%06d", score);
+    return score;
+}
 
-    // Swap out zeros for the letter O
-    for(int i = 0; i < 6; i++)
+// Get the score as a string readable by renderText (only rewritten when the score changes)
+static const char* stringScore(void)
+{
+    if(score != score_text_value)
     {
-        if(str[i] == '0') str[i] = 'O';
+        // Copy number into buffer
+        sprintf(score_text, "%06d", score);
+
+        // Swap out zeros for the letter O
+        for(int i = 0; i < 6; i++)
+        {
+            if(score_text[i] == '0') score_text[i] = 'O';
+        }
+        score_text_value = score;
     }
-    return str;
+    return score_text;
 }
 
 /* ELEMENT RENDERING */
 
+// Render part of an image from the atlas to the screen (the clip is relative to the image's upper-left corner,
+// and is drawn at its own size)
+static void renderImage(int image, SDL_Rect clip, SDL_Rect renderQuad)
+{
+    if(clipAtlas(image, &clip, &renderQuad, false)) SDL_RenderCopy(renderer, getAtlas(), &clip, &renderQuad);
+}
+
 // Render the guys' cooldown meters (alpha blended black bars)
 static void renderCooldowns(double* guy1_cds, double* guy2_cds)
 {
     // Starting location for cooldown meter
     Tool bar = element_list[COOLDOWN_BAR];
-    SDL_Rect clip = {bar->sheet_pos_x, bar->sheet_pos_y, bar->width, bar->height};
+    SDL_Rect clip = {0, 0, bar->width, bar->height};
     SDL_Rect renderQuad = {(int) bar->x, (int) bar->y, bar->width, bar->height};
 
     // Render cooldown meters on each spell for each guy
-    SDL_SetTextureAlphaMod(toolbar, 125);
+    SDL_SetTextureAlphaMod(getAtlas(), 125);
     for(int i = 0; guy1_cds[i] >= 0; i++)
     {
         // Render cooldown meter of spell i for first Guy
@@ -122,7 +169,7 @@ static void renderCooldowns(double* guy1_cds, double* guy2_cds)
         clip.w = cooled_down;
         renderQuad.w = cooled_down;
         renderQuad.x = (int) bar->x + i * 60;
-        SDL_RenderCopy(renderer, toolbar, &clip, &renderQuad);
+        renderImage(element_images[COOLDOWN_BAR], clip, renderQuad);
 
         // Render cooldown meter of spell i for second Guy if in VS mode
         if(guy2_cds)
@@ -132,10 +179,10 @@ static void renderCooldowns(double* guy1_cds, double* guy2_cds)
             renderQuad.w = cooled_down;
             Tool hp_bar = element_list[HEALTH_BAR];
             renderQuad.x = SCREEN_WIDTH - hp_bar->width - (int) hp_bar->x + 36 + i * 60;
-            SDL_RenderCopy(renderer, toolbar, &clip, &renderQuad);
+            renderImage(element_images[COOLDOWN_BAR], clip, renderQuad);
         }
     }
-    SDL_SetTextureAlphaMod(toolbar, 255);
+    SDL_SetTextureAlphaMod(getAtlas(), 255);
 }
 
 // Render the guys' healthbars
@@ -143,23 +190,22 @@ static void renderHealthbars(int guy1_hp, int guy2_hp)
 {
     // Render guy 1 outline
     Tool hp_bar = element_list[HEALTH_BAR];
-    SDL_Rect clip = {hp_bar->sheet_pos_x, hp_bar->sheet_pos_y, hp_bar->width, hp_bar->height};
+    SDL_Rect clip = {0, 0, hp_bar->width, hp_bar->height};
     SDL_Rect renderQuad = {(int)hp_bar->x, (int)hp_bar->y, hp_bar->width, hp_bar->height};
-    SDL_RenderCopy(renderer, toolbar, &clip, &renderQuad);
+    renderImage(element_images[HEALTH_BAR], clip, renderQuad);
 
     // Render guy 2 outline if in VS mode
     if(guy2_hp != -1)
     {
         renderQuad.x = SCREEN_WIDTH - hp_bar->width - (int)hp_bar->x;
-        SDL_RenderCopy(renderer, toolbar, &clip, &renderQuad);
+        renderImage(element_images[HEALTH_BAR], clip, renderQuad);
         renderQuad.x = (int)hp_bar->x;
     }
 
-    // Render health remaining for Guy 1
-    clip.x += hp_bar->width;
+    // Render health remaining for Guy 1 (the fill is the image after the outline)
     clip.w = 25 + guy1_hp * 3;
     renderQuad.w = 25 + guy1_hp * 3;
-    SDL_RenderCopy(renderer, toolbar, &clip, &renderQuad);
+    renderImage(element_images[HEALTH_BAR] + 1, clip, renderQuad);
 
     // Render health remaining for Guy 2 if in VS mode
     if(guy2_hp != -1)
@@ -167,7 +213,7 @@ static void renderHealthbars(int guy1_hp, int guy2_hp)
         clip.w = 25 + guy2_hp * 3;
         renderQuad.x = SCREEN_WIDTH - hp_bar->width - (int)hp_bar->x + (300 - guy2_hp * 3);
         renderQuad.w = 25 + guy2_hp * 3;
-        SDL_RenderCopy(renderer, toolbar, &clip, &renderQuad);
+        renderImage(element_images[HEALTH_BAR] + 1, clip, renderQuad);
     }
 }
 
@@ -176,10 +222,10 @@ static void renderLogo(long long frame)
 {
     // Render the logo, idling according to the frame
     Tool logo = element_list[LOGO];
-    SDL_Rect clip = {logo->sheet_pos_x, logo->sheet_pos_y, logo->width, logo->height};
+    SDL_Rect clip = {0, 0, logo->width, logo->height};
     SDL_Rect renderQuad = {(int)logo->x, (int)logo->y, logo->width, logo->height};
     renderQuad.y -= ((frame / 30) % 2);
-    SDL_RenderCopy(renderer, toolbar, &clip, &renderQuad);
+    renderImage(element_images[LOGO], clip, renderQuad);
 }
 
 // Render the selection arrow
@@ -211,23 +257,41 @@ static void renderSelectionArrow(int mode, long long frame)
     }
 
     // Render the selection arrow, idling according to the frame
-    SDL_Rect clip = {arrow->sheet_pos_x, arrow->sheet_pos_y, arrow->width, arrow->height};
+    SDL_Rect clip = {0, 0, arrow->width, arrow->height};
     SDL_Rect renderQuad = {(int)arrow->x, (int)arrow->y, arrow->width, arrow->height};
     renderQuad.x -= ((frame / 50) % 2);
-    SDL_RenderCopy(renderer, toolbar, &clip, &renderQuad);
+    renderImage(element_images[ARROW], clip, renderQuad);
 }
 
-// Render a piece of text to the screen
-static void renderText(const char* text, int x, int y, int align, int fade)
+// Hash a piece of text along with where and how it is laid out (FNV-1a)
+static Uint32 hashText(const char* text, int x, int y, int align)
 {
+    Uint32 hash = 2166136261u;
+    for(int i = 0; text[i]; i++) hash = (hash ^ (Uint8) text[i]) * 16777619u;
+    int key[3] = {x, y, align};
+    for(int i = 0; i < 3; i++) hash = (hash ^ (Uint32) key[i]) * 16777619u;
+    return hash;
+}
+
+// Lay out a piece of text as glyph quads from the atlas
+static void layoutText(CachedText* t, Uint32 hash, const char* text, int x, int y, int align)
+{
+    // Remember what was laid out (longer text is cut off)
+    t->hash = hash;
+    t->len = (int) fmin(strlen(text), MAX_TEXT_LENGTH);
+    memcpy(t->text, text, t->len);
+    t->text[t->len] = '\0';
+    t->x = x; t->y = y; t->align = align;
+    t->fade = 255;
+
     // Set initial cursor position based on text align type
-    int len = (int) strlen(text);
+    int atlas_width, atlas_height;
+    getAtlasSize(&atlas_width, &atlas_height);
     int cursor = x;
-    if(align == C) cursor = x - (len * FONT_SIZE / 2);
+    if(align == C) cursor = x - (t->len * FONT_SIZE / 2);
 
     // Iterate over string
-    SDL_SetTextureAlphaMod(toolbar, fade);
-    for(int i = 0; i < len; i++)
+    for(int i = 0; i < t->len; i++)
     {
         // ASCII shenanigans
         char c = text[i];
@@ -235,17 +299,54 @@ static void renderText(const char* text, int x, int y, int align, int fade)
         if(c >= 49 && c <= 57) c += 42;
         c -= 65;
 
-        // Convert char value to texture clip
-        int clipx = FONT_SIZE * (c % 10);
-        int clipy = 351 + FONT_SIZE * (c / 10);
-
-        // Render character and move cursor
-        SDL_Rect clip = {clipx, clipy, FONT_SIZE, FONT_SIZE};
-        SDL_Rect renderQuad = {cursor, y, FONT_SIZE, FONT_SIZE};
-        SDL_RenderCopy(renderer, toolbar, &clip, &renderQuad);
+        // Find the glyph's trimmed pixels in the atlas (blank glyphs get an empty quad), and convert them to
+        // texture coordinates
+        SDL_Rect clip = {0, 0, FONT_SIZE, FONT_SIZE};
+        SDL_Rect quad = {cursor, y, FONT_SIZE, FONT_SIZE};
+        if(c < 0 || c >= FONT_ROWS * 10 || !clipAtlas(glyph_images + c, &clip, &quad, false)) quad.w = quad.h = 0;
+        float u0 = (float) clip.x / atlas_width;
+        float v0 = (float) clip.y / atlas_height;
+        float u1 = (float) (clip.x + clip.w) / atlas_width;
+        float v1 = (float) (clip.y + clip.h) / atlas_height;
+
+        // Place the character's corners and move cursor
+        SDL_Vertex* v = t->vertices + 4 * i;
+        v[0] = (SDL_Vertex) {{quad.x, quad.y}, {255, 255, 255, 255}, {u0, v0}};
+        v[1] = (SDL_Vertex) {{quad.x + quad.w, quad.y}, {255, 255, 255, 255}, {u1, v0}};
+        v[2] = (SDL_Vertex) {{quad.x + quad.w, quad.y + quad.h}, {255, 255, 255, 255}, {u1, v1}};
+        v[3] = (SDL_Vertex) {{quad.x, quad.y + quad.h}, {255, 255, 255, 255}, {u0, v1}};
         cursor += FONT_SIZE;
     }
-    SDL_SetTextureAlphaMod(toolbar, 255);
+}
+
+// Find a piece of text in the cache, laying it out in the least recently used slot if it isn't there
+static CachedText* cacheText(const char* text, int x, int y, int align)
+{
+    Uint32 hash = hashText(text, x, y, align);
+    CachedText* oldest = &text_cache[0];
+    for(int i = 0; i < TEXT_CACHE_SIZE; i++)
+    {
+        CachedText* t = &text_cache[i];
+        if(t->hash == hash && t->x == x && t->y == y && t->align == align && !strcmp(t->text, text)) return t;
+        if(t->last_used < oldest->last_used) oldest = t;
+    }
+    layoutText(oldest, hash, text, x, y, align);
+    return oldest;
+}
+
+// Render a piece of text to the screen, in one draw call
+static void renderText(const char* text, int x, int y, int align, int fade)
+{
+    CachedText* t = cacheText(text, x, y, align);
+    t->last_used = text_clock;
+
+    // Fade the text through its vertex colors, rather than the whole atlas's alpha
+    if(t->fade != fade)
+    {
+        for(int i = 0; i < 4 * t->len; i++) t->vertices[i].color.a = fade;
+        t->fade = fade;
+    }
+    SDL_RenderGeometry(renderer, getAtlas(), t->vertices, 4 * t->len, text_indices, 6 * t->len);
 }
 
 /* PER FRAME UPDATE */
@@ -255,6 +356,7 @@ void renderInterface(int mode, long long frame, int guy1_hp, int guy2_hp, double
 {
     int alpha_max = 255;
     int x = SCREEN_WIDTH / 2;
+    text_clock++;
     int margin = FONT_SIZE + 10;
     switch(mode)
     {
@@ -313,25 +415,23 @@ void renderInterface(int mode, long long frame, int guy1_hp, int guy2_hp, double
         case AI:
         {
             int y = 25;
-            char* score_string = stringScore(score);
+            const char* score_string = stringScore();
             renderHealthbars(guy1_hp, -1);
             renderCooldowns(guy1_cds, NULL);
             renderText("SCORE",      600, y, L, alpha_max);
             renderText(score_string, 780, y, L, alpha_max);
-            free(score_string);
             break;
         }
 
         case PAUSE:
         {
             int y = 25;
-            char* score_string = stringScore(score);
+            const char* score_string = stringScore();
             renderHealthbars(guy1_hp, -1);
             renderCooldowns(guy1_cds, NULL);
             renderText("PAUSED",     x,   280, C, alpha_max);
             renderText("SCORE",      600, y,   L, alpha_max);
             renderText(score_string, 780, y,   L, alpha_max);
-            free(score_string);
             break;
         }
 
@@ -344,15 +444,12 @@ void renderInterface(int mode, long long frame, int guy1_hp, int guy2_hp, double
         case GAME_OVER_AI:
         {
             int y = 280;
-            char* score_string = stringScore(score);
+            const char* score_string = stringScore();
             renderText("GAME OVER",  x,       y,            C, alpha_max);
             renderText("SCORE",      x - 100, y + 2*margin, C, alpha_max);
             renderText(score_string, x + 80,  y + 2*margin, C, alpha_max);
-            free(score_string);
         }
     }
-    free(guy1_cds);
-    free(guy2_cds);
 }
 
 /* DATA ALLOCATION / INITIALIZATION */
@@ -379,31 +476,90 @@ static Selection initMenuOption(int mode_in, int mode_out, double x, double y)
     return this_option;
 }
 
-// Load the toolbar texture, toolbar elements, and selection text into memory
+// Add the toolbar elements and the alphabet to the atlas, from the toolbar sheet
+static void addInterfaceImages(void)
+{
+    for(int i = 0; i < NUM_ELEMENTS; i++)
+    {
+        Tool tool = element_list[i];
+        element_images[i] = addAtlasImages("art/Toolbar.bmp", tool->sheet_pos_x, tool->sheet_pos_y, tool->width,
+                                           tool->height, i == HEALTH_BAR ? 2 : 1);
+    }
+    for(int row = 0; row < FONT_ROWS; row++)
+    {
+        int first = addAtlasImages("art/Toolbar.bmp", 0, 351 + FONT_SIZE * row, FONT_SIZE, FONT_SIZE, 10);
+        if(!row) glyph_images = first;
+    }
+}
+
+// Load the toolbar elements and selection text into memory, and add their images to the atlas
 void loadInterface(void)
 {
-    // Load the texture containing all toolbar elements and the alphabet
-    toolbar = loadTexture("art/Toolbar.bmp");
+    // Text is drawn as glyph quads, two triangles each, laid out once and cached
+    for(int i = 0; i < MAX_TEXT_LENGTH; i++)
+    {
+        int* idx = text_indices + 6 * i;
+        int v = 4 * i;
+        idx[0] = v; idx[1] = v + 1; idx[2] = v + 2;
+        idx[3] = v; idx[4] = v + 2; idx[5] = v + 3;
+    }
 
-    // Make space for the toolbar elements and initialize them
+    // Make space for the toolbar elements and menu options
     element_list = (Tool*) malloc(NUM_ELEMENTS * sizeof(Tool));
+    menu_selections = (Selection*) malloc(NUM_MENU_OPTIONS * sizeof(Selection));
+
+    // Copy them from the content pack if there is one (they're copied since the arrow moves)
+    size_t size;
+    const struct baked_interface* baked = (const struct baked_interface*) findPackData("interface", &size);
+    if(baked && size >= sizeof(struct baked_interface) && baked->num_elements == NUM_ELEMENTS &&
+       baked->num_menu_options == NUM_MENU_OPTIONS)
+    {
+        for(int i = 0; i < NUM_ELEMENTS; i++)
+        {
+            element_list[i] = (Tool) malloc(sizeof(struct toolbar_element));
+            *element_list[i] = baked->elements[i];
+        }
+        for(int i = 0; i < NUM_MENU_OPTIONS; i++)
+        {
+            menu_selections[i] = (Selection) malloc(sizeof(struct menu_selection));
+            *menu_selections[i] = baked->menu_options[i];
+        }
+        addInterfaceImages();
+        return;
+    }
+
+    // Or else initialize them from the tables
     element_list[COOLDOWN_BAR] = initTool(COOLDOWN_BAR, 700, 0, 39, 39, 86, 64);
     element_list[HEALTH_BAR] = initTool(HEALTH_BAR, 0, 0, 350, 80, 50, 25);
     element_list[LOGO] = initTool(LOGO, 0, 100, 520, 225, 258, 50);
     element_list[ARROW] = initTool(ARROW, 150, 441, FONT_SIZE, FONT_SIZE, 287, 300);
 
-    // Make space for the different menu options and initialize them
-    menu_selections = (Selection*) malloc(NUM_MENU_OPTIONS * sizeof(Selection));
     menu_selections[0] = initMenuOption(TITLE, VS, 370, 300);
     menu_selections[1] = initMenuOption(TITLE, AI, 370, 300 + FONT_SIZE + 10);
     menu_selections[2] = initMenuOption(TITLE, CONTROLS, 370, 300 + (FONT_SIZE + 10) * 2);
     menu_selections[3] = initMenuOption(STAGE_SELECT, 0, 250, 120);
     menu_selections[4] = initMenuOption(STAGE_SELECT, 1, 250, 120 + FONT_SIZE + 10);
+    addInterfaceImages();
+}
+
+/* CONTENT PACK */
+
+// Bake the toolbar elements and menu options into the content pack being baked (the toolbar sheet is baked
+// into the atlas)
+void bakeInterface(void)
+{
+    struct baked_interface baked;
+    memset(&baked, 0, sizeof(struct baked_interface));
+    baked.num_elements = NUM_ELEMENTS;
+    baked.num_menu_options = NUM_MENU_OPTIONS;
+    for(int i = 0; i < NUM_ELEMENTS; i++) baked.elements[i] = *element_list[i];
+    for(int i = 0; i < NUM_MENU_OPTIONS; i++) baked.menu_options[i] = *menu_selections[i];
+    bakeData("interface", &baked, sizeof(struct baked_interface));
 }
 
 /* DATA UNLOADING */
 
-// Free the toolbar elements, selection options, and toolbar texture from memory
+// Free the toolbar elements and selection options from memory
 void freeInterface(void)
 {
     for(int i = 0; i < NUM_ELEMENTS; i++) free(element_list[i]);
@@ -411,6 +567,4 @@ void freeInterface(void)
 
     for(int i = 0; i < NUM_MENU_OPTIONS; i++) free(menu_selections[i]);
     free(menu_selections);
-
-    SDL_DestroyTexture(toolbar);
 }
@@ -0,0 +1,175 @@
+#include "../headers/constants.h"
+#include "../headers/jobs.h"
+
+// Each thread's run of items is kept as its front and back packed into one atomic, so that the owner (taking
+// from the front) and thieves (taking from the back) can never both take the last item
+#define PACK_RUN(front, back) ((front) | ((back) << 16))
+#define RUN_FRONT(run) ((run) & 0xFFFF)
+#define RUN_BACK(run) ((run) >> 16)
+
+// The worker pool (the main thread works on each parallel-for too, with run 0)
+SDL_Thread* job_threads[MAX_JOB_THREADS];
+int num_job_threads = 0;                 // worker threads started
+SDL_atomic_t runs[MAX_JOB_THREADS];      // items each thread has left in the current parallel-for
+
+// The current parallel-for (the fields below are guarded by job_lock)
+JobWork job_work = NULL;
+void* job_data = NULL;
+int job_generation = 0;                  // parallel-fors ever started, so workers can tell when a new one starts
+int workers_done = 0;                    // workers which have run out of items in the current parallel-for
+bool jobs_quit = false;                  // set to tell the workers to finish
+SDL_mutex* job_lock = NULL;
+SDL_cond* job_started = NULL;            // signalled when a parallel-for starts, or the workers should quit
+SDL_cond* job_finished = NULL;           // signalled when the last worker runs out of items
+
+/* WORKERS */
+
+// Take the item at the front of a thread's own run, returning -1 if the run is empty
+static int takeItem(int thread)
+{
+    while(true)
+    {
+        int run = SDL_AtomicGet(&runs[thread]);
+        int front = RUN_FRONT(run);
+        int back = RUN_BACK(run);
+        if(front >= back) return -1;
+        if(SDL_AtomicCAS(&runs[thread], run, PACK_RUN(front + 1, back))) return front;
+    }
+}
+
+// Steal the item at the back of another thread's run, returning -1 if every other run is empty
+static int stealItem(int thread)
+{
+    for(int i = 1; i <= num_job_threads; i++)
+    {
+        // Each thread starts with the thread after it, so thieves spread out over the runs
+        int victim = (thread + i) % (num_job_threads + 1);
+        while(true)
+        {
+            int run = SDL_AtomicGet(&runs[victim]);
+            int front = RUN_FRONT(run);
+            int back = RUN_BACK(run);
+            if(front >= back) break;
+            if(SDL_AtomicCAS(&runs[victim], run, PACK_RUN(front, back - 1))) return back - 1;
+        }
+    }
+    return -1;
+}
+
+// Work on items of the current parallel-for until there are none left to take
+static void workItems(int thread)
+{
+    while(true)
+    {
+        int item = takeItem(thread);
+        if(item == -1) item = stealItem(thread);
+        if(item == -1) return;
+        job_work(job_data, item);
+    }
+}
+
+// Wait for parallel-fors to start and work on them until told to quit (runs on a worker thread)
+static int runJobs(void* data)
+{
+    int thread = (int) (intptr_t) data;
+    int generation = 0;
+    SDL_LockMutex(job_lock);
+    while(true)
+    {
+        while(job_generation == generation && !jobs_quit) SDL_CondWait(job_started, job_lock);
+        if(jobs_quit) break;
+        generation = job_generation;
+
+        // Work with the lock released, then check in so the parallel-for can return once every worker has
+        SDL_UnlockMutex(job_lock);
+        workItems(thread);
+        SDL_LockMutex(job_lock);
+        if(++workers_done == num_job_threads) SDL_CondSignal(job_finished);
+    }
+    SDL_UnlockMutex(job_lock);
+    return 0;
+}
+
+/* SETTERS */
+
+// Do work for every item in [0, count) across the threads, returning once every item is done
+void parallelFor(int count, JobWork work, void* data)
+{
+    // Without workers (or with too little to share), the items are just worked through here
+    if(!num_job_threads || count < 2 || count > MAX_JOB_ITEMS)
+    {
+        for(int item = 0; item < count; item++) work(data, item);
+        return;
+    }
+
+    // Deal the items out in one contiguous run per thread
+    int threads = num_job_threads + 1;
+    for(int thread = 0; thread < threads; thread++)
+    {
+        SDL_AtomicSet(&runs[thread], PACK_RUN(count * thread / threads, count * (thread + 1) / threads));
+    }
+
+    // Wake the workers, work alongside them, then wait for every worker to run out of items
+    SDL_LockMutex(job_lock);
+    job_work = work;
+    job_data = data;
+    workers_done = 0;
+    job_generation++;
+    SDL_CondBroadcast(job_started);
+    SDL_UnlockMutex(job_lock);
+    workItems(0);
+    SDL_LockMutex(job_lock);
+    while(workers_done < num_job_threads) SDL_CondWait(job_finished, job_lock);
+    SDL_UnlockMutex(job_lock);
+}
+
+/* GETTERS */
+
+// Get the number of threads which work on a parallel-for, including the one which starts it
+int jobThreads(void)
+{
+    return num_job_threads + 1;
+}
+
+/* DATA ALLOCATION / INITIALIZATION */
+
+// Start the worker threads
+void startJobs(void)
+{
+    job_lock = SDL_CreateMutex();
+    job_started = SDL_CreateCond();
+    job_finished = SDL_CreateCond();
+    if(!job_lock || !job_started || !job_finished) return;
+
+    // One thread per core, counting the main thread (if no workers can be started, parallel-fors just run
+    // on the main thread)
+    jobs_quit = false;
+    job_generation = 0;
+    int cores = fmax(1, fmin(MAX_JOB_THREADS, SDL_GetCPUCount()));
+    for(int i = 1; i < cores; i++)
+    {
+        job_threads[num_job_threads] = SDL_CreateThread(runJobs, "jobs", (void*) (intptr_t) (num_job_threads + 1));
+        if(job_threads[num_job_threads]) num_job_threads++;
+    }
+}
+
+/* DATA UNLOADING */
+
+// Stop the worker threads
+void stopJobs(void)
+{
+    if(num_job_threads)
+    {
+        SDL_LockMutex(job_lock);
+        jobs_quit = true;
+        SDL_CondBroadcast(job_started);
+        SDL_UnlockMutex(job_lock);
+        for(int i = 0; i < num_job_threads; i++) SDL_WaitThread(job_threads[i], NULL);
+        num_job_threads = 0;
+    }
+    if(job_finished) SDL_DestroyCond(job_finished);
+    if(job_started) SDL_DestroyCond(job_started);
+    if(job_lock) SDL_DestroyMutex(job_lock);
+    job_lock = NULL;
+    job_started = job_finished = NULL;
+}
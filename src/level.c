@@ -1,12 +1,15 @@
 #include "../headers/constants.h"
 #include "../headers/sound.h"
 #include "../headers/level.h"
+#include "../headers/loader.h"
+#include "../headers/pack.h"
 
 // Struct for background information
 typedef struct background
 {
     // Meta info about the background
-    SDL_Texture* image;         // texture for this background
+    const char* path;           // bitmap the texture is loaded from
+    SDL_Texture* image;         // texture for this background (NULL unless its level is resident)
     int width;                  // image width in pixels
     int height;                 // image height in pixels
     int x_init;                 // initial x rendering position
@@ -18,6 +21,8 @@ typedef struct background
     // State info about the background
     double x;                   // current x position
     double y;                   // current y position
+    double prev_x;              // x position at the previous tick, for interpolated rendering
+    double prev_y;              // y position at the previous tick, for interpolated rendering
     double x_vel;               // current x velocity
     double y_vel;               // current y velocity
 
@@ -26,29 +31,211 @@ typedef struct background
 // Struct for foreground information
 typedef struct foreground
 {
-    SDL_Texture* image;         // texture for this foreground
+    const char* path;           // bitmap the pixels are loaded from
+    SDL_Surface* image;         // pixels of this foreground, which are uploaded a tile at a time (NULL unless
+                                // its level is resident)
+    int width;                  // width of the level in pixels
+    int height;                 // height of the level in pixels
+    int tile_columns;           // number of tiles across the foreground
+    int tile_rows;              // number of tiles down the foreground
+    SDL_Texture** tiles;        // texture of each tile, row by row (NULL unless it's in view)
+    int* resident;              // indices of the tiles which currently have textures
+    int num_resident;           // number of tiles which currently have textures
     int* platforms;             // { pf1_y, pf1_x1, pf1_x2, pf2_y, ... } pf1 is the ground by convention
     int* walls;                 // { wall1_x, wall1_y1, wall1_y2, wall2_x, ... }
     int* starting_positions;    // { guy1_x, guy1_y, guy2_x, guy2_y }
+    Terrain terrain;            // platforms and walls indexed by x-column
 }* Foreground;
 
+// A level as it's baked into a content pack, followed by its foreground's platforms and walls (laid out as a
+// foreground's are), and then padding up to PACK_ALIGN
+struct baked_level
+{
+    char background_path[PACK_NAME_LENGTH];
+    char foreground_path[PACK_NAME_LENGTH];
+    int drift_type;
+    int background_width;
+    int background_height;
+    int x_init;
+    int y_init;
+    double xv_init;
+    double yv_init;
+    int width;                  // size of the level
+    int height;
+    int starting_positions[4];
+    int platforms_size;         // number of ints in the platforms array
+    int walls_size;             // number of ints in the walls array
+};
+
 // Types of background behavior
 enum drift_types
 { SCROLL, DRIFT };
 
+// Whether a level's images are in memory
+enum residency
+{ UNLOADED, LOADING, RESIDENT };
+
+// Struct for the residency of a level's images (its background's texture and its foreground's pixels)
+typedef struct level_images
+{
+    int state;                  // UNLOADED, LOADING, or RESIDENT
+    int pending;                // images still being loaded
+    int tickets[2];             // tickets of the loads of its background and foreground, for waiting on them
+    size_t bytes;               // memory taken by the images loaded
+    unsigned long long last_used; // when the level was last used or asked for, for freeing the least recent
+} LevelImages;
+
 Background* backgrounds = NULL; // Array of existing backgrounds
 Foreground* foregrounds = NULL; // Array of existing foregrounds
 
 int current_background = FOREST; // Current background
 int current_foreground = FOREST; // Current foreground
+int tiles_foreground = FOREST;   // Foreground whose tiles are loaded
+bool levels_baked = false;       // Whether the levels' geometry is in the content pack
+
+LevelImages level_images[NUM_FOREGROUNDS]; // Residency of each level's images
+size_t resident_bytes = 0;                 // Memory taken by every level's images
+unsigned long long level_uses = 0;         // Times any level has been used or asked for
+
+SDL_Rect view = {0, 0, SCREEN_WIDTH, SCREEN_HEIGHT}; // Part of the level on screen
+
+/* LEVEL RESIDENCY */
+
+// Upload one tile of a foreground's pixels to a texture
+static void loadTile(Foreground fg, int tile)
+{
+    // The tile's surface points into the foreground's pixels, so nothing is copied until the upload
+    SDL_Surface* image = fg->image;
+    int x = (tile % fg->tile_columns) * FOREGROUND_TILE_SIZE;
+    int y = (tile / fg->tile_columns) * FOREGROUND_TILE_SIZE;
+    int w = fmin(FOREGROUND_TILE_SIZE, image->w - x);
+    int h = fmin(FOREGROUND_TILE_SIZE, image->h - y);
+    char* pixels = (char*) image->pixels + y * image->pitch + x * image->format->BytesPerPixel;
+    SDL_Surface* sub = SDL_CreateRGBSurfaceWithFormatFrom(pixels, w, h, image->format->BitsPerPixel, image->pitch,
+                                                          image->format->format);
+    fg->tiles[tile] = SDL_CreateTextureFromSurface(renderer, sub);
+    SDL_FreeSurface(sub);
+    fg->resident[fg->num_resident++] = tile;
+}
+
+// Free the textures of a foreground's tiles, keeping those within a tile of the view if keep_near is set
+static void unloadTiles(Foreground fg, bool keep_near)
+{
+    for(int r = fg->num_resident - 1; r >= 0; r--)
+    {
+        int tile = fg->resident[r];
+        int x = (tile % fg->tile_columns) * FOREGROUND_TILE_SIZE;
+        int y = (tile / fg->tile_columns) * FOREGROUND_TILE_SIZE;
+        if(keep_near && x + 2 * FOREGROUND_TILE_SIZE > view.x && x - FOREGROUND_TILE_SIZE < view.x + view.w
+        && y + 2 * FOREGROUND_TILE_SIZE > view.y && y - FOREGROUND_TILE_SIZE < view.y + view.h) continue;
+
+        SDL_DestroyTexture(fg->tiles[tile]);
+        fg->tiles[tile] = NULL;
+        fg->resident[r] = fg->resident[--fg->num_resident];
+    }
+}
+
+// Free a level's images (its foreground's tiles go with them)
+static void unloadLevel(int level)
+{
+    Foreground fg = foregrounds[level];
+    unloadTiles(fg, false);
+    SDL_FreeSurface(fg->image);
+    fg->image = NULL;
+    SDL_DestroyTexture(backgrounds[level]->image);
+    backgrounds[level]->image = NULL;
+
+    resident_bytes -= level_images[level].bytes;
+    level_images[level].bytes = 0;
+    level_images[level].state = UNLOADED;
+}
+
+// Free the least recently used levels' images until the levels resident fit in the budget
+static void evictLevels(void)
+{
+    while(resident_bytes > LEVEL_IMAGE_BUDGET)
+    {
+        // Levels still loading, and the current level, are never freed
+        int lru = -1;
+        for(int i = 0; i < NUM_FOREGROUNDS; i++)
+        {
+            if(level_images[i].state != RESIDENT || i == current_foreground) continue;
+            if(lru < 0 || level_images[i].last_used < level_images[lru].last_used) lru = i;
+        }
+        if(lru < 0) return;
+        unloadLevel(lru);
+    }
+}
+
+// Note that one of a level's images has loaded, taking up the given memory
+static void finishLevelImage(LevelImages* images, size_t bytes)
+{
+    images->bytes += bytes;
+    resident_bytes += bytes;
+    if(--images->pending == 0)
+    {
+        images->state = RESIDENT;
+        evictLevels();
+    }
+}
+
+// Make a level's decoded background into a texture
+static void finishBackgroundImage(void* surface, void* target)
+{
+    LevelImages* images = (LevelImages*) target;
+    Background bg = backgrounds[images - level_images];
+    SDL_Surface* loaded = (SDL_Surface*) surface;
+    bg->image = makeTexture(loaded);
+    finishLevelImage(images, bg->image ? (size_t) loaded->w * loaded->h * 4 : 0);
+    SDL_FreeSurface(loaded);
+}
+
+// Keep a level's decoded foreground pixels, which are uploaded a tile at a time
+static void finishForegroundImage(void* surface, void* target)
+{
+    LevelImages* images = (LevelImages*) target;
+    Foreground fg = foregrounds[images - level_images];
+    fg->image = (SDL_Surface*) surface;
+    finishLevelImage(images, fg->image ? (size_t) fg->image->pitch * fg->image->h : 0);
+}
+
+// Queue a level's images to be loaded, unless they're already loading or loaded
+static void requestLevel(int level)
+{
+    // Without a renderer (in headless mode) nothing is drawn, so no images are needed
+    LevelImages* images = &level_images[level];
+    images->last_used = ++level_uses;
+    if(!renderer || images->state != UNLOADED) return;
+
+    images->state = LOADING;
+    images->pending = 2;
+    images->tickets[0] = queueLoad(decodeBitmap, backgrounds[level]->path, finishBackgroundImage, images);
+    images->tickets[1] = queueLoad(decodeBitmap, foregrounds[level]->path, finishForegroundImage, images);
+}
+
+// Make sure a level's images are loaded, waiting for them (and only them) if they aren't yet
+static void useLevel(int level)
+{
+    requestLevel(level);
+    if(level_images[level].state != LOADING) return;
+    waitForLoad(level_images[level].tickets[0]);
+    waitForLoad(level_images[level].tickets[1]);
+}
 
 /* SETTERS */
 
-// Switch the level to a new one
+// Switch the level to a new one, loading its images if they weren't prefetched
 void switchLevel(int new_level)
 {
     current_background = new_level;
     current_foreground = new_level;
+    useLevel(new_level);
+}
+
+// Start loading a level's images in the background, so that switching to it doesn't wait (if it exists)
+void prefetchLevel(int level)
+{
+    if(level >= 0 && level < NUM_FOREGROUNDS) requestLevel(level);
 }
 
 /* GETTERS */
@@ -71,19 +258,110 @@ int* getWalls(void)
     return foregrounds[current_foreground]->walls;
 }
 
+// Returns the width of the current level, in pixels
+int getLevelWidth(void)
+{
+    return foregrounds[current_foreground]->width;
+}
+
+// Returns the height of the current level, in pixels
+int getLevelHeight(void)
+{
+    return foregrounds[current_foreground]->height;
+}
+
+// Returns the part of the current level on screen
+SDL_Rect getView(void)
+{
+    return view;
+}
+
+// Returns the terrain index of the current foreground
+Terrain getTerrain(void)
+{
+    return foregrounds[current_foreground]->terrain;
+}
+
+// Returns the column of the terrain index an x-coord falls in (clamped to the columns that exist)
+int terrainColumn(Terrain terrain, double x)
+{
+    int col = (int) floor((x - terrain->min_x) / TERRAIN_COLUMN_WIDTH);
+    return col < 0 ? 0 : (col >= terrain->num_columns ? terrain->num_columns - 1 : col);
+}
+
 // Returns starting position of the guys on the current foreground
 int* getStartingPositions(int fg)
 {
     return foregrounds[fg]->starting_positions;
 }
 
+/* LEVEL STATE */
+
+// Copy size bytes from data to buf, or from buf to data if load is set (if buf is NULL, nothing is copied)
+static size_t copyBytes(char* buf, void* data, size_t size, bool load)
+{
+    if(buf && load) memcpy(data, buf, size);
+    else if(buf)    memcpy(buf, data, size);
+    return size;
+}
+
+// Copy the current level and the state of every background to buf, or from buf if load is set,
+// returning the number of bytes copied (if buf is NULL, nothing is copied and the size is just measured)
+static size_t copyLevelState(char* buf, bool load)
+{
+    size_t n = 0;
+    #define COPY(data, size) n += copyBytes(buf ? buf + n : NULL, (data), (size), load)
+
+    COPY(&current_background, sizeof(int));
+    COPY(&current_foreground, sizeof(int));
+    for(int i = 0; i < NUM_BACKGROUNDS; i++)
+    {
+        Background bg = backgrounds[i];
+        COPY(&bg->x, sizeof(double));      COPY(&bg->y, sizeof(double));
+        COPY(&bg->prev_x, sizeof(double)); COPY(&bg->prev_y, sizeof(double));
+        COPY(&bg->x_vel, sizeof(double));  COPY(&bg->y_vel, sizeof(double));
+    }
+
+    #undef COPY
+    return n;
+}
+
+// Save the level state to buf, returning its size in bytes (if buf is NULL, just return the size)
+size_t saveLevelState(char* buf)
+{
+    return copyLevelState(buf, false);
+}
+
+// Restore the level state from buf, returning the number of bytes read (0 if it names a level that doesn't exist,
+// in which case the forest is used)
+size_t loadLevelState(const char* buf)
+{
+    size_t n = copyLevelState((char*) buf, true);
+    if(current_background < 0 || current_background >= NUM_BACKGROUNDS || current_foreground < 0 || current_foreground >= NUM_FOREGROUNDS)
+    {
+        current_background = current_foreground = FOREST;
+        return 0;
+    }
+    return n;
+}
+
 /* PER FRAME UPDATES */
 
+// Center the camera on a point in the level, as far as it can go without showing past the level's edges
+void moveCamera(double x, double y)
+{
+    Foreground fg = foregrounds[current_foreground];
+    view.x = (int) fmax(fmin(x - SCREEN_WIDTH / 2, fg->width - SCREEN_WIDTH), 0);
+    view.y = (int) fmax(fmin(y - SCREEN_HEIGHT / 2, fg->height - SCREEN_HEIGHT), 0);
+}
+
 // Animate the background
 void moveBackground(void)
 {
     // Update position of the current background according to its velocity
     Background bg = backgrounds[current_background];
+    bg->prev_x = bg->x;
+    bg->prev_y = bg->y;
     bg->x += bg->x_vel;
     bg->y += bg->y_vel;
 
@@ -105,39 +383,70 @@ void moveBackground(void)
     else
     {
         // Scrolling backgrounds reset so they appear to loop infinitely
-        if(bg->x >= bg->width || bg->x <= bg->width * -1) bg->x = 0;
+        if(bg->x >= bg->width || bg->x <= bg->width * -1)
+        {
+            bg->x = 0;
+            bg->prev_x = bg->x - bg->x_vel;
+        }
     }
 }
 
 // Render the current background
-static void renderBackground(void)
+static void renderBackground(double alpha)
 {
-    // Draw the background at it's current position
+    // Draw the background at its interpolated position
     Background bg = backgrounds[current_background];
-    SDL_Rect quad = {(int) bg->x * -1, (int) bg->y * -1, bg->width, bg->height};
+    double x = bg->prev_x + (bg->x - bg->prev_x) * alpha;
+    double y = bg->prev_y + (bg->y - bg->prev_y) * alpha;
+    SDL_Rect quad = {(int) x * -1, (int) y * -1, bg->width, bg->height};
     SDL_RenderCopy(renderer, bg->image, NULL, &quad);
 
     // If the background scrolls, we may need to render it twice to create the illusion of looping
-    if(bg->drift_type == SCROLL && (bg->x + SCREEN_WIDTH > bg->width || bg->x < 0))
+    if(bg->drift_type == SCROLL && (x + SCREEN_WIDTH > bg->width || x < 0))
     {
-        quad.x = (int)bg->x * -1 + convert(bg->x > 0) * bg->width;
-        quad.y = (int)bg->y * -1;
+        quad.x = (int)x * -1 + convert(x > 0) * bg->width;
+        quad.y = (int)y * -1;
         quad.w = bg->width;
         quad.h = bg->height;
         SDL_RenderCopy(renderer, bg->image, NULL, &quad);
     }
 }
 
-// Render the current foreground
+// Render the part of the current foreground in view, a tile at a time
 static void renderForeground(void)
 {
-    SDL_RenderCopy(renderer, foregrounds[current_foreground]->image, NULL, NULL);
+    // Tiles are only kept for the current foreground, near the view
+    if(tiles_foreground != current_foreground) unloadTiles(foregrounds[tiles_foreground], false);
+    tiles_foreground = current_foreground;
+    Foreground fg = foregrounds[current_foreground];
+    if(!fg->image) return;
+    unloadTiles(fg, true);
+
+    // Draw the tiles in view, uploading any which have just come into view
+    int first_col = view.x / FOREGROUND_TILE_SIZE;
+    int first_row = view.y / FOREGROUND_TILE_SIZE;
+    int last_col = fmin((view.x + view.w - 1) / FOREGROUND_TILE_SIZE, fg->tile_columns - 1);
+    int last_row = fmin((view.y + view.h - 1) / FOREGROUND_TILE_SIZE, fg->tile_rows - 1);
+    for(int row = first_row; row <= last_row; row++)
+    {
+        for(int col = first_col; col <= last_col; col++)
+        {
+            int tile = row * fg->tile_columns + col;
+            if(!fg->tiles[tile]) loadTile(fg, tile);
+            SDL_Rect quad = {col * FOREGROUND_TILE_SIZE - view.x, row * FOREGROUND_TILE_SIZE - view.y,
+                             fmin(FOREGROUND_TILE_SIZE, fg->width - col * FOREGROUND_TILE_SIZE),
+                             fmin(FOREGROUND_TILE_SIZE, fg->height - row * FOREGROUND_TILE_SIZE)};
+            SDL_RenderCopy(renderer, fg->tiles[tile], NULL, &quad);
+        }
+    }
 }
 
 // Render the current level
-void renderLevel(void)
+void renderLevel(double alpha)
 {
-    renderBackground();
+    // The level can change without switchLevel (when a replay seeks), so make sure its images are loaded
+    useLevel(current_foreground);
+    renderBackground(alpha);
     renderForeground();
 }
 
@@ -146,14 +455,16 @@ void renderLevel(void)
 // Assign background fields
 static Background initBackground(const char* path, int drift, int w, int h, int x, int y, double x_vel, double y_vel)
 {
-    // Make space for this background and load its texture
+    // Make space for this background (its texture is loaded when its level is used)
     Background this_background = (Background) malloc(sizeof(struct background));
-    this_background->image = loadTexture(path);
+    this_background->path = path;
+    this_background->image = NULL;
 
     // Assign positional data to the background
     this_background->width = w;     this_background->height = h;
     this_background->x_init = x;        this_background->y_init = y;
     this_background->x = x;             this_background->y = y;
+    this_background->prev_x = x;        this_background->prev_y = y;
     this_background->xv_init = x_vel;   this_background->yv_init = y_vel;
     this_background->x_vel = x_vel;     this_background->y_vel = y_vel;
 
@@ -169,26 +480,100 @@ static Background initBackground(const char* path, int drift, int w, int h, int
     return this_background;
 }
 
+// List the terrain in each column, given the column range of every platform or wall (the terrain at
+// offset 1 + 3*i spans columns first[i] through last[i]), filling in the index's start and entries arrays
+static void fillColumns(Terrain terrain, int count, int* first, int* last, int** start, int** entries)
+{
+    // Count the entries in each column, then give each column its run of the entries array
+    *start = (int*) calloc(terrain->num_columns + 1, sizeof(int));
+    for(int i = 0; i < count; i++)
+    {
+        for(int col = first[i]; col <= last[i]; col++) (*start)[col + 1]++;
+    }
+    for(int col = 0; col < terrain->num_columns; col++) (*start)[col + 1] += (*start)[col];
+    *entries = (int*) malloc(sizeof(int) * ((*start)[terrain->num_columns] + 1));
+
+    // Fill the runs in terrain order, so a query finds the same terrain first as a full scan would
+    int* fill = (int*) malloc(sizeof(int) * terrain->num_columns);
+    memcpy(fill, *start, sizeof(int) * terrain->num_columns);
+    for(int i = 0; i < count; i++)
+    {
+        for(int col = first[i]; col <= last[i]; col++) (*entries)[fill[col]++] = 1 + 3 * i;
+    }
+    free(fill);
+}
+
+// Build the x-column index of a foreground's platforms and walls
+static Terrain buildTerrain(int* platforms, int* walls)
+{
+    Terrain terrain = (Terrain) malloc(sizeof(struct terrain_index));
+    terrain->platforms = platforms;
+    terrain->walls = walls;
+
+    // The columns cover every platform and wall
+    int min_x = INT_MAX, max_x = INT_MIN;
+    for(int i = 1; i < platforms[0] * 3 + 1; i += 3)
+    {
+        min_x = fmin(min_x, platforms[i+1]);
+        max_x = fmax(max_x, platforms[i+2]);
+    }
+    for(int i = 1; i < walls[0] * 3 + 1; i += 3)
+    {
+        min_x = fmin(min_x, walls[i]);
+        max_x = fmax(max_x, walls[i]);
+    }
+    if(min_x > max_x) min_x = max_x = 0;
+    terrain->min_x = min_x;
+    terrain->num_columns = (max_x - min_x) / TERRAIN_COLUMN_WIDTH + 1;
+
+    // Platforms are listed in every column they span, and walls in the column they stand in
+    int count = fmax(platforms[0], walls[0]);
+    int* first = (int*) malloc(sizeof(int) * (count + 1));
+    int* last = (int*) malloc(sizeof(int) * (count + 1));
+    for(int i = 0; i < platforms[0]; i++)
+    {
+        first[i] = terrainColumn(terrain, platforms[3*i + 2]);
+        last[i] = terrainColumn(terrain, platforms[3*i + 3]);
+    }
+    fillColumns(terrain, platforms[0], first, last, &terrain->platform_start, &terrain->platform_entries);
+    for(int i = 0; i < walls[0]; i++)
+    {
+        first[i] = last[i] = terrainColumn(terrain, walls[3*i + 1]);
+    }
+    fillColumns(terrain, walls[0], first, last, &terrain->wall_start, &terrain->wall_entries);
+    free(first);
+    free(last);
+    return terrain;
+}
+
 // Assign foreground fields
-static Foreground initForeground(const char* path, int* platforms, int* walls, int* starts)
+static Foreground initForeground(const char* path, int width, int height, int* platforms, int* walls, int* starts)
 {
-    // Make space for this foreground and load its texture
+    // Make space for this foreground (its pixels are loaded when its level is used, and textures are only
+    // made for the tiles in view)
     Foreground this_foreground = (Foreground) malloc(sizeof(struct foreground));
-    this_foreground->image = loadTexture(path);
+    this_foreground->path = path;
+    this_foreground->image = NULL;
+    this_foreground->width = width;
+    this_foreground->height = height;
+    this_foreground->tile_columns = (width + FOREGROUND_TILE_SIZE - 1) / FOREGROUND_TILE_SIZE;
+    this_foreground->tile_rows = (height + FOREGROUND_TILE_SIZE - 1) / FOREGROUND_TILE_SIZE;
+    int num_tiles = this_foreground->tile_columns * this_foreground->tile_rows;
+    this_foreground->tiles = (SDL_Texture**) calloc(num_tiles, sizeof(SDL_Texture*));
+    this_foreground->resident = (int*) malloc(sizeof(int) * num_tiles);
+    this_foreground->num_resident = 0;
 
     // Assign position data to foreground and return it
     this_foreground->platforms = platforms;
     this_foreground->walls = walls;
     this_foreground->starting_positions = starts;
+    this_foreground->terrain = buildTerrain(platforms, walls);
     return this_foreground;
 }
 
-// Load all backgrounds and foregrounds into memory
-void loadLevels(void)
+// Build every background and foreground from the tables below
+static void initLevels(void)
 {
-    // Make space for backgrounds and foregrounds
-    backgrounds = (Background*) malloc(NUM_BACKGROUNDS * sizeof(Background));
-    foregrounds = (Foreground*) malloc(NUM_FOREGROUNDS * sizeof(Foreground));
     int numPlatforms; int numWalls;
 
     // Initialize backgrounds
@@ -220,7 +605,8 @@ void loadLevels(void)
     // Forest Guy starting spots
     int* forest_starts = (int*) malloc(sizeof(int) * 4);
     memcpy(forest_starts, (int[]) { 100, 192, 896, 192 }, sizeof(int) * 4);
-    foregrounds[FOREST] = initForeground("art/forest_foreground.bmp", forest_platforms, forest_walls, forest_starts);
+    foregrounds[FOREST] = initForeground("art/forest_foreground.bmp", SCREEN_WIDTH, SCREEN_HEIGHT,
+                                         forest_platforms, forest_walls, forest_starts);
 
     // Volcano platforms
     numPlatforms = 4;
@@ -245,7 +631,159 @@ void loadLevels(void)
     // Volcano Guy starting spots
     int* volcano_starts = (int*) malloc(sizeof(int) * 4);
     memcpy(volcano_starts, (int[]){250, 294, 747, 294}, sizeof(int) * 4);
-    foregrounds[VOLCANO] = initForeground("art/volcano_foreground.bmp", volcano_platforms, volcano_walls, volcano_starts);
+    foregrounds[VOLCANO] = initForeground("art/volcano_foreground.bmp", SCREEN_WIDTH, SCREEN_HEIGHT,
+                                          volcano_platforms, volcano_walls, volcano_starts);
+}
+
+// Check that a terrain x-coord is close enough to a level that indexing it by column stays small
+static bool checkTerrainX(int x)
+{
+    return x >= -MAX_LEVEL_WIDTH && x <= 2 * MAX_LEVEL_WIDTH;
+}
+
+// Check that the size bytes of levels baked into the content pack hold every level - each one's paths are
+// terminated, its size is within the MAX_LEVEL limits, and its platforms and walls fit in the bytes left and
+// have as many entries as their counts say
+static bool checkBakedLevels(const char* buf, size_t size)
+{
+    size_t n = PACK_ALIGN;
+    for(int i = 0; i < NUM_FOREGROUNDS; i++)
+    {
+        if(n > size || size - n < sizeof(struct baked_level)) return false;
+        const struct baked_level* baked = (const struct baked_level*) (buf + n);
+        if(!memchr(baked->background_path, '\0', PACK_NAME_LENGTH)) return false;
+        if(!memchr(baked->foreground_path, '\0', PACK_NAME_LENGTH)) return false;
+        if(baked->width <= 0 || baked->width > MAX_LEVEL_WIDTH) return false;
+        if(baked->height <= 0 || baked->height > MAX_LEVEL_HEIGHT) return false;
+
+        // The platforms and walls come right after the level, each led by its count
+        size_t ints_left = (size - n - sizeof(struct baked_level)) / sizeof(int);
+        if(baked->platforms_size < 1 || (size_t) baked->platforms_size > ints_left) return false;
+        if(baked->walls_size < 1 || (size_t) baked->walls_size > ints_left - baked->platforms_size) return false;
+        const int* platforms = (const int*) (baked + 1);
+        const int* walls = platforms + baked->platforms_size;
+        if(platforms[0] != (baked->platforms_size - 1) / 3 || (baked->platforms_size - 1) % 3) return false;
+        if(walls[0] != (baked->walls_size - 1) / 3 || (baked->walls_size - 1) % 3) return false;
+        for(int j = 1; j < baked->platforms_size; j += 3)
+        {
+            if(!checkTerrainX(platforms[j+1]) || !checkTerrainX(platforms[j+2]) || platforms[j+1] > platforms[j+2]) return false;
+        }
+        for(int j = 1; j < baked->walls_size; j += 3)
+        {
+            if(!checkTerrainX(walls[j])) return false;
+        }
+
+        size_t level_size = sizeof(struct baked_level) + sizeof(int) * (baked->platforms_size + baked->walls_size);
+        n += (level_size + PACK_ALIGN - 1) / PACK_ALIGN * PACK_ALIGN;
+    }
+    return true;
+}
+
+// Take every background and foreground from levels baked into the content pack, which have been checked by
+// checkBakedLevels (the paths, platforms, walls, and starting positions are used in place in the pack's mapping)
+static void unbakeLevels(const char* buf)
+{
+    buf += PACK_ALIGN;
+
+    for(int i = 0; i < NUM_FOREGROUNDS; i++)
+    {
+        const struct baked_level* baked = (const struct baked_level*) buf;
+        int* platforms = (int*) (baked + 1);
+        int* walls = platforms + baked->platforms_size;
+        backgrounds[i] = initBackground(baked->background_path, baked->drift_type, baked->background_width,
+                                        baked->background_height, baked->x_init, baked->y_init, baked->xv_init,
+                                        baked->yv_init);
+        foregrounds[i] = initForeground(baked->foreground_path, baked->width, baked->height, platforms, walls,
+                                        (int*) baked->starting_positions);
+
+        size_t size = sizeof(struct baked_level) + sizeof(int) * (baked->platforms_size + baked->walls_size);
+        buf += (size + PACK_ALIGN - 1) / PACK_ALIGN * PACK_ALIGN;
+    }
+}
+
+// Load all backgrounds and foregrounds into memory, returning false if the content pack's levels are corrupt
+bool loadLevels(void)
+{
+    // Make space for backgrounds and foregrounds
+    backgrounds = (Background*) malloc(NUM_BACKGROUNDS * sizeof(Background));
+    foregrounds = (Foreground*) malloc(NUM_FOREGROUNDS * sizeof(Foreground));
+
+    // Take the levels from the content pack if there is one, or else build them from the tables (as they are
+    // if the pack was baked with a different number of levels)
+    size_t size;
+    const char* baked = (const char*) findPackData("levels", &size);
+    if(baked && size >= sizeof(int) && *(const int*) baked != NUM_FOREGROUNDS) baked = NULL;
+    if(baked && !checkBakedLevels(baked, size))
+    {
+        fprintf(stderr, "Error: The levels in the content pack are corrupt\n");
+        return false;
+    }
+    levels_baked = baked != NULL;
+    if(levels_baked) unbakeLevels(baked);
+    else             initLevels();
+
+    // Only the level the game starts on is loaded up front - the rest are loaded when they're needed
+    requestLevel(current_foreground);
+    return true;
+}
+
+/* CONTENT PACK */
+
+// Copy every level to buf as it's baked into a content pack, returning its size in bytes (if buf is NULL,
+// nothing is copied and the size is just measured). The padding isn't written, so buf should start zeroed.
+static size_t copyBakedLevels(char* buf)
+{
+    size_t n = 0;
+    #define COPY(data, size) n += copyBytes(buf ? buf + n : NULL, (data), (size), false)
+    #define PAD() n = (n + PACK_ALIGN - 1) / PACK_ALIGN * PACK_ALIGN
+
+    // The number of levels comes first, so a pack baked with a different number can be told apart
+    int num_levels = NUM_FOREGROUNDS;
+    COPY(&num_levels, sizeof(int));
+    PAD();
+
+    for(int i = 0; i < NUM_FOREGROUNDS; i++)
+    {
+        Background bg = backgrounds[i];
+        Foreground fg = foregrounds[i];
+        struct baked_level baked;
+        memset(&baked, 0, sizeof(struct baked_level));
+        strncpy(baked.background_path, bg->path, PACK_NAME_LENGTH - 1);
+        strncpy(baked.foreground_path, fg->path, PACK_NAME_LENGTH - 1);
+        baked.drift_type = bg->drift_type;
+        baked.background_width = bg->width;     baked.background_height = bg->height;
+        baked.x_init = bg->x_init;              baked.y_init = bg->y_init;
+        baked.xv_init = bg->xv_init;            baked.yv_init = bg->yv_init;
+        baked.width = fg->width;                baked.height = fg->height;
+        memcpy(baked.starting_positions, fg->starting_positions, sizeof(baked.starting_positions));
+        baked.platforms_size = fg->platforms[0] * 3 + 1;
+        baked.walls_size = fg->walls[0] * 3 + 1;
+
+        COPY(&baked, sizeof(struct baked_level));
+        COPY(fg->platforms, sizeof(int) * baked.platforms_size);
+        COPY(fg->walls, sizeof(int) * baked.walls_size);
+        PAD();
+    }
+
+    #undef PAD
+    #undef COPY
+    return n;
+}
+
+// Bake every level, and their images, into the content pack being baked
+void bakeLevels(void)
+{
+    size_t size = copyBakedLevels(NULL);
+    char* buf = (char*) calloc(size, 1);
+    copyBakedLevels(buf);
+    bakeData("levels", buf, size);
+    free(buf);
+
+    for(int i = 0; i < NUM_FOREGROUNDS; i++)
+    {
+        bakeImage(backgrounds[i]->path);
+        bakeImage(foregrounds[i]->path);
+    }
 }
 
 /* DATA UNLOADING */
@@ -260,10 +798,22 @@ static void freeBackground(Background bg)
 // Free a foreground from memory
 static void freeForeground(Foreground fg)
 {
-    SDL_DestroyTexture(fg->image);
-    free(fg->platforms);
-    free(fg->walls);
-    free(fg->starting_positions);
+    unloadTiles(fg, false);
+    free(fg->tiles);
+    free(fg->resident);
+    SDL_FreeSurface(fg->image);
+    if(!levels_baked)
+    {
+        // Baked geometry belongs to the content pack
+        free(fg->platforms);
+        free(fg->walls);
+        free(fg->starting_positions);
+    }
+    free(fg->terrain->platform_start);
+    free(fg->terrain->platform_entries);
+    free(fg->terrain->wall_start);
+    free(fg->terrain->wall_entries);
+    free(fg->terrain);
     free(fg);
 }
 
@@ -0,0 +1,250 @@
+#include "../headers/constants.h"
+#include "../headers/loader.h"
+#include "../headers/pack.h"
+
+// Struct for a queued load
+typedef struct load
+{
+    int number;                 // loads queued before this one
+    LoadWork work;              // decoding done on a worker thread
+    const void* input;
+    LoadFinish finish;          // work done with the result on the main thread
+    void* target;
+    void* result;               // result of the work, once done
+    bool done;                  // whether the work is done (guarded by load_lock)
+    struct load* next;          // next load queued
+}* Load;
+
+// Unfinished loads, in the order they were queued (the list is guarded by load_lock)
+Load first_load = NULL;            // oldest load which hasn't been finished
+Load last_load = NULL;             // newest load
+Load next_pending = NULL;          // oldest load no worker has started on
+int num_loads = 0;                 // loads ever queued
+
+// The worker pool
+SDL_Thread* workers[MAX_LOADER_THREADS];
+int num_workers = 0;
+bool loader_quit = false;          // set to tell the workers to finish once the queue is empty
+SDL_mutex* load_lock = NULL;
+SDL_cond* load_queued = NULL;      // signalled when a load is queued, or the workers should quit
+SDL_cond* load_done = NULL;        // signalled when a load's work is done
+
+/* WORKERS */
+
+// Take loads from the queue and work on them until told to quit (runs on a worker thread)
+static int runLoads(void* data)
+{
+    SDL_LockMutex(load_lock);
+    while(true)
+    {
+        while(!next_pending && !loader_quit) SDL_CondWait(load_queued, load_lock);
+        if(!next_pending) break;
+
+        // Work on the load with the queue unlocked, so the other workers can take loads meanwhile
+        Load load = next_pending;
+        next_pending = load->next;
+        SDL_UnlockMutex(load_lock);
+        void* result = load->work(load->input);
+        SDL_LockMutex(load_lock);
+        load->result = result;
+        load->done = true;
+        SDL_CondBroadcast(load_done);
+    }
+    SDL_UnlockMutex(load_lock);
+    return 0;
+}
+
+// Decode a bitmap into a surface, or take its pixels from the content pack if it's been baked (runs on a
+// worker thread)
+void* decodeBitmap(const void* path)
+{
+    SDL_Surface* baked = findPackImage((const char*) path);
+    return baked ? baked : SDL_LoadBMP((const char*) path);
+}
+
+/* FINISHING LOADS */
+
+// Make a texture of a decoded surface. Pixels already in a texture format (as every image in the content
+// pack is) are streamed straight into the texture, and anything else is converted by SDL.
+SDL_Texture* makeTexture(SDL_Surface* surface)
+{
+    if(!surface) return NULL;
+    Uint32 format = surface->format->format;
+    SDL_Texture* texture = NULL;
+    if(format == SDL_PIXELFORMAT_ARGB8888 || format == SDL_PIXELFORMAT_RGB888)
+    {
+        texture = SDL_CreateTexture(renderer, format, SDL_TEXTUREACCESS_STREAMING, surface->w, surface->h);
+    }
+    if(!texture) return SDL_CreateTextureFromSurface(renderer, surface);
+    SDL_UpdateTexture(texture, NULL, surface->pixels, surface->pitch);
+    if(SDL_ISPIXELFORMAT_ALPHA(format)) SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+    return texture;
+}
+
+// Make a decoded bitmap into a texture
+static void finishTexture(void* surface, void* texture)
+{
+    *(SDL_Texture**) texture = makeTexture((SDL_Surface*) surface);
+    SDL_FreeSurface((SDL_Surface*) surface);
+}
+
+// Finish every load whose work is done (with load_lock held, which is released while each one finishes)
+static void finishDone(void)
+{
+    Load prev = NULL;
+    Load load = first_load;
+    while(load)
+    {
+        Load next = load->next;
+        if(!load->done)
+        {
+            prev = load;
+            load = next;
+            continue;
+        }
+
+        // Take the load off the list, and finish it with the queue unlocked
+        if(prev) prev->next = next;
+        else     first_load = next;
+        if(last_load == load) last_load = prev;
+        SDL_UnlockMutex(load_lock);
+        load->finish(load->result, load->target);
+        free(load);
+        SDL_LockMutex(load_lock);
+
+        // Finishing a load might have queued another one after it
+        load = prev ? prev->next : first_load;
+    }
+}
+
+/* SETTERS */
+
+// Queue a load, to be worked on by a worker thread and finished on the main thread, returning its ticket
+int queueLoad(LoadWork work, const void* input, LoadFinish finish, void* target)
+{
+    int ticket = num_loads++;
+
+    // Without workers, the load is done right away
+    if(!num_workers)
+    {
+        finish(work(input), target);
+        return ticket;
+    }
+
+    Load load = (Load) malloc(sizeof(struct load));
+    load->number = ticket;
+    load->work = work;
+    load->input = input;
+    load->finish = finish;
+    load->target = target;
+    load->result = NULL;
+    load->done = false;
+    load->next = NULL;
+
+    SDL_LockMutex(load_lock);
+    if(last_load) last_load->next = load;
+    else          first_load = load;
+    last_load = load;
+    if(!next_pending) next_pending = load;
+    SDL_CondSignal(load_queued);
+    SDL_UnlockMutex(load_lock);
+    return ticket;
+}
+
+// Queue a bitmap to be decoded and made into a texture, stored in *texture when it's finished
+void queueTexture(const char* path, SDL_Texture** texture)
+{
+    // Without a renderer (in headless mode) there's nothing to draw textures with
+    *texture = NULL;
+    if(renderer) queueLoad(decodeBitmap, path, finishTexture, texture);
+}
+
+// Finish the first count loads ever queued, waiting for any which are still being worked on
+void waitForLoads(int count)
+{
+    if(!num_workers) return;
+    SDL_LockMutex(load_lock);
+    while(true)
+    {
+        finishDone();
+        if(!first_load || first_load->number >= count) break;
+        SDL_CondWait(load_done, load_lock);
+    }
+    SDL_UnlockMutex(load_lock);
+}
+
+// Finish the load with the given ticket, waiting for it if it's still being worked on
+void waitForLoad(int ticket)
+{
+    if(!num_workers) return;
+    SDL_LockMutex(load_lock);
+    while(true)
+    {
+        // The unfinished loads are kept in the order they were queued, so the search stops past the ticket
+        finishDone();
+        Load load = first_load;
+        while(load && load->number < ticket) load = load->next;
+        if(!load || load->number != ticket) break;
+        SDL_CondWait(load_done, load_lock);
+    }
+    SDL_UnlockMutex(load_lock);
+}
+
+// Finish any loads whose work is done, without waiting (once per frame)
+void updateLoader(void)
+{
+    if(!num_workers) return;
+    SDL_LockMutex(load_lock);
+    finishDone();
+    SDL_UnlockMutex(load_lock);
+}
+
+/* GETTERS */
+
+// Return the number of loads ever queued (loads queued before this are waited for by waitForLoads)
+int loadsQueued(void)
+{
+    return num_loads;
+}
+
+/* DATA ALLOCATION / INITIALIZATION */
+
+// Start the worker threads
+void startLoader(void)
+{
+    load_lock = SDL_CreateMutex();
+    load_queued = SDL_CreateCond();
+    load_done = SDL_CreateCond();
+    if(!load_lock || !load_queued || !load_done) return;
+
+    // One worker per core (if none can be started, loads are just done as they're queued)
+    loader_quit = false;
+    int cores = fmax(1, fmin(MAX_LOADER_THREADS, SDL_GetCPUCount()));
+    for(int i = 0; i < cores; i++)
+    {
+        workers[num_workers] = SDL_CreateThread(runLoads, "loader", NULL);
+        if(workers[num_workers]) num_workers++;
+    }
+}
+
+/* DATA UNLOADING */
+
+// Finish every load, and stop the worker threads
+void stopLoader(void)
+{
+    waitForLoads(num_loads);
+    if(num_workers)
+    {
+        SDL_LockMutex(load_lock);
+        loader_quit = true;
+        SDL_CondBroadcast(load_queued);
+        SDL_UnlockMutex(load_lock);
+        for(int i = 0; i < num_workers; i++) SDL_WaitThread(workers[i], NULL);
+        num_workers = 0;
+    }
+    if(load_done) SDL_DestroyCond(load_done);
+    if(load_queued) SDL_DestroyCond(load_queued);
+    if(load_lock) SDL_DestroyMutex(load_lock);
+    load_lock = NULL;
+    load_queued = load_done = NULL;
+}
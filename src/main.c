@@ -3,10 +3,41 @@
 #include "../headers/sprite.h"
 #include "../headers/level.h"
 #include "../headers/interface.h"
+#include "../headers/replay.h"
+#include "../headers/netplay.h"
+#include "../headers/arena.h"
+#include "../headers/profiler.h"
+#include "../headers/loader.h"
+#include "../headers/pack.h"
+#include "../headers/atlas.h"
+#include "../headers/jobs.h"
 
 // Debug mode is off by default
 bool debug = false;
 
+// Headless mode (simulation only, no window or audio) is off by default
+bool headless = false;
+
+// Both guys are controlled by the CPU in a demo (headless mode, and replays of it)
+bool demo = false;
+
+// File the profiler's trace is exported to on exit (profiling can also be switched on with F3)
+const char* profile_path = PROFILE_PATH;
+
+// File each match is recorded to (if any), and the seed of the next match
+const char* record_path = NULL;
+unsigned long long next_seed = DEFAULT_SEED;
+
+// Keys controlling each guy in 2-player and 1-player mode: the five spells, then jump, left, and right
+const SDL_Scancode vs_controls[2][NUM_SPELLS + 3] = {
+    { SDL_SCANCODE_1, SDL_SCANCODE_2, SDL_SCANCODE_3, SDL_SCANCODE_4, SDL_SCANCODE_5,
+      SDL_SCANCODE_D, SDL_SCANCODE_X, SDL_SCANCODE_V },
+    { SDL_SCANCODE_Y, SDL_SCANCODE_U, SDL_SCANCODE_I, SDL_SCANCODE_O, SDL_SCANCODE_P,
+      SDL_SCANCODE_UP, SDL_SCANCODE_LEFT, SDL_SCANCODE_RIGHT } };
+const SDL_Scancode ai_controls[NUM_SPELLS + 3] = {
+    SDL_SCANCODE_1, SDL_SCANCODE_2, SDL_SCANCODE_3, SDL_SCANCODE_4, SDL_SCANCODE_5,
+    SDL_SCANCODE_UP, SDL_SCANCODE_LEFT, SDL_SCANCODE_RIGHT };
+
 // Window and renderer, used by all modules
 SDL_Window* window = NULL;
 SDL_Renderer* renderer = NULL;
@@ -14,6 +45,20 @@ SDL_Renderer* renderer = NULL;
 // Load SDL and initialize the window, renderer, audio, and data
 bool loadGame(void)
 {
+    // Map the content pack, if one has been baked (the modules take their data from it instead of their tables)
+    openPack(PACK_PATH);
+
+    // In headless mode, only the game data is loaded - no window, renderer, textures, or audio
+    if(headless)
+    {
+        if(SDL_Init(SDL_INIT_TIMER) < 0) return false;
+        startJobs();
+        if(!loadLevels()) return false;
+        loadSpriteInfo();
+        loadInterface();
+        return true;
+    }
+
     // Initialize SDL
     if(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) < 0) return false;
 
@@ -22,14 +67,21 @@ bool loadGame(void)
     if(!window) return false;
 
     // Create renderer for window
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
     if(!renderer) return false;
 
     // Initialize renderer color and image loading
     SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
 
+    // Start decoding assets on every core - the modules below queue their images and sounds, and
+    // textures are made on this thread as each one is decoded
+    startLoader();
+
+    // Start the threads the sprite updates are split across
+    startJobs();
+
     // Load level backgrounds and foregrounds
-    loadLevels();
+    if(!loadLevels()) return false;
 
     // Load meta information for sprites
     loadSpriteInfo();
@@ -37,17 +89,30 @@ bool loadGame(void)
     // Load UI elements
     loadInterface();
 
+    // Pack the sprite and toolbar images added above into one texture
+    loadAtlas();
+    int opening_loads = loadsQueued();
+
     // Load audio elements
     loadSound();
 
+    // The opening needs the images queued so far (the first level's, and the atlas), but
+    // sound effects can finish loading while it plays
+    waitForLoads(opening_loads);
     return true;
 }
 
 // Free all resources and quit SDL
 void quitGame(void)
 {
-    // Free sprite metainfo
-    freeSpriteInfo();
+    // Export the profile, if anything was profiled
+    if(!exportProfile(profile_path)) fprintf(stderr, "Error: Could not write profile to %s\n", profile_path);
+
+    // Finish any assets still loading, so that everything below can be freed
+    stopLoader();
+
+    // Stop the threads the sprite updates are split across
+    stopJobs();
 
     // Free remaining active sprites
     freeActiveSprites();
@@ -58,36 +123,38 @@ void quitGame(void)
     // Free UI elements
     freeInterface();
 
-    // Free audio elements
-    freeSound();
+    // Free the atlas of sprites and UI elements
+    freeAtlas();
 
-    // Free renderer and window
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
+    // Free audio elements, renderer, and window (which don't exist in headless mode)
+    if(!headless)
+    {
+        printAudioStats();
+        freeSound();
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+    }
+
+    // Unmap the content pack, now that nothing points into it
+    closePack();
 
     // Free SDL
     SDL_Quit();
 }
 
-// Helper function to load an SDL texture
-SDL_Texture* loadTexture(const char* path)
-{
-    // Create a surface from path to bitmap file
-    SDL_Texture* newTexture = NULL;
-    SDL_Surface* loaded = SDL_LoadBMP(path);
-
-    // Create a texture from the surface
-    newTexture = SDL_CreateTextureFromSurface(renderer, loaded);
-    SDL_FreeSurface(loaded);
-    return newTexture;
-}
-
 // Turn debug mode on
 void setDebugMode(void)
 {
     debug = true;
 }
 
+// Point the camera between the guys, at their interpolated positions (it stays put if neither is in the level)
+void followGuys(double alpha)
+{
+    double x, y;
+    if(getFocus(alpha, &x, &y)) moveCamera(x, y);
+}
+
 // Helper function to cast a spell and update the score on success
 bool sCast(int guy, int spell)
 {
@@ -105,6 +172,13 @@ void setLevel(int level, int mode)
     resetGuy(1, starts[2], starts[3]);
 }
 
+// Helper function to prefetch the stages one hover away from the one being previewed on the stage select
+void prefetchStages(void)
+{
+    prefetchLevel(getLevel() - 1);
+    prefetchLevel(getLevel() + 1);
+}
+
 // Helper function to reset the game to title screen
 void resetGame(int* mode, int* selection, int* vs_or_ai)
 {
@@ -115,39 +189,520 @@ void resetGame(int* mode, int* selection, int* vs_or_ai)
     setLevel(FOREST, TITLE);
 }
 
+// Helper function to seed a new match, and start recording it if matches are being recorded
+void startMatch(int mode)
+{
+    seedMatch(next_seed);
+    if(record_path) startRecording(mode, demo, next_seed);
+    next_seed++;
+}
+
+// Helper function to write a finished match's replay, if it was being recorded
+void endMatch(void)
+{
+    if(isRecording() && !stopRecording(record_path)) fprintf(stderr, "Error: Could not write replay to %s\n", record_path);
+}
+
+// Read a guy's inputs for this tick from the keyboard, using the given keys for
+// the five spells, jump, left, and right
+Uint8 readKeys(const Uint8* keys, const SDL_Scancode* controls)
+{
+    Uint8 input = 0;
+    for(int spell = 0; spell < NUM_SPELLS; spell++)
+    {
+        if(keys[controls[spell]]) input |= INPUT_CAST(spell);
+    }
+    bool left = keys[controls[NUM_SPELLS + 1]], right = keys[controls[NUM_SPELLS + 2]];
+    if(keys[controls[NUM_SPELLS]]) input |= INPUT_JUMP;
+    if(left && !right)             input |= INPUT_LEFT;
+    if(right && !left)             input |= INPUT_RIGHT;
+    return input;
+}
+
+// Carry out a human player's inputs - only the first of the guy's inputs which succeeds is
+// acted on, and in 1-player mode, casting a spell scores points
+void takePlayerAction(int guy, Uint8 input, bool scored)
+{
+    bool succ = 0;
+    for(int spell = ARCSURGE; spell >= FIREBALL; spell--)
+    {
+        if(!succ && (input & INPUT_CAST(spell))) succ = scored ? sCast(guy, spell) : cast(guy, spell);
+    }
+    if(!succ && (input & INPUT_JUMP))  succ = jump(guy);
+    if(!succ && (input & INPUT_LEFT))  succ = walk(guy, LEFT);
+    if(!succ && (input & INPUT_RIGHT)) succ = walk(guy, RIGHT);
+}
+
+// Carry out both guys' inputs for one tick of a match
+void applyInputs(int mode, const Uint8* inputs)
+{
+    if(demo)
+    {
+        takeCPUAction(0, inputs[0]);
+        takeCPUAction(1, inputs[1]);
+    }
+    else if(mode == VS)
+    {
+        takePlayerAction(0, inputs[0], false);
+        takePlayerAction(1, inputs[1], false);
+    }
+    else
+    {
+        takePlayerAction(0, inputs[0], true);
+        takeCPUAction(1, inputs[1]);
+    }
+}
+
+// Run every sprite and level update for one simulation tick, returning which guy died (if any)
+int simulateTick(int* mode)
+{
+    // Move the background
+    PROFILE_ZONE("moveBackground") moveBackground();
+
+    // Update positions, velocities, and orientations of all sprites
+    PROFILE_ZONE("moveSprites") moveSprites();
+
+    // Check for and handle collisions with terrain or other sprites
+    PROFILE_ZONE("terrainCollisions") terrainCollisions(getTerrain());
+    PROFILE_ZONE("spriteCollisions") spriteCollisions();
+
+    // Spawn any new spells that people are casting
+    PROFILE_ZONE("launchSpells") launchSpells();
+
+    // Update values on timed sprite variables (spell cooldowns, casting / collision durations, etc)
+    PROFILE_ZONE("advanceTimers") advanceTimers();
+
+    // Unload dead sprites and check for dead guys
+    int signal = 0;
+    PROFILE_ZONE("unloadSprites") signal = unloadSprites();
+    if(signal)
+    {
+        // In VS mode, if either guy dies, the game ends. In AI mode, if the cpu guy dies,
+        // a new guy is spawned and play continues. In a demo, the first guy comes back too.
+        int* starts = getStartingPositions(getLevel());
+        if(*mode == VS) *mode = GAME_OVER_VS;
+        else if (signal == 1 && demo) resetGuy(0, starts[0], -100);
+        else if (signal == 1) *mode = GAME_OVER_AI;
+        else
+        {
+            resetGuy(1, starts[2], -100);
+            updateScore(100);
+        }
+    }
+
+    // Update the animation frame which is drawn for all sprites
+    PROFILE_ZONE("updateAnimationFrames") updateAnimationFrames();
+    return signal;
+}
+
+// Advance the game by one fixed simulation tick
+void tickGame(int* mode, long long tick)
+{
+    // Delay the music starting a little bit because it's less jarring
+    if(tick == 10) startMusic();
+
+    // Immediately spawn guys and go to title in debug mode,
+    // otherwise guys spawn at specific points in opening scene
+    int f = tick, m = *mode;
+    int* s = getStartingPositions(getLevel());
+    if((m == OPENING && f == 100) || (debug && f == 0)) spawnSprite(GUY, s[0], -100, 0, 0, RIGHT, 0, 0, 0);
+    if((m == OPENING && f == 225) || (debug && f == 0)) spawnSprite(GUY, s[2], -100, 0, 0, LEFT, 0, 0, 0);
+    if((m == OPENING && f == 375) || (debug && f == 0)) *mode = TITLE;
+
+    if(*mode != PAUSE)
+    {
+        // Process key presses (and the CPU guy's decisions) as actions in battle
+        if(*mode == VS || *mode == AI)
+        {
+            const Uint8* keys = SDL_GetKeyboardState(NULL);
+            Uint8 inputs[2];
+            inputs[0] = readKeys(keys, *mode == VS ? vs_controls[0] : ai_controls);
+            inputs[1] = *mode == VS ? readKeys(keys, vs_controls[1]) : decideCPUAction(1);
+            if(isRecording()) recordTick(*mode, inputs);
+            applyInputs(*mode, inputs);
+        }
+
+        // Run the simulation, and save the replay once the match is over
+        simulateTick(mode);
+        if(*mode == GAME_OVER_VS || *mode == GAME_OVER_AI) endMatch();
+    }
+}
+
+// Simulate an AI vs AI match for a number of ticks as fast as possible, with no rendering or input
+void runHeadless(long long ticks)
+{
+    // Start the match on the first level, with both guys controlled by the CPU
+    int mode = AI;
+    int* starts = getStartingPositions(FOREST);
+    spawnSprite(GUY, starts[0], starts[1], 0, 0, RIGHT, 0, 0, 0);
+    spawnSprite(GUY, starts[2], starts[3], 0, 0, LEFT, 0, 0, 0);
+    setLevel(FOREST, mode);
+    demo = true;
+    startMatch(mode);
+
+    // Run the same pipeline as the game loop, uncapped
+    long long rounds = 0;
+    Uint64 start = SDL_GetPerformanceCounter();
+    for(long long tick = 0; tick < ticks; tick++)
+    {
+        Uint8 inputs[2] = { decideCPUAction(0), decideCPUAction(1) };
+        if(isRecording()) recordTick(mode, inputs);
+        applyInputs(mode, inputs);
+        if(simulateTick(&mode) == 1) rounds++;
+    }
+    double seconds = (SDL_GetPerformanceCounter() - start) / (double) SDL_GetPerformanceFrequency();
+    endMatch();
+
+    // Report how fast the simulation ran
+    printf("Simulated %lld ticks in %.3f s (%.0f ticks per second)\n", ticks, seconds, ticks / seconds);
+    printf("Rounds lost by guy 1: %lld, score: %d, health: %d / %d\n", rounds, getScore(), getHealth(0), getHealth(1));
+}
+
+// Re-simulate one tick of the loaded replay from its recorded inputs
+void replayTick(long long tick, int* mode)
+{
+    Uint8 inputs[2];
+    getReplayInputs(tick, inputs);
+    applyInputs(*mode, inputs);
+    simulateTick(mode);
+}
+
+// Seek the loaded replay to a tick by restoring the nearest keyframe and re-simulating from there,
+// returning the tick reached (-1 if the keyframe couldn't be restored)
+long long seekReplay(long long target, int* mode)
+{
+    target = target < 0 ? 0 : (target > getReplayLength() ? getReplayLength() : target);
+    long long tick = restoreKeyframe(target, mode);
+    if(tick < 0) return -1;
+    suppressSoundEffects(true);
+    for(; tick < target; tick++) replayTick(tick, mode);
+    suppressSoundEffects(false);
+    return tick;
+}
+
+// Play back the whole loaded replay as fast as possible with no rendering, checking the
+// simulation against every keyframe on the way, and returning whether its keyframes could be restored
+bool runReplayHeadless(void)
+{
+    int mode;
+    long long length = getReplayLength();
+    long long tick = seekReplay(0, &mode);
+    if(tick < 0) return false;
+    long long desyncs = 0;
+    Uint64 start = SDL_GetPerformanceCounter();
+    for(; tick < length; tick++)
+    {
+        if(!matchesKeyframe(tick, mode)) desyncs++;
+        replayTick(tick, &mode);
+    }
+    double seconds = (SDL_GetPerformanceCounter() - start) / (double) SDL_GetPerformanceFrequency();
+
+    // Report how fast the replay ran, and whether it played out as recorded
+    printf("Replayed %lld ticks in %.3f s (%.0f ticks per second)\n", length, seconds, length / seconds);
+    printf("Score: %d, health: %d / %d, keyframes out of sync: %lld\n", getScore(), getHealth(0), getHealth(1), desyncs);
+    return true;
+}
+
+// Play back the loaded replay in the window. Space pauses, up and down change the playback speed,
+// left and right seek backwards and forwards, and escape exits. Returns whether the replay's keyframes could be restored.
+bool runReplay(void)
+{
+    int mode;
+    long long length = getReplayLength();
+    long long tick = seekReplay(0, &mode);
+    if(tick < 0) return false;
+    int speed = 1;
+    bool paused = false;
+    double lag = 0;
+    Uint64 last_time = SDL_GetPerformanceCounter();
+    startMusic();
+
+    bool quit = false;
+    SDL_Event e;
+    while(!quit)
+    {
+        // Track how long this frame takes, and release last frame's transient data
+        int start_time = SDL_GetTicks();
+        resetFrameArena();
+
+        // Finish any assets decoded since last frame, and grow the audio buffer if it's been running dry
+        updateLoader();
+        updateAudio();
+
+        // Accumulate the time since the last frame, sped up by the playback speed
+        Uint64 now = SDL_GetPerformanceCounter();
+        double elapsed = (now - last_time) * 1000.0 / SDL_GetPerformanceFrequency();
+        last_time = now;
+        if(!paused) lag += fmin(elapsed, MAX_FRAME_LAG) * speed;
+
+        // Process playback controls
+        while(SDL_PollEvent(&e) != 0)
+        {
+            if(e.type == SDL_QUIT) quit = true;
+            if(e.type != SDL_KEYDOWN) continue;
+
+            int key = e.key.keysym.sym;
+            if(key == SDLK_ESCAPE)     quit = true;
+            else if(key == SDLK_SPACE) paused = !paused;
+            else if(key == SDLK_UP)    speed = speed < MAX_REPLAY_SPEED ? speed * 2 : speed;
+            else if(key == SDLK_DOWN)  speed = speed > 1 ? speed / 2 : speed;
+            else if(key == SDLK_LEFT)  tick = seekReplay(tick - REPLAY_SEEK_STEP, &mode);
+            else if(key == SDLK_RIGHT) tick = seekReplay(tick + REPLAY_SEEK_STEP, &mode);
+            if(key == SDLK_LEFT || key == SDLK_RIGHT) lag = 0;
+            if(tick < 0) return false;
+        }
+
+        // Run as many ticks as the elapsed time calls for, stopping at the end of the replay
+        while(lag >= MS_PER_TICK && tick < length)
+        {
+            replayTick(tick, &mode);
+            lag -= MS_PER_TICK;
+            tick++;
+        }
+        if(tick == length) lag = 0;
+
+        // Render the replay as the match was seen
+        double alpha = paused ? 1 : lag / MS_PER_TICK;
+        SDL_RenderClear(renderer);
+        followGuys(alpha);
+        renderLevel(alpha);
+        renderSprites(alpha);
+        renderInterface(mode, tick, getHealth(0), getHealth(1), getCooldowns(0), getCooldowns(1));
+        SDL_RenderPresent(renderer);
+
+        // Cap framerate at MAX_FPS
+        int sleep_time = (1000.0 / MAX_FPS) - (SDL_GetTicks() - start_time);
+        if(sleep_time > 0) SDL_Delay(sleep_time);
+    }
+    return true;
+}
+
+// Simulate one tick of a netplay match from both guys' inputs (used for rollbacks too), returning
+// whether the match ended on it
+bool netTick(int* mode, const Uint8* inputs)
+{
+    int before = *mode;
+    if(*mode == VS) applyInputs(*mode, inputs);
+    simulateTick(mode);
+    return before == VS && *mode == GAME_OVER_VS;
+}
+
+// Play a VS match against another instance over the network. In headless mode, this instance's
+// guy is controlled by the CPU for a number of ticks (or until the match ends), and netplay statistics
+// are printed at the end. Once the match ends, both instances stop on the tick after it, and the game
+// over screen is shown until esc or enter is hit.
+void runNetplay(long long ticks)
+{
+    // Both instances start the same match, seeded by the host
+    int mode = VS;
+    int local = getLocalGuy();
+    int* starts = getStartingPositions(FOREST);
+    spawnSprite(GUY, starts[0], starts[1], 0, 0, RIGHT, 0, 0, 0);
+    spawnSprite(GUY, starts[2], starts[3], 0, 0, LEFT, 0, 0, 0);
+    setLevel(FOREST, mode);
+    seedMatch(getNetSeed());
+    if(!headless) startMusic();
+
+    long long tick = 0;
+    double lag = 0;
+    Uint64 last_time = SDL_GetPerformanceCounter();
+    bool quit = false;
+    bool over = false;
+    SDL_Event e;
+    while(!quit && (!headless || (tick < ticks && !over)))
+    {
+        // Track how long this frame takes, and release last frame's transient data
+        int start_time = SDL_GetTicks();
+        resetFrameArena();
+
+        // Finish any assets decoded since last frame, and grow the audio buffer if it's been running dry
+        updateLoader();
+        updateAudio();
+
+        // Accumulate the time since the last frame
+        Uint64 now = SDL_GetPerformanceCounter();
+        double elapsed = (now - last_time) * 1000.0 / SDL_GetPerformanceFrequency();
+        last_time = now;
+        lag = fmin(lag + elapsed, MAX_FRAME_LAG);
+
+        // Hit esc to leave the match (or esc or enter to leave the game over screen)
+        while(!headless && SDL_PollEvent(&e) != 0)
+        {
+            int key = e.type == SDL_KEYDOWN ? e.key.keysym.sym : 0;
+            if(e.type == SDL_QUIT || key == SDLK_ESCAPE || (over && key == SDLK_RETURN)) quit = true;
+        }
+
+        // Once the match is over the session is done, and the world just plays out behind the game over
+        // screen as it does offline
+        while(over && lag >= MS_PER_TICK)
+        {
+            simulateTick(&mode);
+            lag -= MS_PER_TICK;
+            tick++;
+        }
+
+        // Exchange inputs with the other instance
+        if(!over && !pollNetplay())
+        {
+            fprintf(stderr, "Error: Lost connection\n");
+            break;
+        }
+
+        // Run as many ticks as the elapsed time calls for, unless too far ahead of the other instance
+        while(!over && lag >= MS_PER_TICK && (!headless || tick < ticks))
+        {
+            // Now and then, give up a tick if this instance is running ahead of the other
+            if(netplayAhead())
+            {
+                lag -= MS_PER_TICK;
+                continue;
+            }
+
+            Uint8 input = headless ? decideCPUAction(local) : readKeys(SDL_GetKeyboardState(NULL), ai_controls);
+            if(!advanceNetplay(input, &mode)) break;
+            lag -= MS_PER_TICK;
+            tick++;
+        }
+
+        // When the match ends on a tick both instances agree on, stop there and let the other instance
+        // catch up to it before the connection is closed
+        long long end = over ? -1 : netplayEnd(&mode);
+        if(end >= 0)
+        {
+            tick = end;
+            over = true;
+            finishNetplay(&mode);
+        }
+
+        // Render changes to screen
+        if(!headless)
+        {
+            double alpha = lag / MS_PER_TICK;
+            SDL_RenderClear(renderer);
+            followGuys(alpha);
+            renderLevel(alpha);
+            renderSprites(alpha);
+            renderInterface(mode, tick, getHealth(0), getHealth(1), getCooldowns(0), getCooldowns(1));
+            SDL_RenderPresent(renderer);
+        }
+
+        // Cap framerate at MAX_FPS
+        int sleep_time = (1000.0 / MAX_FPS) - (SDL_GetTicks() - start_time);
+        if(sleep_time > 0) SDL_Delay(sleep_time);
+    }
+
+    // Make sure both instances end on the same tick, with the same world
+    if(headless)
+    {
+        if(!over) finishNetplay(&mode);
+        printNetStats();
+    }
+}
+
 int main(int argc, char** argv)
 {
     // Parse command line arguments
-    if(argc > 1)
+    long long headless_ticks = HEADLESS_TICKS;
+    bool seeded = false;
+    const char* replay_path = NULL;
+    const char* net_address = NULL;
+    int net_port = 0, net_delay = 0, net_loss = 0;
+    for(int i = 1; i < argc; i++)
     {
-        if(!strcmp(argv[1], "-d") || !strcmp(argv[1], "--debug"))
+        if(!strcmp(argv[i], "-d") || !strcmp(argv[i], "--debug"))
         {
             setDebugMode();
             setMute();
         }
-        else if(!strcmp(argv[1], "-m") || !strcmp(argv[1], "--mute"))
+        else if(!strcmp(argv[i], "-m") || !strcmp(argv[i], "--mute"))
         {
             setMute();
         }
-        else if(!strcmp(argv[1], "-v") || !strcmp(argv[1], "--version"))
+        else if(!strcmp(argv[i], "-l") || !strcmp(argv[i], "--low-latency"))
+        {
+            setLowLatency();
+        }
+        else if(!strcmp(argv[i], "--headless"))
+        {
+            // Optionally followed by the number of ticks to simulate
+            headless = true;
+            setMute();
+            if(i + 1 < argc && atoll(argv[i + 1]) > 0) headless_ticks = atoll(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "--seed") && i + 1 < argc)
+        {
+            // Seed the match's random streams, to play out a reproducible match
+            seeded = true;
+            next_seed = strtoull(argv[++i], NULL, 10);
+        }
+        else if(!strcmp(argv[i], "--record") && i + 1 < argc)
+        {
+            // Record each match to a replay file (overwritten by the next match)
+            record_path = argv[++i];
+        }
+        else if(!strcmp(argv[i], "--replay") && i + 1 < argc)
+        {
+            // Play back a recorded match instead of playing
+            replay_path = argv[++i];
+        }
+        else if(!strcmp(argv[i], "--profile") && i + 1 < argc)
+        {
+            // Profile from the start, and write the trace to a file on exit
+            profile_path = argv[++i];
+            setProfiling(true);
+        }
+        else if(!strcmp(argv[i], "--host") && i + 1 < argc)
+        {
+            // Host a VS match over the network on a port
+            net_port = atoi(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "--join") && i + 1 < argc && strchr(argv[i + 1], ':'))
+        {
+            // Join a VS match over the network at address:port
+            net_address = argv[++i];
+            char* colon = strrchr(argv[i], ':');
+            *colon = '\0';
+            net_port = atoi(colon + 1);
+        }
+        else if(!strcmp(argv[i], "--net-delay") && i + 1 < argc)
+        {
+            // Delay outgoing packets, to test netplay on one machine
+            net_delay = atoi(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "--net-loss") && i + 1 < argc)
+        {
+            // Drop a percentage of outgoing packets, to test netplay on one machine
+            net_loss = atoi(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "-v") || !strcmp(argv[i], "--version"))
         {
             printf("GUY_BATTLE 1.0.0\n");
             return 0;
         }
-        else if(!strcmp(argv[1], "-h") || !strcmp(argv[1], "--help"))
+        else if(!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help"))
         {
             printf("\nGUY_BATTLE 1.0.0\n\n");
             printf("Options\n");
             printf("----------------\n");
             printf("-d, --debug          run in debug mode\n");
             printf("-m, --mute           play with no sound effects or music\n");
+            printf("-l, --low-latency    use the smallest audio buffer the machine can keep filled\n");
+            printf("--headless [TICKS]   simulate an AI vs AI match with no window or audio, as fast as possible\n");
+            printf("--seed SEED          seed the game's random numbers, for reproducible matches\n");
+            printf("--record FILE        record each match to a replay file\n");
+            printf("--replay FILE        play back a replay (space pauses, up/down change speed, left/right seek)\n");
+            printf("--profile FILE       profile frame times from the start (F3 toggles), and export a Chrome trace\n");
+            printf("--host PORT          host a VS match over the network\n");
+            printf("--join ADDRESS:PORT  join a VS match over the network\n");
+            printf("--net-delay MS       delay outgoing network packets, for testing\n");
+            printf("--net-loss PERCENT   drop outgoing network packets, for testing\n");
             printf("-v, --version        print version information\n");
             printf("-h, --help           print help text\n\n");
             return 0;
         }
         else
         {
-            printf("Unknown option: %s\n", argv[1]);
+            printf("Unknown option: %s\n", argv[i]);
             printf("Use -h or --help to see a list of available options.\n");
             return 0;
         }
@@ -160,32 +715,80 @@ int main(int argc, char** argv)
         return 1;
     }
 
+    // Without a given seed, every run plays out differently
+    if(!seeded) next_seed = SDL_GetPerformanceCounter();
+    seedMatch(next_seed);
+
+    // Play a match over the network, and exit
+    if(net_port)
+    {
+        bool connected = startNetplay(net_address, net_port, net_delay, net_loss, netTick);
+        if(!connected) fprintf(stderr, "Error: Could not connect to the other player\n");
+        else           runNetplay(headless_ticks);
+        stopNetplay();
+        quitGame();
+        return !connected;
+    }
+
+    // Play back a replay, headless or in the window, and exit
+    if(replay_path)
+    {
+        bool loaded = loadReplay(replay_path);
+        if(!loaded) fprintf(stderr, "Error: Could not read replay from %s\n", replay_path);
+        else
+        {
+            demo = getReplayDemo();
+            printf("Seed: %llu\n", getReplaySeed());
+            if(headless) loaded = runReplayHeadless();
+            else         loaded = runReplay();
+        }
+        freeReplay();
+        quitGame();
+        return !loaded;
+    }
+
+    // In headless mode, just run the simulation and exit
+    if(headless)
+    {
+        printf("Seed: %llu\n", next_seed);
+        runHeadless(headless_ticks);
+        quitGame();
+        return 0;
+    }
+
     // Track what mode the game is in, and what menu selection is hovered
     int mode = OPENING;
     int selection = VS;
     int vs_or_ai = VS;
 
-    // Track how many frames have passed since the game started
-    long long frame = 0;
+    // Track how many simulation ticks have passed since the game started, and how much
+    // real time has passed that hasn't been simulated yet
+    long long tick = 0;
+    double lag = 0;
+    Uint64 last_time = SDL_GetPerformanceCounter();
 
     // Game loop
     bool quit = false;
     SDL_Event e;
     while(!quit)
     {
-        // Track how long this frame takes
+        // Track how long this frame takes, and release last frame's transient data
         int start_time = SDL_GetTicks();
-
-        // Delay the music starting a little bit because it's less jarring
-        if(frame == 10) startMusic();
-
-        // Immediately spawn guys and go to title in debug mode,
-        // otherwise guys spawn at specific points in opening scene
-        int f = frame, m = mode;
-        int* s = getStartingPositions(getLevel());
-        if((m == OPENING && f == 100) || (debug && f == 0)) spawnSprite(GUY, s[0], -100, 0, 0, RIGHT, 0, 0, 0);
-        if((m == OPENING && f == 225) || (debug && f == 0)) spawnSprite(GUY, s[2], -100, 0, 0, LEFT, 0, 0, 0);
-        if((m == OPENING && f == 375) || (debug && f == 0)) mode = TITLE;
+        Uint64 frame_zone = beginZone();
+        resetFrameArena();
+
+        // Finish any assets decoded since last frame, and grow the audio buffer if it's been running dry
+        updateLoader();
+        updateAudio();
+
+        // Accumulate the time since the last frame. A very slow frame is only partly made up for,
+        // so the simulation can't fall further and further behind. In debug mode, the game runs
+        // in slow motion.
+        Uint64 now = SDL_GetPerformanceCounter();
+        double elapsed = (now - last_time) * 1000.0 / SDL_GetPerformanceFrequency();
+        last_time = now;
+        if(debug) elapsed /= 3;
+        lag += fmin(elapsed, MAX_FRAME_LAG);
 
         // Process any SDL events that have happened since last frame
         while(SDL_PollEvent(&e) != 0)
@@ -193,6 +796,9 @@ int main(int argc, char** argv)
             // No need to process further events if an exit signal was received
             if(e.type == SDL_QUIT) quit = true;
 
+            // F3 switches profiling on and off in any mode
+            if(e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_F3) setProfiling(!profiling);
+
             // Process key presses as game mode changes / menu selections
             if(e.type == SDL_KEYDOWN)
             {
@@ -213,6 +819,7 @@ int main(int argc, char** argv)
                                 mode = STAGE_SELECT;
                                 vs_or_ai = selection;
                                 playSoundEffect(SFX_SELECT);
+                                prefetchStages();
                             }
                         }
                         else if(key == SDLK_UP)
@@ -230,6 +837,7 @@ int main(int argc, char** argv)
                         if(key == SDLK_RETURN)
                         {
                             mode = vs_or_ai;
+                            startMatch(mode);
                             playSoundEffect(SFX_SELECT);
                         }
                         else if(key == SDLK_ESCAPE)
@@ -241,11 +849,13 @@ int main(int argc, char** argv)
                         {
                             selection = hover(mode, UP);
                             if(getLevel() != selection) setLevel(FOREST, vs_or_ai);
+                            prefetchStages();
                         }
                         else if(key == SDLK_DOWN)
                         {
                             selection = hover(mode, DOWN);
                             if(getLevel() != selection) setLevel(VOLCANO, vs_or_ai);
+                            prefetchStages();
                         }
                         break;
 
@@ -293,104 +903,36 @@ int main(int argc, char** argv)
             }
         }
 
-        if(mode != PAUSE)
+        // Run as many fixed simulation ticks as the elapsed time calls for
+        while(lag >= MS_PER_TICK)
         {
-            // Process key presses as actions in battle
-            const Uint8* keys = SDL_GetKeyboardState(NULL);
-            bool succ = 0;
-            int guy = 0;
-            if(mode == VS)
-            {
-                // Input for guy 0
-                if(!succ && keys[SDL_SCANCODE_5])                          succ = cast(guy, ARCSURGE);
-                if(!succ && keys[SDL_SCANCODE_4])                          succ = cast(guy, DARKEDGE);
-                if(!succ && keys[SDL_SCANCODE_3])                          succ = cast(guy, ROCKFALL);
-                if(!succ && keys[SDL_SCANCODE_2])                          succ = cast(guy, ICESHOCK);
-                if(!succ && keys[SDL_SCANCODE_1])                          succ = cast(guy, FIREBALL);
-                if(!succ && keys[SDL_SCANCODE_D])                          succ = jump(guy);
-                if(!succ && keys[SDL_SCANCODE_X] && !keys[SDL_SCANCODE_V]) succ = walk(guy, LEFT);
-                if(!succ && keys[SDL_SCANCODE_V] && !keys[SDL_SCANCODE_X]) succ = walk(guy, RIGHT);
-
-                // Input for guy 1
-                succ = 0;
-                guy = 1;
-                if(!succ && keys[SDL_SCANCODE_P])                                 succ = cast(guy, ARCSURGE);
-                if(!succ && keys[SDL_SCANCODE_O])                                 succ = cast(guy, DARKEDGE);
-                if(!succ && keys[SDL_SCANCODE_I])                                 succ = cast(guy, ROCKFALL);
-                if(!succ && keys[SDL_SCANCODE_U])                                 succ = cast(guy, ICESHOCK);
-                if(!succ && keys[SDL_SCANCODE_Y])                                 succ = cast(guy, FIREBALL);
-                if(!succ && keys[SDL_SCANCODE_UP])                                succ = jump(guy);
-                if(!succ && keys[SDL_SCANCODE_LEFT] && !keys[SDL_SCANCODE_RIGHT]) succ = walk(guy, LEFT);
-                if(!succ && keys[SDL_SCANCODE_RIGHT] && !keys[SDL_SCANCODE_LEFT]) succ = walk(guy, RIGHT);
-            }
-            else if(mode == AI)
-            {
-                // Input for guy 0
-                if(!succ && keys[SDL_SCANCODE_5])                                 succ = sCast(guy, ARCSURGE);
-                if(!succ && keys[SDL_SCANCODE_4])                                 succ = sCast(guy, DARKEDGE);
-                if(!succ && keys[SDL_SCANCODE_3])                                 succ = sCast(guy, ROCKFALL);
-                if(!succ && keys[SDL_SCANCODE_2])                                 succ = sCast(guy, ICESHOCK);
-                if(!succ && keys[SDL_SCANCODE_1])                                 succ = sCast(guy, FIREBALL);
-                if(!succ && keys[SDL_SCANCODE_UP])                                succ = jump(guy);
-                if(!succ && keys[SDL_SCANCODE_LEFT] && !keys[SDL_SCANCODE_RIGHT]) succ = walk(guy, LEFT);
-                if(!succ && keys[SDL_SCANCODE_RIGHT] && !keys[SDL_SCANCODE_LEFT]) succ = walk(guy, RIGHT);
-
-                // Decisions for CPU Guy
-                takeCPUAction();
-            }
-
-            // Move the background
-            moveBackground();
-
-            // Update positions, velocities, and orientations of all sprites
-            moveSprites();
-
-            // Check for and handle collisions with terrain or other sprites
-            terrainCollisions(getPlatforms(), getWalls());
-            spriteCollisions();
-
-            // Spawn any new spells that people are casting
-            launchSpells();
-
-            // Update values on timed sprite variables (spell cooldowns, casting / collision durations, etc)
-            advanceTimers();
-
-            // Unload dead sprites and check for dead guys
-            int signal = unloadSprites();
-            if(signal)
-            {
-                // In VS mode, if either guy dies, the game ends. In AI mode, if the cpu guy dies,
-                // a new guy is spawned and play continues.
-                if(mode == VS) mode = GAME_OVER_VS;
-                else if (signal == 1) mode = GAME_OVER_AI;
-                else
-                {
-                    int* starts = getStartingPositions(getLevel());
-                    resetGuy(1, starts[2], -100);
-                    updateScore(100);
-                }
-            }
-
-            // Update the animation frame which is drawn for all sprites
-            updateAnimationFrames();
+            PROFILE_ZONE("tickGame") tickGame(&mode, tick);
+            lag -= MS_PER_TICK;
+            tick++;
         }
 
-        // Render changes to screen
+        // Render changes to screen, interpolating sprites and backgrounds between the last two
+        // ticks by however far we are into the next one (nothing moves while paused)
+        double alpha = lag / MS_PER_TICK;
+        if(mode == PAUSE) alpha = 1;
         SDL_RenderClear(renderer);
-        renderLevel();
-        renderSprites();
-        renderInterface(mode, frame, getHealth(0), getHealth(1), getCooldowns(0), getCooldowns(1));
-        SDL_RenderPresent(renderer);
+        followGuys(alpha);
+        PROFILE_ZONE("renderLevel") renderLevel(alpha);
+        PROFILE_ZONE("renderSprites") renderSprites(alpha);
+        PROFILE_ZONE("renderInterface")
+        {
+            renderInterface(mode, tick, getHealth(0), getHealth(1), getCooldowns(0), getCooldowns(1));
+        }
+        PROFILE_ZONE("SDL_RenderPresent") SDL_RenderPresent(renderer);
 
         // Cap framerate at MAX_FPS
-        double ms_per_frame = 1000.0 / MAX_FPS;
-        if(debug) ms_per_frame *= 3;
-        int sleep_time = ms_per_frame - (SDL_GetTicks() - start_time);
-        if(sleep_time > 0) SDL_Delay(sleep_time);
-        frame++;
+        int sleep_time = (1000.0 / MAX_FPS) - (SDL_GetTicks() - start_time);
+        if(sleep_time > 0) PROFILE_ZONE("sleep") SDL_Delay(sleep_time);
+        endZone("frame", frame_zone);
     }
 
-    // Free all resources and exit game
+    // Save the replay of a match that was quit partway, then free all resources and exit game
+    endMatch();
     quitGame();
     return 0;
 }
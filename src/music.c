@@ -0,0 +1,324 @@
+#include "../headers/constants.h"
+#include "../headers/sound.h"
+#include "../headers/music.h"
+
+// WAV format tags the stream can decode
+#define FORMAT_PCM 1
+#define FORMAT_IMA_ADPCM 0x11
+
+// Struct for an open music track
+struct music_stream
+{
+    FILE* file;                      // the track's file, positioned by the decode thread
+    int format;                      // FORMAT_PCM or FORMAT_IMA_ADPCM
+    int channels;                    // channels in the file (mono is played in both ears)
+    long data_offset;                // offset of the first block in the file
+    int block_bytes;                 // size of a block in the file
+    int block_frames;                // frames decoded from a full block
+    long long total_frames;          // frames in the whole track
+    long long loop_start;            // frame the track jumps back to on reaching loop_end
+    long long loop_end;
+    long long next_frame;            // next frame the decode thread will push
+    Uint8 block[MAX_ADPCM_BLOCK];    // the block being decoded
+    Sint16 decoded[MAX_ADPCM_BLOCK * 2 * 2]; // the block, decoded to interleaved stereo
+};
+
+struct music_stream music;                 // The track being streamed
+bool music_open = false;                   // Whether a track is open
+SDL_Thread* decoder = NULL;                // Thread decoding the track into the ring buffer
+SDL_atomic_t decoder_quit;                 // Set to tell the decode thread to finish
+
+Sint16 music_ring[MUSIC_RING_FRAMES * 2];  // Decoded music waiting to be played, in interleaved stereo
+SDL_atomic_t ring_written;                 // Frames ever written to the ring (by the decode thread only)
+SDL_atomic_t ring_read;                    // Frames ever read from the ring (by the audio thread only)
+int music_underruns = 0;                   // Times the ring ran dry once playing (with the device locked)
+
+// IMA ADPCM step sizes, and how each code moves through them
+const int ima_steps[89] =
+{ 7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97,
+  107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+  876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871,
+  5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623,
+  27086, 29794, 32767 };
+const int ima_index_change[16] = { -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+
+/* DECODING */
+
+// Decode one 4-bit IMA ADPCM code, updating the channel's predictor and step index
+static Sint16 decodeNibble(int code, int* predictor, int* index)
+{
+    int step = ima_steps[*index];
+    int diff = step >> 3;
+    if(code & 4) diff += step;
+    if(code & 2) diff += step >> 1;
+    if(code & 1) diff += step >> 2;
+    *predictor += (code & 8) ? -diff : diff;
+    *predictor = *predictor > 32767 ? 32767 : (*predictor < -32768 ? -32768 : *predictor);
+    *index += ima_index_change[code];
+    *index = *index < 0 ? 0 : (*index > 88 ? 88 : *index);
+    return *predictor;
+}
+
+// Decode an IMA ADPCM block of n bytes into interleaved stereo, returning the number of frames
+static int decodeAdpcm(const Uint8* block, int n, int channels, Sint16* out)
+{
+    // Each channel's header holds its first sample and step index
+    int predictor[2], index[2];
+    for(int c = 0; c < channels; c++)
+    {
+        predictor[c] = (Sint16) (block[4 * c] | (block[4 * c + 1] << 8));
+        index[c] = block[4 * c + 2] > 88 ? 88 : block[4 * c + 2];
+        out[c] = predictor[c];
+    }
+    if(channels == 1) out[1] = out[0];
+
+    // Then the channels take turns with 4 bytes (8 samples) each, low nibble first
+    int frames = 1;
+    for(int pos = 4 * channels; pos + 4 * channels <= n; pos += 4 * channels)
+    {
+        for(int c = 0; c < channels; c++)
+        {
+            for(int i = 0; i < 8; i++)
+            {
+                Uint8 byte = block[pos + 4 * c + i / 2];
+                int code = (i % 2) ? byte >> 4 : byte & 15;
+                out[2 * (frames + i) + c] = decodeNibble(code, &predictor[c], &index[c]);
+            }
+        }
+        if(channels == 1)
+        {
+            for(int i = 0; i < 8; i++) out[2 * (frames + i) + 1] = out[2 * (frames + i)];
+        }
+        frames += 8;
+    }
+    return frames;
+}
+
+// Read and decode the block a frame of the track is in, returning the frame the block starts at
+// (the decoded frames are left in music.decoded, and their number in *frames)
+static long long decodeBlockAt(long long frame, int* frames)
+{
+    long long block = frame / music.block_frames;
+    fseek(music.file, music.data_offset + (long) (block * music.block_bytes), SEEK_SET);
+    int n = (int) fread(music.block, 1, music.block_bytes, music.file);
+
+    if(music.format == FORMAT_IMA_ADPCM)
+    {
+        *frames = n >= 4 * music.channels ? decodeAdpcm(music.block, n, music.channels, music.decoded) : 0;
+    }
+    else
+    {
+        // 16-bit little-endian PCM just needs spreading to stereo
+        *frames = n / (2 * music.channels);
+        for(int i = 0; i < *frames; i++)
+        {
+            for(int c = 0; c < 2; c++)
+            {
+                int at = 2 * (i * music.channels + (c < music.channels ? c : 0));
+                music.decoded[2 * i + c] = (Sint16) (music.block[at] | (music.block[at + 1] << 8));
+            }
+        }
+    }
+    *frames = fmin(*frames, music.total_frames - block * music.block_frames);
+    return block * music.block_frames;
+}
+
+// Decode the track into the ring buffer, keeping it as full as possible until told to quit
+static int decodeMusic(void* data)
+{
+    while(!SDL_AtomicGet(&decoder_quit))
+    {
+        // Wait for room for a whole block
+        Uint32 written = SDL_AtomicGet(&ring_written);
+        Uint32 space = MUSIC_RING_FRAMES - (written - (Uint32) SDL_AtomicGet(&ring_read));
+        if(space < (Uint32) music.block_frames)
+        {
+            SDL_Delay(MUSIC_POLL_MS);
+            continue;
+        }
+
+        // Decode the block holding the next frame, and push the part of it before the loop end
+        int frames;
+        long long start = decodeBlockAt(music.next_frame, &frames);
+        int from = music.next_frame - start;
+        int to = fmin(frames, music.loop_end - start);
+        if(to <= from)
+        {
+            // A truncated file ends early - loop from wherever it stops
+            music.next_frame = music.loop_start;
+            if(frames == 0) SDL_Delay(MUSIC_POLL_MS);
+            continue;
+        }
+        for(int i = from; i < to; i++)
+        {
+            int slot = (written + i - from) & (MUSIC_RING_FRAMES - 1);
+            music_ring[2 * slot] = music.decoded[2 * i];
+            music_ring[2 * slot + 1] = music.decoded[2 * i + 1];
+        }
+        SDL_AtomicSet(&ring_written, written + to - from);
+
+        // Jump back to the loop start after the loop end, so the loop is seamless
+        music.next_frame = start + to;
+        if(music.next_frame >= music.loop_end) music.next_frame = music.loop_start;
+    }
+    return 0;
+}
+
+// Fill the music stream from the ring buffer (runs on the audio thread, before sound effects are mixed in)
+static void feedMusic(void* data, Uint8* stream, int len)
+{
+    Sint16* out = (Sint16*) stream;
+    int frames = len / (int) (NUM_CHANNELS * sizeof(Sint16));
+    Uint32 read = SDL_AtomicGet(&ring_read);
+    Uint32 available = (Uint32) SDL_AtomicGet(&ring_written) - read;
+
+    // Play what's been decoded, and silence if the decoder has fallen behind (which only counts
+    // once it's had a chance to get ahead)
+    int n = fmin(frames, available);
+    if(n < frames && SDL_AtomicGet(&ring_written) > 0) music_underruns++;
+    for(int i = 0; i < n; i++)
+    {
+        int slot = (read + i) & (MUSIC_RING_FRAMES - 1);
+        out[2 * i] = music_ring[2 * slot] * MUSIC_VOLUME / 128;
+        out[2 * i + 1] = music_ring[2 * slot + 1] * MUSIC_VOLUME / 128;
+    }
+    memset(out + 2 * n, 0, sizeof(Sint16) * 2 * (frames - n));
+    SDL_AtomicSet(&ring_read, read + n);
+}
+
+/* FILE PARSING */
+
+// Read a little-endian integer of n bytes from a buffer
+static Uint32 readLE(const Uint8* buf, int n)
+{
+    Uint32 value = 0;
+    for(int i = n - 1; i >= 0; i--) value = (value << 8) | buf[i];
+    return value;
+}
+
+// Open a track for streaming, at the given device sample rate (returns false if it can't be played)
+bool openMusic(const char* path, int sample_rate)
+{
+    music.file = fopen(path, "rb");
+    if(!music.file) return false;
+
+    // Walk the RIFF chunks for the format, loop points, and where the audio data is
+    Uint8 header[12], chunk[8], fmt[20] = {0}, smpl[60] = {0};
+    bool has_fmt = false, has_loop = false;
+    long data_size = 0;
+    music.data_offset = 0;
+    if(fread(header, 1, 12, music.file) != 12 || memcmp(header, "RIFF", 4) || memcmp(header + 8, "WAVE", 4))
+    {
+        fclose(music.file);
+        return false;
+    }
+    while(fread(chunk, 1, 8, music.file) == 8)
+    {
+        long size = readLE(chunk + 4, 4);
+        long next = ftell(music.file) + size + (size & 1);
+        if(!memcmp(chunk, "fmt ", 4))
+        {
+            has_fmt = fread(fmt, 1, fmin(size, sizeof(fmt)), music.file) >= 16;
+        }
+        else if(!memcmp(chunk, "smpl", 4) && size >= 60)
+        {
+            has_loop = fread(smpl, 1, 60, music.file) == 60 && readLE(smpl + 28, 4) > 0;
+        }
+        else if(!memcmp(chunk, "data", 4))
+        {
+            music.data_offset = ftell(music.file);
+            data_size = size;
+        }
+        fseek(music.file, next, SEEK_SET);
+    }
+
+    // Only 16-bit PCM and 4-bit IMA ADPCM, mono or stereo, at the device's rate can be played
+    music.format = readLE(fmt, 2);
+    music.channels = readLE(fmt + 2, 2);
+    music.block_bytes = readLE(fmt + 12, 2);
+    int bits = readLE(fmt + 14, 2);
+    bool playable = has_fmt && music.data_offset && (music.channels == 1 || music.channels == 2)
+                 && (int) readLE(fmt + 4, 4) == sample_rate
+                 && ((music.format == FORMAT_PCM && bits == 16)
+                  || (music.format == FORMAT_IMA_ADPCM && bits == 4 && music.block_bytes <= MAX_ADPCM_BLOCK
+                      && music.block_bytes > 4 * music.channels));
+    if(!playable)
+    {
+        fclose(music.file);
+        return false;
+    }
+
+    // Work out how blocks map to frames
+    if(music.format == FORMAT_IMA_ADPCM)
+    {
+        music.block_frames = (music.block_bytes - 4 * music.channels) * 2 / music.channels + 1;
+        long full = data_size / music.block_bytes, rest = data_size % music.block_bytes;
+        music.total_frames = full * music.block_frames;
+        if(rest >= 4 * music.channels) music.total_frames += (rest - 4 * music.channels) * 2 / music.channels + 1;
+    }
+    else
+    {
+        music.block_frames = PCM_BLOCK_FRAMES;
+        music.block_bytes = PCM_BLOCK_FRAMES * 2 * music.channels;
+        music.total_frames = data_size / (2 * music.channels);
+    }
+
+    // Loop over the first loop in the sampler chunk (whose end is inclusive), or else the whole track
+    music.loop_start = 0;
+    music.loop_end = music.total_frames;
+    if(has_loop)
+    {
+        long long start = readLE(smpl + 44, 4), end = (long long) readLE(smpl + 48, 4) + 1;
+        if(start < end && end <= music.total_frames)
+        {
+            music.loop_start = start;
+            music.loop_end = end;
+        }
+    }
+    music.next_frame = 0;
+    music_open = music.total_frames > 0;
+    if(!music_open) fclose(music.file);
+    return music_open;
+}
+
+/* PLAYBACK */
+
+// Start the decode thread and feed the track to the audio device, looping forever
+void playMusic(void)
+{
+    if(!music_open || decoder) return;
+    SDL_AtomicSet(&decoder_quit, 0);
+    SDL_AtomicSet(&ring_written, 0);
+    SDL_AtomicSet(&ring_read, 0);
+    decoder = SDL_CreateThread(decodeMusic, "music", NULL);
+    if(decoder) Mix_HookMusic(feedMusic, NULL);
+}
+
+// Hook the music back into the audio device after it's been reopened
+void resumeMusic(void)
+{
+    if(decoder) Mix_HookMusic(feedMusic, NULL);
+}
+
+// Get the number of times the audio device has asked for music the decoder hadn't decoded yet
+int getMusicUnderruns(void)
+{
+    SDL_LockAudio();
+    int underruns = music_underruns;
+    SDL_UnlockAudio();
+    return underruns;
+}
+
+// Stop the music and close the track
+void closeMusic(void)
+{
+    if(decoder)
+    {
+        Mix_HookMusic(NULL, NULL);
+        SDL_AtomicSet(&decoder_quit, 1);
+        SDL_WaitThread(decoder, NULL);
+        decoder = NULL;
+    }
+    if(music_open) fclose(music.file);
+    music_open = false;
+}
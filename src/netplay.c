@@ -0,0 +1,513 @@
+#define _POSIX_C_SOURCE 200112L
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../headers/constants.h"
+#include "../headers/random.h"
+#include "../headers/sound.h"
+#include "../headers/replay.h"
+#include "../headers/netplay.h"
+#include "../headers/profiler.h"
+
+// Identifies the game's packets
+#define NET_MAGIC 0x4E504247 // "GBPN"
+
+// Sizes of the netplay buffers
+#define NET_WINDOW 256           // ticks of inputs kept for both guys
+#define NET_MAX_INPUTS 64        // most inputs sent in one packet
+#define NUM_SNAPSHOTS 16         // world states kept for rolling back (must be more than MAX_ROLLBACK + 1)
+#define NUM_CHECKSUMS 16         // world checksums kept for comparing with the other instance
+#define MAX_DELAYED 4096         // most packets held back by the latency shim
+
+// Kinds of packets
+enum packet_types
+{ HELLO, START, INPUT };
+
+// Packet sent between instances. Every input packet carries all of the sender's inputs that
+// haven't been acknowledged yet, so lost packets are made up for by the next one.
+struct packet
+{
+    uint32_t magic;                  // NET_MAGIC
+    uint32_t type;                   // HELLO, START, or INPUT
+    uint64_t seed;                   // seed of the match (START only)
+    int32_t start;                   // tick of the first input in the packet
+    int32_t count;                   // number of inputs in the packet
+    int32_t ack;                     // the sender has the receiver's inputs for every tick before this
+    int32_t tick;                    // next tick the sender will simulate
+    int32_t advantage;               // how many ticks the sender is past the receiver's latest tick it knows of
+    int32_t check_tick;              // tick of the sender's latest world checksum (-1 if none yet)
+    uint32_t checksum;               // the sender's world checksum at that tick
+    uint8_t inputs[NET_MAX_INPUTS];  // the sender's inputs, starting at tick start
+};
+
+// World state saved before simulating a tick, for rolling back to
+struct snapshot
+{
+    long long tick;                  // tick the state was saved before (-1 if unused)
+    char* data;                      // the saved world state
+    size_t size;                     // size of the saved world state in bytes
+    size_t capacity;                 // size of the data buffer in bytes
+};
+
+// Packet held back by the latency shim until it's due to be sent
+struct delayed_packet
+{
+    Uint32 due;                      // time to send the packet, in ms
+    struct packet packet;
+};
+
+// Struct for the state of the connection and the match
+struct netplay
+{
+    // Connection
+    int sock;                        // UDP socket
+    struct sockaddr_in peer;         // address of the other instance
+    bool connected;                  // has the other instance been heard from
+    bool host;                       // is this instance hosting
+    unsigned long long seed;         // seed of the match
+    TickFunction tick_function;      // simulates one tick of the match
+    Uint32 last_heard;               // time the last packet arrived, in ms
+
+    // Inputs and rollback
+    int local;                       // guy controlled by this instance
+    long long tick;                  // next tick to simulate
+    long long received;              // the other guy's inputs are known for every tick before this
+    long long acked;                 // the other instance has this guy's inputs for every tick before this
+    long long mispredicted;          // earliest tick simulated with a wrong prediction (-1 if none)
+    long long ended;                 // tick the match ended on, as simulated so far (-1 if it hasn't)
+    Uint8 inputs[2][NET_WINDOW];     // inputs of both guys, by tick
+    Uint8 predicted[NET_WINDOW];     // input the other guy was predicted to give, by tick
+    struct snapshot snapshots[NUM_SNAPSHOTS];
+
+    // Time synchronization
+    long long remote_tick;           // latest tick the other instance is known to have reached
+    long long remote_advantage;      // how far ahead the other instance thinks it is of this one
+    long long last_sync;             // tick this instance last gave up a tick to let the other catch up
+
+    // Desync detection
+    long long checked;               // next tick whose world state may need a checksum
+    long long check_ticks[NUM_CHECKSUMS];
+    Uint32 checksums[NUM_CHECKSUMS]; // this instance's checksums of the world at check_ticks
+    long long last_check;            // tick of the latest checksum (-1 if none yet)
+    long long last_compared;         // tick of the latest checksum compared with the other instance's
+
+    // Latency / loss shim
+    int delay;                       // ms to hold back every outgoing packet
+    int loss;                        // percent of outgoing packets dropped
+    Rng shim_rng;                    // decides which packets are dropped
+    struct delayed_packet* delayed;  // packets held back, in order of due time
+    int num_delayed;
+
+    // Statistics
+    long long rollbacks;             // number of rollbacks
+    long long resimulated;           // total ticks re-simulated by rollbacks
+    long long stalls;                // times a tick was held back waiting for the other instance
+    long long syncs;                 // ticks given up to let the other instance catch up
+    long long desyncs;               // checksums which didn't match the other instance's
+    long long checks;                // checksums compared
+    int longest_rollback;            // most ticks re-simulated in one rollback
+    double worst_rollback_ms;        // longest time taken by one rollback
+    double total_rollback_ms;        // total time taken by rollbacks
+};
+
+struct netplay net; // The current netplay match
+
+/* PACKETS */
+
+// Send a packet straight to the other instance
+static void sendNow(struct packet* p)
+{
+    sendto(net.sock, p, sizeof(struct packet), 0, (struct sockaddr*) &net.peer, sizeof(net.peer));
+}
+
+// Send a packet to the other instance, through the latency / loss shim if it's enabled
+static void sendPacket(struct packet* p)
+{
+    if(net.loss && nextRand(&net.shim_rng) * 100 < net.loss) return;
+    if(net.delay && net.num_delayed < MAX_DELAYED)
+    {
+        net.delayed[net.num_delayed++] = (struct delayed_packet) { SDL_GetTicks() + net.delay, *p };
+    }
+    else if(!net.delay)
+    {
+        sendNow(p);
+    }
+}
+
+// Send any packets held back by the shim which are now due
+static void sendDelayed(void)
+{
+    int sent = 0;
+    Uint32 now = SDL_GetTicks();
+    while(sent < net.num_delayed && (Sint32) (now - net.delayed[sent].due) >= 0) sendNow(&net.delayed[sent++].packet);
+    memmove(net.delayed, net.delayed + sent, sizeof(struct delayed_packet) * (net.num_delayed - sent));
+    net.num_delayed -= sent;
+}
+
+// Send a packet with no inputs in it, of the given type
+static void sendControl(int type)
+{
+    struct packet p = { NET_MAGIC, type, net.seed, 0, 0, 0, 0, 0, -1, 0, {0} };
+    sendPacket(&p);
+}
+
+// Send every input of this instance's guy that the other instance hasn't acknowledged
+static void sendInputs(void)
+{
+    struct packet p = { NET_MAGIC, INPUT, net.seed, net.acked, 0, net.received, net.tick, net.tick - net.remote_tick,
+                        net.last_check, 0, {0} };
+    p.count = fmax(0, fmin(net.tick - net.acked, NET_MAX_INPUTS));
+    for(int i = 0; i < p.count; i++) p.inputs[i] = net.inputs[net.local][(net.acked + i) % NET_WINDOW];
+    if(net.last_check >= 0) p.checksum = net.checksums[(net.last_check / NET_CHECK_INTERVAL) % NUM_CHECKSUMS];
+    sendPacket(&p);
+}
+
+// Handle the other guy's inputs arriving, noting any tick which was simulated with a wrong prediction
+static void receiveInputs(struct packet* p)
+{
+    int remote = !net.local;
+    if(p->ack > net.acked && p->ack <= net.tick) net.acked = p->ack;
+    if(p->tick > net.remote_tick)
+    {
+        net.remote_tick = p->tick;
+        net.remote_advantage = p->advantage;
+    }
+    for(int i = 0; i < p->count; i++)
+    {
+        // Only the next unknown input is taken, so the known inputs are always contiguous
+        long long t = p->start + i;
+        if(t != net.received) continue;
+
+        Uint8 input = p->inputs[i];
+        net.inputs[remote][t % NET_WINDOW] = input;
+        if(t < net.tick && net.predicted[t % NET_WINDOW] != input && (net.mispredicted < 0 || t < net.mispredicted))
+        {
+            net.mispredicted = t;
+        }
+        net.received++;
+    }
+
+    // Compare the other instance's latest checksum with ours at the same tick
+    long long t = p->check_tick;
+    int k = (t / NET_CHECK_INTERVAL) % NUM_CHECKSUMS;
+    if(t > net.last_compared && t >= 0 && net.check_ticks[k] == t)
+    {
+        net.checks++;
+        if(net.checksums[k] != p->checksum) net.desyncs++;
+        net.last_compared = t;
+    }
+}
+
+// Receive and handle every packet waiting on the socket
+static void receivePackets(void)
+{
+    struct packet p;
+    struct sockaddr_in from;
+    socklen_t from_len = sizeof(from);
+    while(recvfrom(net.sock, &p, sizeof(p), 0, (struct sockaddr*) &from, &from_len) == sizeof(p))
+    {
+        from_len = sizeof(from);
+        if(p.magic != NET_MAGIC) continue;
+
+        // The host takes whoever says hello first as the other instance, and answers with the match's seed
+        if(net.host && p.type == HELLO && !net.connected)
+        {
+            net.peer = from;
+            net.connected = true;
+        }
+        if(from.sin_addr.s_addr != net.peer.sin_addr.s_addr || from.sin_port != net.peer.sin_port) continue;
+        net.last_heard = SDL_GetTicks();
+
+        if(net.host && p.type == HELLO) sendControl(START);
+        else if(!net.host && p.type == START && !net.connected)
+        {
+            net.seed = p.seed;
+            net.connected = true;
+        }
+        else if(p.type == INPUT && net.connected)
+        {
+            // The other instance never predicts more than MAX_ROLLBACK ticks past our latest input it has, so any
+            // inputs further ahead than that (or a count the packet can't hold) mean the packet is malformed
+            if(p.count < 0 || p.count > NET_MAX_INPUTS || p.start < 0) continue;
+            if((long long) p.start + p.count > net.tick + MAX_ROLLBACK) continue;
+            receiveInputs(&p);
+        }
+    }
+}
+
+/* ROLLBACK */
+
+// Checksum a buffer (FNV-1a)
+static Uint32 checksum(const char* data, size_t size)
+{
+    Uint32 hash = 2166136261u;
+    for(size_t i = 0; i < size; i++) hash = (hash ^ (Uint8) data[i]) * 16777619u;
+    return hash;
+}
+
+// Save the world state before simulating a tick
+static void saveSnapshot(long long tick, int mode)
+{
+    struct snapshot* s = &net.snapshots[tick % NUM_SNAPSHOTS];
+    size_t size = saveWorld(NULL, mode);
+    if(size > s->capacity)
+    {
+        s->capacity = size * 2;
+        s->data = (char*) realloc(s->data, s->capacity);
+    }
+    saveWorld(s->data, mode);
+    s->size = size;
+    s->tick = tick;
+}
+
+// Simulate a tick, predicting the other guy repeats his last known input if his input isn't known yet
+static void simulate(long long tick, int* mode)
+{
+    int remote = !net.local;
+    Uint8 inputs[2];
+    inputs[net.local] = net.inputs[net.local][tick % NET_WINDOW];
+    if(tick < net.received)
+    {
+        inputs[remote] = net.inputs[remote][tick % NET_WINDOW];
+    }
+    else
+    {
+        inputs[remote] = net.received ? net.inputs[remote][(net.received - 1) % NET_WINDOW] : 0;
+        net.predicted[tick % NET_WINDOW] = inputs[remote];
+    }
+    saveSnapshot(tick, *mode);
+    if(net.tick_function(mode, inputs) && net.ended < 0) net.ended = tick;
+}
+
+// If a tick was simulated with a wrong prediction, restore the world to that tick and re-simulate up to the present
+static void rollback(int* mode)
+{
+    if(net.mispredicted < 0) return;
+
+    // Once the match has ended, ticks past its end aren't simulated any more
+    if(net.mispredicted >= net.tick)
+    {
+        net.mispredicted = -1;
+        return;
+    }
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    long long from = net.mispredicted;
+    struct snapshot* s = &net.snapshots[from % NUM_SNAPSHOTS];
+    if(net.ended >= from) net.ended = -1;
+    PROFILE_ZONE("rollback")
+    {
+        // The re-simulated ticks were already heard the first time round
+        loadWorld(s->data, s->size, mode);
+        suppressSoundEffects(true);
+        for(long long t = from; t < net.tick; t++) simulate(t, mode);
+        suppressSoundEffects(false);
+    }
+    net.mispredicted = -1;
+
+    // Track how much work rollbacks are doing
+    double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+    net.rollbacks++;
+    net.resimulated += net.tick - from;
+    net.longest_rollback = fmax(net.longest_rollback, net.tick - from);
+    net.worst_rollback_ms = fmax(net.worst_rollback_ms, ms);
+    net.total_rollback_ms += ms;
+}
+
+// Checksum the world at every check tick whose state can no longer change (every input before it is known)
+static void updateChecksums(void)
+{
+    for(; net.checked <= net.received && net.checked < net.tick; net.checked++)
+    {
+        struct snapshot* s = &net.snapshots[net.checked % NUM_SNAPSHOTS];
+        if(net.checked % NET_CHECK_INTERVAL || s->tick != net.checked) continue;
+
+        int k = (net.checked / NET_CHECK_INTERVAL) % NUM_CHECKSUMS;
+        net.check_ticks[k] = net.checked;
+        net.checksums[k] = checksum(s->data, s->size);
+        net.last_check = net.checked;
+    }
+}
+
+/* CONNECTION */
+
+// Host a match on a port, or join the match hosted at address:port, waiting for the other instance to connect
+bool startNetplay(const char* address, int port, int delay, int loss, TickFunction tick)
+{
+    memset(&net, 0, sizeof(struct netplay));
+    net.sock = -1;
+    net.host = !address;
+    net.local = !net.host;
+    net.tick_function = tick;
+    net.mispredicted = -1;
+    net.ended = -1;
+    net.last_check = -1;
+    net.last_compared = -1;
+    net.delay = delay;
+    net.loss = loss;
+    net.delayed = (struct delayed_packet*) malloc(sizeof(struct delayed_packet) * MAX_DELAYED);
+    seedRng(&net.shim_rng, SDL_GetPerformanceCounter());
+    for(int i = 0; i < NUM_SNAPSHOTS; i++) net.snapshots[i].tick = -1;
+    for(int i = 0; i < NUM_CHECKSUMS; i++) net.check_ticks[i] = -1;
+
+    // The host picks the match's seed (the joiner is told it when the host answers)
+    if(net.host) net.seed = SDL_GetPerformanceCounter();
+
+    // Look up the address to host on (any local address) or to join
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = net.host ? AI_PASSIVE : 0;
+    char service[16];
+    sprintf(service, "%d", port);
+    if(getaddrinfo(address, service, &hints, &res)) return false;
+
+    // Open a non-blocking socket - the host listens on the port, and the joiner sends to it
+    net.sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    bool succ = net.sock >= 0;
+    if(succ && net.host) succ = !bind(net.sock, res->ai_addr, res->ai_addrlen);
+    if(succ && !net.host) memcpy(&net.peer, res->ai_addr, sizeof(net.peer));
+    if(succ) succ = fcntl(net.sock, F_SETFL, O_NONBLOCK) != -1;
+    freeaddrinfo(res);
+    if(!succ) return false;
+
+    // Wait for the other instance (the joiner says hello every 100ms until the host answers)
+    Uint32 start = SDL_GetTicks(), last_hello = 0;
+    while(!net.connected && SDL_GetTicks() - start < NET_CONNECT_TIMEOUT)
+    {
+        if(!net.host && SDL_GetTicks() - last_hello >= 100)
+        {
+            sendControl(HELLO);
+            last_hello = SDL_GetTicks();
+        }
+        sendDelayed();
+        receivePackets();
+        if(window) SDL_PumpEvents();
+        SDL_Delay(1);
+    }
+
+    net.last_heard = SDL_GetTicks();
+    return net.connected;
+}
+
+/* GETTERS */
+
+// Get the guy controlled by this instance (the host is guy 0)
+int getLocalGuy(void)
+{
+    return net.local;
+}
+
+// Get the seed of the match, chosen by the host
+unsigned long long getNetSeed(void)
+{
+    return net.seed;
+}
+
+/* PER FRAME UPDATES */
+
+// Send and receive any pending packets, returning whether the other instance is still connected
+bool pollNetplay(void)
+{
+    receivePackets();
+    sendInputs();
+    sendDelayed();
+    return SDL_GetTicks() - net.last_heard < NET_TIMEOUT;
+}
+
+// Check whether this instance is running ahead of the other one, and should give up a tick to let it catch up.
+// Each instance's advantage is how far it is past the latest tick it has heard the other reach - with equal
+// latency both ways, the difference between the two advantages is twice the real difference in ticks.
+bool netplayAhead(void)
+{
+    long long advantage = net.tick - net.remote_tick;
+    if(net.tick - net.last_sync < NET_SYNC_INTERVAL || advantage - net.remote_advantage < 2) return false;
+    net.last_sync = net.tick;
+    net.syncs++;
+    return true;
+}
+
+// Simulate the next tick with this instance's input, rolling back first if a misprediction was found
+bool advanceNetplay(Uint8 input, int* mode)
+{
+    rollback(mode);
+
+    // Wait for the other instance rather than predict too far ahead (or overwrite unacknowledged inputs)
+    if(net.tick - net.received >= MAX_ROLLBACK || net.tick - net.acked >= NET_WINDOW - NET_MAX_INPUTS)
+    {
+        net.stalls++;
+        return false;
+    }
+
+    net.inputs[net.local][net.tick % NET_WINDOW] = input;
+    simulate(net.tick, mode);
+    net.tick++;
+    updateChecksums();
+    return true;
+}
+
+// Check whether the match has ended on a tick every input up to which is known, and if so take the world back
+// to just after it, returning the tick the match ends on (-1 if it hasn't ended)
+long long netplayEnd(int* mode)
+{
+    // A misprediction might move (or undo) the end, so it's only settled once every input up to it is in
+    rollback(mode);
+    if(net.ended < 0 || net.received <= net.ended) return -1;
+
+    // Any ticks simulated past the end are undone, so both instances stop on the same tick (the snapshot is
+    // still kept, since the end is no more than MAX_ROLLBACK ticks before the present)
+    long long end = net.ended + 1;
+    if(net.tick > end)
+    {
+        struct snapshot* s = &net.snapshots[end % NUM_SNAPSHOTS];
+        loadWorld(s->data, s->size, mode);
+        net.tick = end;
+    }
+    return end;
+}
+
+// Wait until both instances have every input up to the current tick, to end the match in sync
+void finishNetplay(int* mode)
+{
+    // Keep exchanging packets a little while after that, so the other instance gets our acknowledgements
+    Uint32 done = 0;
+    while(pollNetplay() && (!done || SDL_GetTicks() - done < (Uint32) (2 * net.delay + 250)))
+    {
+        rollback(mode);
+        updateChecksums();
+        if(!done && net.received >= net.tick && net.acked >= net.tick) done = SDL_GetTicks();
+        SDL_Delay(1);
+    }
+}
+
+// Print statistics about the match: rollbacks, re-simulation times, and desyncs
+void printNetStats(void)
+{
+    printf("Ticks: %lld, stalls: %lld, ticks given up to sync: %lld\n", net.tick, net.stalls, net.syncs);
+    printf("Rollbacks: %lld, ticks re-simulated: %lld (longest %d)\n", net.rollbacks, net.resimulated, net.longest_rollback);
+    printf("Rollback time: %.3f ms worst, %.3f ms average\n", net.worst_rollback_ms,
+           net.rollbacks ? net.total_rollback_ms / net.rollbacks : 0);
+    printf("Checksums compared: %lld, desyncs: %lld\n", net.checks, net.desyncs);
+
+    // The final world state, which both instances should agree on
+    size_t size = saveWorld(NULL, 0);
+    char* buf = (char*) malloc(size);
+    saveWorld(buf, 0);
+    printf("Final checksum: %08x\n", checksum(buf, size));
+    free(buf);
+}
+
+/* DATA UNLOADING */
+
+// Close the connection and free netplay data
+void stopNetplay(void)
+{
+    if(net.sock >= 0) close(net.sock);
+    for(int i = 0; i < NUM_SNAPSHOTS; i++) free(net.snapshots[i].data);
+    free(net.delayed);
+    memset(&net, 0, sizeof(struct netplay));
+}
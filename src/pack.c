@@ -0,0 +1,236 @@
+#define _POSIX_C_SOURCE 200112L
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../headers/constants.h"
+#include "../headers/pack.h"
+
+// Identifies content packs, and the version of their layout (and of the baked structs in them)
+#define PACK_MAGIC 0x4B504247 // "GBPK"
+#define PACK_VERSION 3
+
+// Written as an int, to tell whether a pack was baked on a machine of the same byte order
+#define PACK_BYTE_ORDER 0x01020304
+
+// Header at the start of a pack, which is followed by the entry table and then each entry's data
+struct pack_header
+{
+    int magic;                  // PACK_MAGIC
+    int version;                // PACK_VERSION
+    int byte_order;             // PACK_BYTE_ORDER
+    int num_entries;            // number of entries in the table
+    long long size;             // size of the whole pack in bytes
+};
+
+// Entry in the table, locating a block of baked data or an image's pixels
+struct pack_entry
+{
+    char name[PACK_NAME_LENGTH];
+    long long offset;           // where the data starts, from the start of the pack (a multiple of PACK_ALIGN)
+    long long size;             // size of the data in bytes
+    int width;                  // size of the image in pixels (0 for data)
+    int height;
+    int pitch;                  // bytes per row of pixels
+    Uint32 format;              // pixel format of the image, which its texture is made in (0 for data)
+};
+
+// The pack mapped into memory
+const char* pack = NULL;
+size_t pack_size = 0;
+const struct pack_entry* pack_entries = NULL;
+int num_pack_entries = 0;
+
+// The pack being baked, with a copy of each entry's data
+struct pack_entry* baked_entries = NULL;
+void** baked_data = NULL;
+int num_baked = 0;
+
+/* LOOKUP */
+
+// Find an entry in the pack by name
+static const struct pack_entry* findEntry(const char* name)
+{
+    for(int i = 0; i < num_pack_entries; i++)
+    {
+        if(!strcmp(pack_entries[i].name, name)) return &pack_entries[i];
+    }
+    return NULL;
+}
+
+// Find a block of baked data in the pack by name, setting size to its size in bytes (returns NULL if there's
+// no pack, or no such entry)
+const void* findPackData(const char* name, size_t* size)
+{
+    const struct pack_entry* entry = findEntry(name);
+    if(!entry || entry->format) return NULL;
+    *size = entry->size;
+    return pack + entry->offset;
+}
+
+// Make a surface of an image's pixels in the pack, which point into the mapping so nothing is copied
+// (returns NULL if there's no pack, or no such image)
+SDL_Surface* findPackImage(const char* name)
+{
+    const struct pack_entry* entry = findEntry(name);
+    if(!entry || !entry->format) return NULL;
+
+    // SDL never writes to the pixels of a surface it's just uploading from, so the mapping can be read-only
+    return SDL_CreateRGBSurfaceWithFormatFrom((void*) (pack + entry->offset), entry->width, entry->height, 32,
+                                              entry->pitch, entry->format);
+}
+
+/* DATA ALLOCATION / INITIALIZATION */
+
+// Check that a mapped pack is one this version of the game can read, and that its entries are all inside it
+static bool checkPack(const char* data, size_t size)
+{
+    const struct pack_header* header = (const struct pack_header*) data;
+    if(size < sizeof(struct pack_header)) return false;
+    if(header->magic != PACK_MAGIC || header->byte_order != PACK_BYTE_ORDER) return false;
+    if(header->version != PACK_VERSION || header->size != (long long) size || header->num_entries < 0) return false;
+    if((size - sizeof(struct pack_header)) / sizeof(struct pack_entry) < (size_t) header->num_entries) return false;
+
+    const struct pack_entry* entries = (const struct pack_entry*) (header + 1);
+    for(int i = 0; i < header->num_entries; i++)
+    {
+        const struct pack_entry* entry = &entries[i];
+        if(!memchr(entry->name, '\0', PACK_NAME_LENGTH) || entry->offset % PACK_ALIGN) return false;
+        if(entry->offset < 0 || entry->size < 0 || entry->offset + entry->size > (long long) size) return false;
+        if(entry->format && (long long) entry->pitch * entry->height > entry->size) return false;
+    }
+    return true;
+}
+
+// Map a content pack into memory, returning whether it's a pack this version of the game can read
+bool openPack(const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) return false;
+    struct stat st;
+    void* data = MAP_FAILED;
+    if(!fstat(fd, &st) && st.st_size > 0) data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) return false;
+
+    // A pack from a different version of the game is ignored (the tables in the code are used instead)
+    if(!checkPack((const char*) data, st.st_size))
+    {
+        fprintf(stderr, "Warning: %s wasn't baked by this version of the game, so it isn't used\n", path);
+        munmap(data, st.st_size);
+        return false;
+    }
+    pack = (const char*) data;
+    pack_size = st.st_size;
+    pack_entries = (const struct pack_entry*) (pack + sizeof(struct pack_header));
+    num_pack_entries = ((const struct pack_header*) pack)->num_entries;
+    return true;
+}
+
+/* BAKING */
+
+// Add an entry to the pack being baked, taking ownership of its data
+static void addEntry(const char* name, void* data, size_t size, int width, int height, int pitch, Uint32 format)
+{
+    baked_entries = (struct pack_entry*) realloc(baked_entries, sizeof(struct pack_entry) * (num_baked + 1));
+    baked_data = (void**) realloc(baked_data, sizeof(void*) * (num_baked + 1));
+    struct pack_entry* entry = &baked_entries[num_baked];
+    memset(entry, 0, sizeof(struct pack_entry));
+    strncpy(entry->name, name, PACK_NAME_LENGTH - 1);
+    entry->size = size;
+    entry->width = width;
+    entry->height = height;
+    entry->pitch = pitch;
+    entry->format = format;
+    baked_data[num_baked++] = data;
+}
+
+// Add a block of data to the pack being baked
+void bakeData(const char* name, const void* data, size_t size)
+{
+    void* copy = malloc(size);
+    memcpy(copy, data, size);
+    addEntry(name, copy, size, 0, 0, 0, 0);
+}
+
+// Add an image's pixels to the pack being baked as they are in the surface, which must already be in the
+// format its texture will use
+void bakeSurface(const char* name, SDL_Surface* surface)
+{
+    // Rows are stored back to back
+    int pitch = surface->w * 4;
+    char* pixels = (char*) malloc((size_t) pitch * surface->h);
+    for(int y = 0; y < surface->h; y++)
+    {
+        memcpy(pixels + (size_t) y * pitch, (char*) surface->pixels + (size_t) y * surface->pitch, pitch);
+    }
+    addEntry(name, pixels, (size_t) pitch * surface->h, surface->w, surface->h, pitch, surface->format->format);
+}
+
+// Add an image to the pack being baked, converted from a BMP to the format its texture will use
+void bakeImage(const char* path)
+{
+    SDL_Surface* loaded = SDL_LoadBMP(path);
+    if(!loaded)
+    {
+        fprintf(stderr, "Warning: Could not read %s, so it isn't in the pack\n", path);
+        return;
+    }
+
+    // Images with transparency keep an alpha channel, and the rest are opaque
+    Uint32 key;
+    bool alpha = loaded->format->Amask || SDL_GetColorKey(loaded, &key) == 0;
+    Uint32 format = alpha ? SDL_PIXELFORMAT_ARGB8888 : SDL_PIXELFORMAT_RGB888;
+    SDL_Surface* converted = SDL_ConvertSurfaceFormat(loaded, format, 0);
+    SDL_FreeSurface(loaded);
+    if(!converted) return;
+    bakeSurface(path, converted);
+    SDL_FreeSurface(converted);
+}
+
+// Write the pack being baked to a file, returning whether it was written successfully
+bool writePack(const char* path)
+{
+    // Lay the data out after the entry table, each block aligned
+    long long offset = sizeof(struct pack_header) + sizeof(struct pack_entry) * num_baked;
+    for(int i = 0; i < num_baked; i++)
+    {
+        offset = (offset + PACK_ALIGN - 1) / PACK_ALIGN * PACK_ALIGN;
+        baked_entries[i].offset = offset;
+        offset += baked_entries[i].size;
+    }
+    struct pack_header header = { PACK_MAGIC, PACK_VERSION, PACK_BYTE_ORDER, num_baked, offset };
+
+    FILE* f = fopen(path, "wb");
+    if(!f) return false;
+    bool succ = fwrite(&header, sizeof(struct pack_header), 1, f) == 1;
+    succ = succ && fwrite(baked_entries, sizeof(struct pack_entry), num_baked, f) == (size_t) num_baked;
+    static const char padding[PACK_ALIGN];
+    for(int i = 0; i < num_baked && succ; i++)
+    {
+        size_t pad = baked_entries[i].offset - ftell(f);
+        succ = fwrite(padding, 1, pad, f) == pad;
+        succ = succ && fwrite(baked_data[i], 1, baked_entries[i].size, f) == (size_t) baked_entries[i].size;
+    }
+    succ = fclose(f) == 0 && succ;
+    return succ;
+}
+
+/* DATA UNLOADING */
+
+// Unmap the pack, and free the pack being baked
+void closePack(void)
+{
+    if(pack) munmap((void*) pack, pack_size);
+    pack = NULL;
+    pack_entries = NULL;
+    num_pack_entries = 0;
+
+    for(int i = 0; i < num_baked; i++) free(baked_data[i]);
+    free(baked_data);
+    free(baked_entries);
+    baked_data = NULL;
+    baked_entries = NULL;
+    num_baked = 0;
+}
@@ -0,0 +1,68 @@
+#include "../headers/constants.h"
+#include "../headers/profiler.h"
+
+// A timed zone of code
+struct zone
+{
+    const char* name;           // name of the zone
+    Uint64 start;               // performance counter when the zone started
+    Uint64 end;                 // performance counter when the zone ended
+    SDL_threadID thread;        // thread the zone ran on
+};
+
+bool profiling = false;                 // Profiling is off by default
+struct zone ring[PROFILE_RING_SIZE];    // The most recent zones
+SDL_atomic_t ring_next;                 // Total number of zones ever recorded (the next slot, modulo the ring size)
+Uint64 profile_origin = 0;              // Performance counter when profiling was first switched on
+
+/* SETTERS */
+
+// Switch profiling on or off
+void setProfiling(bool on)
+{
+    if(on && !profile_origin) profile_origin = SDL_GetPerformanceCounter();
+    profiling = on;
+}
+
+/* RECORDING */
+
+// Finish timing a zone that started at start, recording it in the ring buffer
+Uint64 endZone(const char* name, Uint64 start)
+{
+    // Zones that started while profiling was off aren't recorded
+    if(start == 1 || !profiling) return 0;
+
+    // Claim a slot atomically, so zones can be recorded from any thread without locking
+    int slot = SDL_AtomicAdd(&ring_next, 1) & (PROFILE_RING_SIZE - 1);
+    ring[slot] = (struct zone) { name, start, SDL_GetPerformanceCounter(), SDL_ThreadID() };
+    return 0;
+}
+
+/* EXPORT */
+
+// Write the zones in the ring buffer to a file as Chrome trace-event JSON, returning whether it was written
+bool exportProfile(const char* path)
+{
+    // Nothing to export if profiling was never switched on
+    if(!profile_origin) return true;
+
+    FILE* f = fopen(path, "w");
+    if(!f) return false;
+
+    // The ring holds the last PROFILE_RING_SIZE zones, oldest first from the next slot to be written
+    unsigned int total = SDL_AtomicGet(&ring_next);
+    unsigned int count = total < PROFILE_RING_SIZE ? total : PROFILE_RING_SIZE;
+    double us_per_count = 1000000.0 / SDL_GetPerformanceFrequency();
+
+    // Each zone is a complete event ("X") with its start and duration in microseconds
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for(unsigned int i = 0; i < count; i++)
+    {
+        struct zone* z = &ring[(total - count + i) & (PROFILE_RING_SIZE - 1)];
+        fprintf(f, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f}%s\n",
+                z->name, (unsigned long) z->thread, (z->start - profile_origin) * us_per_count,
+                (z->end - z->start) * us_per_count, i + 1 < count ? "," : "");
+    }
+    fprintf(f, "]}\n");
+    return fclose(f) == 0;
+}
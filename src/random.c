@@ -0,0 +1,23 @@
+#include "../headers/constants.h"
+#include "../headers/random.h"
+
+// Seed a stream, expanding the seed into a full state with splitmix64
+void seedRng(Rng* rng, uint64_t seed)
+{
+    for(int i = 0; i < 4; i++)
+    {
+        uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        rng->s[i] = z ^ (z >> 31);
+    }
+}
+
+// Fill an array with n random numbers in [0, 1), for spawning bursts of particles
+void fillRand(Rng* rng, double* out, int n)
+{
+    // Work on a local copy of the state so it can stay in registers for the whole burst
+    Rng local = *rng;
+    for(int i = 0; i < n; i++) out[i] = nextRand(&local);
+    *rng = local;
+}
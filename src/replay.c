@@ -0,0 +1,303 @@
+#include "../headers/constants.h"
+#include "../headers/sprite.h"
+#include "../headers/level.h"
+#include "../headers/interface.h"
+#include "../headers/replay.h"
+
+// Identifies replay files, and the version of their layout
+#define REPLAY_MAGIC 0x50524247 // "GBRP"
+#define REPLAY_VERSION 3
+
+// Header at the start of a replay file, which is followed by the inputs (two per tick),
+// the keyframe index, and the keyframes' world states, in that order
+struct replay_header
+{
+    int magic;                  // REPLAY_MAGIC
+    int version;                // REPLAY_VERSION
+    unsigned long long seed;    // seed of the match's random streams
+    int mode;                   // mode the match was played in (VS or AI)
+    int demo;                   // were both guys controlled by the CPU
+    int debug;                  // was the match played in debug mode (which disables cooldowns)
+    int num_keyframes;          // number of entries in the keyframe index
+    long long num_ticks;        // number of recorded ticks
+    long long data_size;        // total size in bytes of the keyframes' world states
+};
+
+// Entry in the keyframe index
+struct keyframe
+{
+    long long tick;             // tick the keyframe was taken before
+    long long offset;           // where the keyframe's world state starts in the keyframe data
+};
+
+// Struct for the replay being recorded or played back
+struct replay
+{
+    struct replay_header header;
+    bool recording;             // is a match being recorded
+    Uint8* inputs;              // inputs of both guys on every tick
+    long long input_capacity;   // number of ticks the inputs array has room for
+    struct keyframe* keyframes; // index of the keyframes, in order of tick
+    int keyframe_capacity;      // number of keyframes the index has room for
+    char* data;                 // world states of the keyframes, stored back to back
+    long long data_capacity;    // number of bytes the keyframe data has room for
+};
+
+struct replay replay; // The replay being recorded or played back
+
+/* WORLD STATE */
+
+// Save the whole world state - the mode and score, followed by the level and sprite states - to buf,
+// returning its size in bytes (if buf is NULL, just return the size)
+size_t saveWorld(char* buf, int mode)
+{
+    size_t n = sizeof(int) * 2;
+    if(buf)
+    {
+        int score = getScore();
+        memcpy(buf, &mode, sizeof(int));
+        memcpy(buf + sizeof(int), &score, sizeof(int));
+    }
+    n += saveLevelState(buf ? buf + n : NULL);
+    n += saveSprites(buf ? buf + n : NULL);
+    return n;
+}
+
+// Restore the whole world state from the size bytes at buf, returning the number of bytes read (0 if the state
+// is invalid, in which case the world is left partly restored and shouldn't be simulated)
+size_t loadWorld(const char* buf, size_t size, int* mode)
+{
+    size_t n = sizeof(int) * 2;
+    if(size < n + saveLevelState(NULL)) return 0;
+
+    int score;
+    memcpy(mode, buf, sizeof(int));
+    memcpy(&score, buf + sizeof(int), sizeof(int));
+    setScore(score);
+    size_t level_size = loadLevelState(buf + n);
+    if(!level_size) return 0;
+    n += level_size;
+    size_t sprites_size = loadSprites(buf + n, size - n);
+    if(!sprites_size) return 0;
+    return n + sprites_size;
+}
+
+/* RECORDING */
+
+// Start recording a new match, which is in the given mode and seeded with the given seed
+void startRecording(int mode, bool demo, unsigned long long seed)
+{
+    freeReplay();
+    replay.recording = true;
+    replay.header.magic = REPLAY_MAGIC;
+    replay.header.version = REPLAY_VERSION;
+    replay.header.seed = seed;
+    replay.header.mode = mode;
+    replay.header.demo = demo;
+    replay.header.debug = debug;
+}
+
+// Append a keyframe of the current world state to the replay
+static void takeKeyframe(int mode)
+{
+    // Grow the index and the data to fit the new keyframe
+    struct replay_header* h = &replay.header;
+    if(h->num_keyframes == replay.keyframe_capacity)
+    {
+        replay.keyframe_capacity = replay.keyframe_capacity ? replay.keyframe_capacity * 2 : 64;
+        replay.keyframes = (struct keyframe*) realloc(replay.keyframes, sizeof(struct keyframe) * replay.keyframe_capacity);
+    }
+    long long size = saveWorld(NULL, mode);
+    while(h->data_size + size > replay.data_capacity)
+    {
+        replay.data_capacity = replay.data_capacity ? replay.data_capacity * 2 : 1 << 16;
+        replay.data = (char*) realloc(replay.data, replay.data_capacity);
+    }
+
+    saveWorld(replay.data + h->data_size, mode);
+    replay.keyframes[h->num_keyframes++] = (struct keyframe) { h->num_ticks, h->data_size };
+    h->data_size += size;
+}
+
+// Record the inputs of both guys for the next tick, taking a keyframe first if one is due
+void recordTick(int mode, const Uint8* inputs)
+{
+    struct replay_header* h = &replay.header;
+    if(h->num_ticks % KEYFRAME_INTERVAL == 0) takeKeyframe(mode);
+
+    if(h->num_ticks == replay.input_capacity)
+    {
+        replay.input_capacity = replay.input_capacity ? replay.input_capacity * 2 : 1 << 12;
+        replay.inputs = (Uint8*) realloc(replay.inputs, 2 * replay.input_capacity);
+    }
+    replay.inputs[2 * h->num_ticks] = inputs[0];
+    replay.inputs[2 * h->num_ticks + 1] = inputs[1];
+    h->num_ticks++;
+}
+
+// Check whether a match is being recorded
+bool isRecording(void)
+{
+    return replay.recording;
+}
+
+// Stop recording and write the replay to a file, returning whether it was written successfully
+bool stopRecording(const char* path)
+{
+    FILE* f = fopen(path, "wb");
+    bool succ = f != NULL;
+    if(succ)
+    {
+        struct replay_header* h = &replay.header;
+        succ = fwrite(h, sizeof(struct replay_header), 1, f) == 1;
+        succ = succ && fwrite(replay.inputs, 2, h->num_ticks, f) == (size_t) h->num_ticks;
+        succ = succ && fwrite(replay.keyframes, sizeof(struct keyframe), h->num_keyframes, f) == (size_t) h->num_keyframes;
+        succ = succ && fwrite(replay.data, 1, h->data_size, f) == (size_t) h->data_size;
+        succ = (fclose(f) == 0) && succ;
+    }
+    freeReplay();
+    return succ;
+}
+
+/* PLAYBACK */
+
+// Check that the loaded replay's keyframe index is in order and points inside the replay - the first keyframe
+// is at tick 0, and the ticks and offsets strictly increase from there
+static bool checkKeyframes(void)
+{
+    struct replay_header* h = &replay.header;
+    for(int k = 0; k < h->num_keyframes; k++)
+    {
+        struct keyframe kf = replay.keyframes[k];
+        if(kf.offset < 0 || kf.offset >= h->data_size || kf.tick < 0 || kf.tick > h->num_ticks) return false;
+        if(k == 0 && kf.tick != 0) return false;
+        if(k > 0 && (kf.tick <= replay.keyframes[k - 1].tick || kf.offset <= replay.keyframes[k - 1].offset)) return false;
+    }
+    return true;
+}
+
+// Load a replay from a file for playback, returning whether it was read successfully
+bool loadReplay(const char* path)
+{
+    freeReplay();
+    FILE* f = fopen(path, "rb");
+    if(!f) return false;
+
+    // Measure the file, since the header's sizes have to add up to it
+    bool succ = fseek(f, 0, SEEK_END) == 0;
+    long long file_size = succ ? ftell(f) : -1;
+    succ = succ && file_size >= 0 && fseek(f, 0, SEEK_SET) == 0;
+
+    // Check that this is a replay file this version of the game can play
+    struct replay_header* h = &replay.header;
+    succ = succ && fread(h, sizeof(struct replay_header), 1, f) == 1;
+    succ = succ && h->magic == REPLAY_MAGIC && h->version == REPLAY_VERSION;
+    succ = succ && h->num_ticks >= 0 && h->num_keyframes > 0 && h->data_size > 0;
+
+    // Every part must fit in the file (checked one by one first so the total can't overflow), which bounds
+    // each allocation by the file's size
+    succ = succ && h->num_ticks <= file_size / 2 && h->data_size <= file_size;
+    succ = succ && h->num_keyframes <= file_size / (long long) sizeof(struct keyframe);
+    succ = succ && (long long) sizeof(struct replay_header) + 2 * h->num_ticks
+                   + (long long) sizeof(struct keyframe) * h->num_keyframes + h->data_size == file_size;
+
+    // Read the inputs, keyframe index, and keyframes
+    if(succ)
+    {
+        replay.inputs = (Uint8*) malloc(2 * h->num_ticks + 2);
+        replay.keyframes = (struct keyframe*) malloc(sizeof(struct keyframe) * h->num_keyframes);
+        replay.data = (char*) malloc(h->data_size);
+        succ = replay.inputs && replay.keyframes && replay.data;
+        succ = succ && fread(replay.inputs, 2, h->num_ticks, f) == (size_t) h->num_ticks;
+        succ = succ && fread(replay.keyframes, sizeof(struct keyframe), h->num_keyframes, f) == (size_t) h->num_keyframes;
+        succ = succ && fread(replay.data, 1, h->data_size, f) == (size_t) h->data_size;
+        succ = succ && checkKeyframes();
+    }
+    fclose(f);
+    if(!succ) freeReplay();
+    return succ;
+}
+
+// Get the number of ticks in the loaded replay
+long long getReplayLength(void)
+{
+    return replay.header.num_ticks;
+}
+
+// Get the seed of the match in the loaded replay
+unsigned long long getReplaySeed(void)
+{
+    return replay.header.seed;
+}
+
+// Check whether both guys were controlled by the CPU in the loaded replay
+bool getReplayDemo(void)
+{
+    return replay.header.demo;
+}
+
+// Get the inputs of both guys for a tick of the loaded replay
+void getReplayInputs(long long tick, Uint8* inputs)
+{
+    inputs[0] = replay.inputs[2 * tick];
+    inputs[1] = replay.inputs[2 * tick + 1];
+}
+
+// Find the index of the last keyframe at or before a tick
+static int findKeyframe(long long tick)
+{
+    int lo = 0, hi = replay.header.num_keyframes - 1;
+    while(lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        if(replay.keyframes[mid].tick <= tick) lo = mid;
+        else hi = mid - 1;
+    }
+    return lo;
+}
+
+// Check whether the world matches the loaded replay's keyframe at a tick (true if there's no keyframe there)
+bool matchesKeyframe(long long tick, int mode)
+{
+    int k = findKeyframe(tick);
+    if(replay.keyframes[k].tick != tick) return true;
+
+    // The keyframe runs until the next one starts, or to the end of the data
+    long long end = k + 1 < replay.header.num_keyframes ? replay.keyframes[k + 1].offset : replay.header.data_size;
+    long long size = saveWorld(NULL, mode);
+    if(size != end - replay.keyframes[k].offset) return false;
+
+    char* buf = (char*) malloc(size);
+    saveWorld(buf, mode);
+    bool same = !memcmp(buf, replay.data + replay.keyframes[k].offset, size);
+    free(buf);
+    return same;
+}
+
+// Restore the world to the nearest keyframe at or before a tick, returning the keyframe's tick (-1 if the
+// keyframe's world state is invalid)
+long long restoreKeyframe(long long tick, int* mode)
+{
+    int k = findKeyframe(tick);
+    long long end = k + 1 < replay.header.num_keyframes ? replay.keyframes[k + 1].offset : replay.header.data_size;
+
+    // Restore the world (the match may have been played in debug mode, in which there are no cooldowns)
+    if(!loadWorld(replay.data + replay.keyframes[k].offset, end - replay.keyframes[k].offset, mode))
+    {
+        fprintf(stderr, "Error: Replay keyframe at tick %lld is invalid\n", replay.keyframes[k].tick);
+        return -1;
+    }
+    debug = replay.header.debug;
+    return replay.keyframes[k].tick;
+}
+
+/* DATA UNLOADING */
+
+// Free the replay being recorded or played back
+void freeReplay(void)
+{
+    free(replay.inputs);
+    free(replay.keyframes);
+    free(replay.data);
+    memset(&replay, 0, sizeof(struct replay));
+}
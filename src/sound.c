@@ -1,12 +1,251 @@
 #include "../headers/constants.h"
 #include "../headers/sound.h"
+#include "../headers/level.h"
+#include "../headers/music.h"
+#include "../headers/loader.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Struct for a sound effect's samples (mono, at the audio device's sample rate)
+typedef struct sound
+{
+    float* samples;             // samples in [-1, 1]
+    int length;                 // number of samples
+    int priority;               // sounds of higher priority steal voices from those of lower priority
+}* Sound;
+
+// How to make a sound effect: loaded from a WAV file, or else synthesized as a tone gliding between two
+// pitches (a square wave if buzz is set) mixed with noise, under an envelope which decays at the given rate
+typedef struct sound_recipe
+{
+    const char* path;           // WAV file to load (NULL to synthesize the sound)
+    int priority;
+    double seconds;
+    double from_hz;
+    double to_hz;
+    bool buzz;
+    double noise;               // how much of the sound is noise, in [0, 1]
+    double decay;               // rate the envelope decays at, per second
+} SoundRecipe;
+
+// Struct for a voice of the mixer, which plays one sound effect at a time
+typedef struct voice
+{
+    Sound sound;                // sound being played (NULL if the voice is free)
+    int position;               // next sample of the sound to be mixed
+    float gain_left;            // volume of the sound in each ear
+    float gain_right;
+    Uint32 started;             // when the sound started, in sounds started, for stealing the oldest
+    Uint64 queued;              // performance counter when the sound was played, for measuring latency
+} Voice;
 
 // Audio is not muted by default
 bool mute = false;
 
-// Declaring audio elements
-Mix_Music* main_theme;
-Mix_Chunk** sfx_list;
+// Declaring audio elements (the music is streamed, see music.h)
+Sound* sfx_list;
+
+// How each sound effect is made, in the order of the sound effect list
+const SoundRecipe sfx_recipes[NUM_SOUND_EFFECTS] =
+{
+    // Menu navigation noises
+    { "sound/effects/hover.wav", 2, 0, 0, 0, false, 0, 0 },
+    { "sound/effects/select.wav", 2, 0, 0, 0, false, 0, 0 },
+    { "sound/effects/back.wav", 2, 0, 0, 0, false, 0, 0 },
+
+    // Spell launches
+    { NULL, 1, 0.35, 320, 140, false, 0.6, 8 },
+    { NULL, 1, 0.40, 1400, 2400, false, 0.1, 7 },
+    { NULL, 1, 0.50, 110, 60, true, 0.5, 5 },
+    { NULL, 1, 0.35, 240, 110, true, 0.2, 8 },
+    { NULL, 1, 0.30, 900, 1800, true, 0.4, 10 },
+
+    // Spell collisions
+    { NULL, 0, 0.25, 180, 60, false, 0.8, 14 },
+    { NULL, 0, 0.20, 2600, 1200, false, 0.5, 18 },
+    { NULL, 0, 0.30, 80, 40, true, 0.8, 12 },
+    { NULL, 0, 0.20, 160, 80, true, 0.5, 16 },
+    { NULL, 0, 0.15, 2000, 600, true, 0.7, 24 }
+};
+
+bool mixer_ready = false;            // whether the mixer is hooked into SDL_mixer's output
+bool suppressed = false;             // whether sound effects are currently kept from starting
+int sample_rate = SAMPLE_RATE;       // sample rate the audio device was opened with
+Voice voices[MAX_VOICES];            // the mixer's voices (only touched with the audio device locked)
+Uint32 sounds_started = 0;           // number of sounds started on the mixer's voices
+float mix_buffer[MIX_BLOCK * 2];     // block being mixed, in interleaved stereo (audio thread only)
+
+// Low-latency mode, and what's been measured of the device (only touched with the audio device locked)
+bool low_latency = false;            // whether the buffer starts small and grows on underruns
+int chunk_size = CHUNK_SIZE;         // frames per buffer the device was opened with
+Uint64 last_callback = 0;            // performance counter at the last mixer callback (0 if none yet)
+Uint64 count_underruns_from = 0;     // performance counter once the device has settled after opening
+int underruns = 0;                   // times a callback arrived too late for the device to stay fed
+double latency_total = 0;            // sum of each sound effect's latency, in milliseconds
+int latency_count = 0;               // sound effects measured
+double worst_latency = 0;            // longest latency measured, in milliseconds
+int resizes = 0;                     // times the buffer has grown
+
+// Underruns counted in the current window (main thread only)
+Uint32 window_start = 0;
+int window_underruns = 0;
+
+/* MIXING */
+
+// Add a block of mono samples into the stereo mix, scaled by the gain for each ear
+static void mixMono(float* restrict mix, const float* restrict samples, int n, float left, float right)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    // Four samples at a time, interleaved into two vectors of left/right pairs
+    __m128 l = _mm_set1_ps(left), r = _mm_set1_ps(right);
+    for(; i + 4 <= n; i += 4)
+    {
+        __m128 s = _mm_loadu_ps(samples + i);
+        __m128 sl = _mm_mul_ps(s, l), sr = _mm_mul_ps(s, r);
+        _mm_storeu_ps(mix + 2 * i, _mm_add_ps(_mm_loadu_ps(mix + 2 * i), _mm_unpacklo_ps(sl, sr)));
+        _mm_storeu_ps(mix + 2 * i + 4, _mm_add_ps(_mm_loadu_ps(mix + 2 * i + 4), _mm_unpackhi_ps(sl, sr)));
+    }
+#elif defined(__ARM_NEON)
+    // Four samples at a time, with the mix de-interleaved into left and right on load and store
+    for(; i + 4 <= n; i += 4)
+    {
+        float32x4_t s = vld1q_f32(samples + i);
+        float32x4x2_t m = vld2q_f32(mix + 2 * i);
+        m.val[0] = vmlaq_n_f32(m.val[0], s, left);
+        m.val[1] = vmlaq_n_f32(m.val[1], s, right);
+        vst2q_f32(mix + 2 * i, m);
+    }
+#endif
+    for(; i < n; i++)
+    {
+        mix[2 * i] += samples[i] * left;
+        mix[2 * i + 1] += samples[i] * right;
+    }
+}
+
+// Add the mix to the 16-bit stream SDL_mixer has already filled with music, saturating rather than wrapping
+static void addToStream(Sint16* restrict stream, const float* restrict mix, int n)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    // Eight samples at a time, summed in 32 bits and saturated when packed back to 16
+    __m128 scale = _mm_set1_ps(32767.0f);
+    for(; i + 8 <= n; i += 8)
+    {
+        __m128i s = _mm_loadu_si128((const __m128i*) (stream + i));
+        __m128i a = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(mix + i), scale));
+        __m128i b = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(mix + i + 4), scale));
+        a = _mm_add_epi32(a, _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+        b = _mm_add_epi32(b, _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16));
+        _mm_storeu_si128((__m128i*) (stream + i), _mm_packs_epi32(a, b));
+    }
+#elif defined(__ARM_NEON)
+    // Eight samples at a time, summed in 32 bits and saturated when narrowed back to 16
+    for(; i + 8 <= n; i += 8)
+    {
+        int16x8_t s = vld1q_s16(stream + i);
+        int32x4_t a = vcvtq_s32_f32(vmulq_n_f32(vld1q_f32(mix + i), 32767.0f));
+        int32x4_t b = vcvtq_s32_f32(vmulq_n_f32(vld1q_f32(mix + i + 4), 32767.0f));
+        a = vaddq_s32(a, vmovl_s16(vget_low_s16(s)));
+        b = vaddq_s32(b, vmovl_s16(vget_high_s16(s)));
+        vst1q_s16(stream + i, vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+    }
+#endif
+    for(; i < n; i++)
+    {
+        int sample = stream[i] + (int) (mix[i] * 32767.0f);
+        stream[i] = sample > 32767 ? 32767 : (sample < -32768 ? -32768 : sample);
+    }
+}
+
+// Mix every playing voice into SDL_mixer's output (runs on the audio thread, with the device locked)
+static void mixVoices(void* data, Uint8* stream, int len)
+{
+    Sint16* out = (Sint16*) stream;
+    int frames = len / (int) (NUM_CHANNELS * sizeof(Sint16));
+
+    // Callbacks should come once per buffer - one that comes more than two buffers after the last
+    // means the device had nothing left to play
+    Uint64 now = SDL_GetPerformanceCounter();
+    double frequency = SDL_GetPerformanceFrequency();
+    double buffer_ms = frames * 1000.0 / sample_rate;
+    if(last_callback && now > count_underruns_from && (now - last_callback) * 1000.0 / frequency > 2 * buffer_ms)
+    {
+        underruns++;
+    }
+    last_callback = now;
+
+    for(int start = 0; start < frames; start += MIX_BLOCK)
+    {
+        // Mix a block's worth of each voice, freeing voices which finish
+        int block = fmin(MIX_BLOCK, frames - start);
+        memset(mix_buffer, 0, sizeof(float) * 2 * block);
+        bool any = false;
+        for(int v = 0; v < MAX_VOICES; v++)
+        {
+            Voice* voice = &voices[v];
+            if(!voice->sound) continue;
+
+            // A sound is heard once this buffer has played out of the device, after the one ahead of it
+            if(voice->position == 0)
+            {
+                double latency = (now - voice->queued) * 1000.0 / frequency + start * 1000.0 / sample_rate
+                               + buffer_ms;
+                latency_total += latency;
+                latency_count++;
+                worst_latency = fmax(worst_latency, latency);
+            }
+            int n = fmin(block, voice->sound->length - voice->position);
+            mixMono(mix_buffer, voice->sound->samples + voice->position, n, voice->gain_left, voice->gain_right);
+            voice->position += n;
+            if(voice->position == voice->sound->length) voice->sound = NULL;
+            any = true;
+        }
+        if(any) addToStream(out + 2 * start, mix_buffer, 2 * block);
+    }
+}
+
+// Start a sound effect on a voice, stealing one if they're all busy
+static void startVoice(int sfx_id, float left, float right)
+{
+    if(mute || suppressed || !mixer_ready) return;
+
+    // Sounds which are still loading are skipped
+    Sound sound = sfx_list[sfx_id];
+    if(!sound) return;
+    SDL_LockAudio();
+
+    // Use a free voice, or else the oldest voice playing the least important sound
+    Voice* chosen = NULL;
+    for(int v = 0; v < MAX_VOICES && !(chosen && !chosen->sound); v++)
+    {
+        Voice* voice = &voices[v];
+        if(!chosen || !voice->sound || voice->sound->priority < chosen->sound->priority
+        || (voice->sound->priority == chosen->sound->priority && voice->started < chosen->started))
+        {
+            chosen = voice;
+        }
+    }
+
+    // Sounds are never cut off for something less important
+    if(!chosen->sound || chosen->sound->priority <= sound->priority)
+    {
+        chosen->sound = sound;
+        chosen->position = 0;
+        chosen->gain_left = left;
+        chosen->gain_right = right;
+        chosen->started = sounds_started++;
+        chosen->queued = SDL_GetPerformanceCounter();
+    }
+    SDL_UnlockAudio();
+}
+
+/* SETTERS */
 
 // Mute all audio
 void setMute(void)
@@ -14,51 +253,230 @@ void setMute(void)
     mute = true;
 }
 
+// Stop sound effects from starting while set (for re-simulating ticks which were already heard)
+void suppressSoundEffects(bool suppress)
+{
+    suppressed = suppress;
+}
+
+// Open the audio device with a small buffer, which grows if the machine can't keep it filled
+void setLowLatency(void)
+{
+    low_latency = true;
+}
+
 // Start the game's main theme
 void startMusic(void)
 {
-    if(!mute) Mix_PlayMusic(main_theme, -1);
+    if(!mute) playMusic();
 }
 
 // Play a sound effect
 void playSoundEffect(int sfx_id)
 {
-    if(!mute)
+    startVoice(sfx_id, 1, 1);
+}
+
+// Play a sound effect which happens at an x-coord in the level, panned by where it is relative to the view
+void playSoundEffectAt(int sfx_id, double x)
+{
+    // Pan from hard left at the view's left edge to hard right at its right edge
+    SDL_Rect view = getView();
+    double half_width = view.w / 2.0;
+    double offset = x - (view.x + half_width);
+    double pan = fmax(-1, fmin(1, offset / half_width));
+
+    // Sounds fade as they get further out of view
+    double gain = 1 / (1 + 4 * fmax(0, fabs(offset) - half_width) / view.w);
+    startVoice(sfx_id, gain * fmin(1, 1 - pan), gain * fmin(1, 1 + pan));
+}
+
+/* PER FRAME UPDATES */
+
+// Open the audio device with a buffer of the given size (returns whether it's 16-bit stereo, which we can mix)
+static bool openDevice(int frames)
+{
+    if(Mix_OpenAudio(SAMPLE_RATE, MIX_DEFAULT_FORMAT, NUM_CHANNELS, frames) < 0) return false;
+    chunk_size = frames;
+    last_callback = 0;
+    count_underruns_from = SDL_GetPerformanceCounter() + SDL_GetPerformanceFrequency() * UNDERRUN_GRACE / 1000;
+
+    int channels = 0;
+    Uint16 format = 0;
+    Mix_QuerySpec(&sample_rate, &format, &channels);
+    if(sample_rate <= 0) sample_rate = SAMPLE_RATE;
+    return format == AUDIO_S16SYS && channels == NUM_CHANNELS;
+}
+
+// Grow the audio buffer if it keeps running dry (in low-latency mode, once per frame)
+void updateAudio(void)
+{
+    if(!low_latency || !mixer_ready) return;
+    SDL_LockAudio();
+    int total = underruns;
+    SDL_UnlockAudio();
+
+    // Count underruns over a sliding window, so the odd hitch doesn't cost latency for good
+    Uint32 now = SDL_GetTicks();
+    if(now - window_start >= UNDERRUN_WINDOW)
+    {
+        window_start = now;
+        window_underruns = total;
+    }
+    if(total - window_underruns < UNDERRUN_LIMIT || chunk_size >= CHUNK_SIZE) return;
+
+    // Reopen the device with twice the buffer, and hook the mixer and music back in - voices carry
+    // on where they were, and the music picks up from its ring buffer
+    int old_rate = sample_rate;
+    Mix_HookMusic(NULL, NULL);
+    Mix_SetPostMix(NULL, NULL);
+    Mix_CloseAudio();
+    if(!openDevice(chunk_size * 2) || sample_rate != old_rate)
     {
-        int ch = Mix_PlayChannel(-1, sfx_list[sfx_id], 0);
-	    Mix_ExpireChannel(ch, 1000);
+        fprintf(stderr, "Warning: Could not reopen the audio device with a larger buffer\n");
+        mixer_ready = false;
+        return;
     }
+    Mix_SetPostMix(mixVoices, NULL);
+    resumeMusic();
+    resizes++;
+    window_start = now;
+    window_underruns = total;
+}
+
+/* GETTERS */
+
+// Get the audio device's measured latency and underruns
+AudioStats getAudioStats(void)
+{
+    AudioStats stats;
+    stats.music_underruns = getMusicUnderruns();
+    SDL_LockAudio();
+    stats.chunk_size = chunk_size;
+    stats.buffer_ms = chunk_size * 1000.0 / sample_rate;
+    stats.average_latency = latency_count ? latency_total / latency_count : 0;
+    stats.worst_latency = worst_latency;
+    stats.underruns = underruns;
+    stats.resizes = resizes;
+    SDL_UnlockAudio();
+    return stats;
+}
+
+// Print the audio device's measured latency and underruns (in low-latency mode)
+void printAudioStats(void)
+{
+    if(!low_latency) return;
+    AudioStats stats = getAudioStats();
+    printf("Audio buffer: %d frames (%.1f ms), grown %d times\n", stats.chunk_size, stats.buffer_ms, stats.resizes);
+    printf("Sound effect latency: %.1f ms average, %.1f ms worst\n", stats.average_latency, stats.worst_latency);
+    printf("Underruns: %d (music decoder: %d)\n", stats.underruns, stats.music_underruns);
+}
+
+/* DATA ALLOCATION / INITIALIZATION */
+
+// Convert a sound loaded by SDL_mixer (16-bit stereo, at the device's sample rate) to a mono sound effect
+static Sound convertChunk(Mix_Chunk* chunk, int priority)
+{
+    Sound this_sound = (Sound) malloc(sizeof(struct sound));
+    this_sound->priority = priority;
+    this_sound->length = chunk ? chunk->alen / (NUM_CHANNELS * sizeof(Sint16)) : 0;
+    this_sound->samples = (float*) malloc(sizeof(float) * (this_sound->length + 1));
+    Sint16* pcm = chunk ? (Sint16*) chunk->abuf : NULL;
+    for(int i = 0; i < this_sound->length; i++)
+    {
+        this_sound->samples[i] = (pcm[2 * i] + pcm[2 * i + 1]) / 65536.0f;
+    }
+    if(chunk) Mix_FreeChunk(chunk);
+    return this_sound;
+}
+
+// Synthesize a sound effect from its recipe
+static Sound synthesize(const SoundRecipe* recipe)
+{
+    double seconds = recipe->seconds, from_hz = recipe->from_hz, to_hz = recipe->to_hz;
+    Sound this_sound = (Sound) malloc(sizeof(struct sound));
+    this_sound->priority = recipe->priority;
+    this_sound->length = seconds * sample_rate;
+    this_sound->samples = (float*) malloc(sizeof(float) * this_sound->length);
+
+    Uint32 seed = 0x1234567u + (Uint32) from_hz;
+    double phase = 0, rumble = 0;
+    for(int i = 0; i < this_sound->length; i++)
+    {
+        // Glide the pitch exponentially from start to end
+        double t = (double) i / sample_rate;
+        double hz = from_hz * pow(to_hz / from_hz, t / seconds);
+        phase += hz / sample_rate;
+        phase -= floor(phase);
+        double tone = recipe->buzz ? (phase < 0.5 ? 0.6 : -0.6) : sin(phase * 6.2831853);
+
+        // Low-passed white noise (from its own generator, so the game's random streams are untouched)
+        seed = seed * 1664525u + 1013904223u;
+        rumble += ((seed >> 8) / 8388608.0 - 1 - rumble) * 0.3;
+
+        // Fade in over a few milliseconds to avoid a click, then decay
+        double envelope = fmin(1, t / 0.004) * exp(-recipe->decay * t);
+        this_sound->samples[i] = 0.35 * envelope * ((1 - recipe->noise) * tone + recipe->noise * rumble);
+    }
+    return this_sound;
+}
+
+// Make a sound effect from its recipe (runs on a loader thread)
+static void* makeSound(const void* input)
+{
+    const SoundRecipe* recipe = (const SoundRecipe*) input;
+    if(recipe->path) return convertChunk(Mix_LoadWAV(recipe->path), recipe->priority);
+    return synthesize(recipe);
+}
+
+// Put a sound effect which has been made in the sound effect list
+static void storeSound(void* sound, void* target)
+{
+    *(Sound*) target = (Sound) sound;
 }
 
 // Load audio elements into memory
 void loadSound(void)
 {
-    // Initialize audio
-    Mix_OpenAudio(SAMPLE_RATE, MIX_DEFAULT_FORMAT, NUM_CHANNELS, CHUNK_SIZE);
+    // Initialize audio. Sound effects and music are mixed by us, which needs the device to be 16-bit stereo
+    bool s16_stereo = openDevice(low_latency ? LOW_LATENCY_CHUNK : CHUNK_SIZE);
 
-    // Load music and set volume
-    main_theme = Mix_LoadMUS("sound/music/twilight_of_the_guys.wav");
-    Mix_VolumeMusic(100);
+    // Open the music for streaming (it's read and decoded a block at a time once it starts)
+    if(s16_stereo && !openMusic("sound/music/twilight_of_the_guys.wav", sample_rate))
+    {
+        fprintf(stderr, "Warning: Could not open the music for streaming\n");
+    }
 
-    // Make space for sound effect list
-    sfx_list = (Mix_Chunk**) malloc(sizeof(Mix_Chunk*) * NUM_SOUND_EFFECTS);
+    // Make space for sound effect list, and load or synthesize every sound effect on the loader threads
+    // (each one can be played as soon as it's ready)
+    sfx_list = (Sound*) calloc(NUM_SOUND_EFFECTS, sizeof(Sound));
+    for(int i = 0; i < NUM_SOUND_EFFECTS; i++) queueLoad(makeSound, &sfx_recipes[i], storeSound, &sfx_list[i]);
 
-    // Menu navigation noises
-    sfx_list[SFX_HOVER] = Mix_LoadWAV("sound/effects/hover.wav");
-    sfx_list[SFX_SELECT] = Mix_LoadWAV("sound/effects/select.wav");
-    sfx_list[SFX_BACK] = Mix_LoadWAV("sound/effects/back.wav");
+    // Hook the voices into SDL_mixer's output
+    if(s16_stereo)
+    {
+        Mix_SetPostMix(mixVoices, NULL);
+        mixer_ready = true;
+    }
 }
 
+/* DATA UNLOADING */
+
 // Free audio elements from memory
 void freeSound(void)
 {
-    // Free music
-    Mix_FreeMusic(main_theme);
+    // Unhook the voices
+    if(mixer_ready) Mix_SetPostMix(NULL, NULL);
+    mixer_ready = false;
+
+    // Stop streaming the music
+    closeMusic();
 
     // Free all sound effects
     for(int i = 0; i < NUM_SOUND_EFFECTS; i++)
     {
-        Mix_FreeChunk(sfx_list[i]);
+        free(sfx_list[i]->samples);
+        free(sfx_list[i]);
     }
     free(sfx_list);
 
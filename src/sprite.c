@@ -1,168 +1,428 @@
 #include "../headers/constants.h"
 #include "../headers/sound.h"
 #include "../headers/sprite.h"
-
-// Struct for sprite meta information
-typedef struct sprite_metainfo
-{
-    int width;                  // width in pixels
-    int height;                 // height in pixels
-    int radius;                 // radius in pixels, for collision checking
-    int num_bounds;             // number of bounding boxes
-    SDL_Rect* rbounds;          // arrays of bounding boxes (one for each direction), for collision checking
-    SDL_Rect* lbounds;          // with origin in the upper-left, given relative to the sprite's xy-position
-    int sheet_position;         // y-position of sprite on the sprite sheet
-    int* frame_sections;        // array containing the number of animation frames for each sprite action
-    int power;                  // how much damage this sprite does in a collision
-    int max_hp;                 // the maximum hp of the sprite
-    int type;                   // what kind of sprite is this (HUMANOID, SPELL, PARTICLE)
-    int id;                     // what sprite is this (FIREBALL, GUY, etc)
+#include "../headers/level.h"
+#include "../headers/random.h"
+#include "../headers/arena.h"
+#include "../headers/batch.h"
+#include "../headers/atlas.h"
+#include "../headers/jobs.h"
+
+// Most bounding boxes a sprite has, and most frame sections (guys have one per action, and one for the end)
+#define MAX_BOUNDS 3
+#define MAX_FRAME_SECTIONS (DIE + 2)
+
+// Struct for sprite meta information (fixed at compile time, so the bounds and frame sections are kept inline)
+typedef const struct sprite_metainfo
+{
+    int id;                                 // what sprite is this (FIREBALL, GUY, etc)
+    int type;                               // what kind of sprite is this (HUMANOID, SPELL, PARTICLE)
+    int power;                              // how much damage this sprite does in a collision
+    int max_hp;                             // the maximum hp of the sprite
+    int width;                              // width in pixels
+    int height;                             // height in pixels
+    int radius;                             // radius in pixels, for collision checking
+    int sheet_position;                     // y-position of sprite on the sprite sheet
+    int num_bounds;                         // number of bounding boxes
+    SDL_Rect rbounds[MAX_BOUNDS];           // bounding boxes (one set for each direction), for collision checking
+    SDL_Rect lbounds[MAX_BOUNDS];           // with origin in the upper-left, given relative to the xy-position
+    int frame_sections[MAX_FRAME_SECTIONS]; // first animation frame of each action (the last section ends them)
 }* SpriteInfo;
 
-// Struct for spell meta information
-typedef struct spell_metainfo
+// Struct for spell meta information (what a spell does on launch and collision is in spell_launches and
+// spell_collisions)
+typedef const struct spell_metainfo
 {
     int action;                 // what is the casting animation for this spell
     int cast_time;              // how long does it take to cast this spell
     int finish_time;            // at what point in the casting animation is the spell launched
     int cooldown;               // how many frames before the spell is available again
-    void (*on_launch)(Sprite);  // function that's called when the spell is launched
-    void (*on_collide)(Sprite); // function that's called when the spell collides
 }* SpellInfo;
 
-// Struct for a currently active sprite
-struct sprite
+// Bounding boxes of each sprite facing right, as BOX(width, x, y, w, h) - the boxes facing left are mirrored
+// from them at compile time. Particles don't collide, so they have one empty box, which isn't counted.
+#define GUY_BOUNDS(BOX, width)      BOX(width, 9, 5, 15, 14) BOX(width, 10, 23, 10, 35)
+#define FIREBALL_BOUNDS(BOX, width) BOX(width, 6, 2, 12, 6)
+#define ICESHOCK_BOUNDS(BOX, width) BOX(width, 6, 1, 13, 7)
+#define ROCKFALL_BOUNDS(BOX, width) BOX(width, 40, 5, 20, 90) BOX(width, 20, 20, 60, 60) BOX(width, 5, 40, 90, 20)
+#define DARKEDGE_BOUNDS(BOX, width) BOX(width, 5, 8, 25, 10) BOX(width, 30, 15, 25, 10)
+#define ARCSURGE_BOUNDS(BOX, width) BOX(width, 5, 20, 92, 20)
+#define NO_BOUNDS(BOX, width)       BOX(width, 0, 0, 0, 0)
+
+// Meta info for each sprite, as X(identity, type, power, max hp, width, height, radius, sheet position,
+// (frame sections), bounds). The radius is half the sprite's diagonal, rounded down.
+#define SPRITE_TABLE(X) \
+    X(FIREBALL,    SPELL,    15, 1,   23,  10,  12, 60,  (0, 0, 2, 5),                                 FIREBALL_BOUNDS) \
+    X(ICESHOCK,    SPELL,    20, 1,   23,  10,  12, 70,  (0, 0, 2, 5),                                 ICESHOCK_BOUNDS) \
+    X(ROCKFALL,    SPELL,    30, 1,   100, 100, 70, 85,  (0, 3, 4, 7),                                 ROCKFALL_BOUNDS) \
+    X(DARKEDGE,    SPELL,    25, 1,   60,  30,  33, 215, (0, 5, 8, 11),                                DARKEDGE_BOUNDS) \
+    X(ARCSURGE,    SPELL,    35, 1,   120, 60,  67, 250, (0, 0, 3, 3),                                 ARCSURGE_BOUNDS) \
+    X(FIREBALL_P1, PARTICLE, 0,  1,   5,   5,   3,  315, (0, 0, 2, 2),                                 NO_BOUNDS)       \
+    X(ICESHOCK_P1, PARTICLE, 0,  1,   5,   5,   3,  80,  (0, 0, 2, 2),                                 NO_BOUNDS)       \
+    X(ROCKFALL_P1, PARTICLE, 0,  1,   25,  25,  17, 185, (0, 0, 1, 1),                                 NO_BOUNDS)       \
+    X(ROCKFALL_P2, PARTICLE, 0,  1,   5,   5,   3,  210, (0, 0, 2, 2),                                 NO_BOUNDS)       \
+    X(DARKEDGE_P1, PARTICLE, 0,  1,   5,   5,   3,  245, (0, 0, 2, 2),                                 NO_BOUNDS)       \
+    X(ARCSURGE_P1, PARTICLE, 0,  1,   5,   5,   3,  310, (0, 0, 2, 2),                                 NO_BOUNDS)       \
+    X(GUY,         HUMANOID, 10, 100, 28,  58,  32, 0,   (0, 0, 4, 5, 10, 14, 22, 30, 40, 51, 64, 69), GUY_BOUNDS)
+
+// Meta info for each spell, as X(identity, casting animation, cast time, finish time, cooldown)
+#define SPELL_TABLE(X) \
+    X(FIREBALL, CAST_FIREBALL, 32, 8,  120) \
+    X(ICESHOCK, CAST_ICESHOCK, 32, 8,  240) \
+    X(ROCKFALL, CAST_ROCKFALL, 40, 40, 420) \
+    X(DARKEDGE, CAST_DARKEDGE, 44, 24, 420) \
+    X(ARCSURGE, CAST_ARCSURGE, 52, 40, 600)
+
+// Expand a row of the tables above into its meta info struct
+#define UNPAREN(...) __VA_ARGS__
+#define COUNT_BOX(width, x, y, w, h) + ((w) > 0)
+#define RIGHT_BOX(width, x, y, w, h) {x, y, w, h},
+#define LEFT_BOX(width, x, y, w, h) {(width) - (x) - (w), y, w, h},
+#define SPRITE_INFO(id, type, power, hp, width, height, radius, sheet_pos, sections, bounds) \
+    [id] = { id, type, power, hp, width, height, radius, sheet_pos, 0 bounds(COUNT_BOX, width), \
+             { bounds(RIGHT_BOX, width) }, { bounds(LEFT_BOX, width) }, { UNPAREN sections } },
+#define SPELL_INFO(id, action, cast, finish, cooldown) [id] = { action, cast, finish, cooldown },
+
+// Struct for all currently active sprites of one identity, stored as a structure of arrays
+// so that the per-frame updates can stream through one sprite type at a time
+typedef struct sprite_bucket
 {
-    // Meta info
-    SpriteInfo meta;            // meta info for this sprite (see above)
+    int count;                             // number of active sprites in this bucket
 
     // Positional info
-    double x_pos;               // in-game x-coord
-    double y_pos;               // in-game y-coord
-    double x_vel;               // x-velocity
-    double y_vel;               // y-velocity
-    bool direction;             // direction currently facing
-    int angle;                  // angle of orientation
+    double x_pos[MAX_SPRITES];             // in-game x-coord
+    double y_pos[MAX_SPRITES];             // in-game y-coord
+    double x_vel[MAX_SPRITES];             // x-velocity
+    double y_vel[MAX_SPRITES];             // y-velocity
+    double prev_x[MAX_SPRITES];            // x-coord at the start of the last tick, for interpolated rendering
+    double prev_y[MAX_SPRITES];            // y-coord at the start of the last tick, for interpolated rendering
+    bool direction[MAX_SPRITES];           // direction currently facing
+    int angle[MAX_SPRITES];                // angle of orientation
 
     // Action info
-    int hp;                     // current hp
-    int spawning;               // number of frames left in spawn animation
-    int colliding;              // number of frames left in collision
-    int casting;                // number of frames left to cast spell
-    int lifetime;               // number of frames before this sprite dies automatically
-    int* cooldowns;             // array of spell cooldowns
-    int spell;                  // spell currently in use
-    int action;                 // which animation is the sprite in (MOVE, JUMP, etc)
-    bool action_change;         // has sprite's action changed to a different one this frame
-    double frame;               // which animation frame should be rendered on the sprite sheet
+    int hp[MAX_SPRITES];                   // current hp
+    int spawn_end[MAX_SPRITES];            // tick the spawn animation ends on
+    int collide_end[MAX_SPRITES];          // tick the collision ends on
+    int cast_end[MAX_SPRITES];             // tick the spell being cast finishes casting on
+    int life_end[MAX_SPRITES];             // tick the sprite's lifetime ends on (0 if it lives until it collides)
+    int fired[MAX_SPRITES];                // timers which went off this tick, as a mask of TIMER_BIT(kind)
+    int spell[MAX_SPRITES];                // spell currently in use
+    int action[MAX_SPRITES];               // which animation is the sprite in (MOVE, JUMP, etc)
+    bool action_change[MAX_SPRITES];       // has sprite's action changed to a different one this frame
+    double frame[MAX_SPRITES];             // which animation frame should be rendered on the sprite sheet
+}* Bucket;
+
+// Region sprites can occupy before they're too far out of the level and despawn (the right and bottom
+// edges are given relative to the level's size)
+#define WORLD_LEFT -500
+#define WORLD_TOP -500
+#define WORLD_RIGHT_MARGIN 500
+#define WORLD_BOTTOM_MARGIN 100
+
+// Closest a rockfall can spawn to the left and right edges of a level
+#define ROCKFALL_EDGE_MARGIN 60
+
+// Dimensions of the uniform grid laid over the world for finding potential sprite collisions. Every
+// sprite's bounding circle is small enough to cover at most 3x3 cells. The grid covers the current
+// level, so the storage is sized for the largest level.
+#define GRID_CELL_SIZE 128
+#define GRID_COLUMNS ((WORLD_RIGHT_MARGIN - WORLD_LEFT + MAX_LEVEL_WIDTH) / GRID_CELL_SIZE + 1)
+#define GRID_ROWS ((WORLD_BOTTOM_MARGIN - WORLD_TOP + MAX_LEVEL_HEIGHT) / GRID_CELL_SIZE + 1)
+#define GRID_CELLS (GRID_COLUMNS * GRID_ROWS)
+#define MAX_COLLIDERS (NUM_SPELLS * MAX_SPRITES + 2)
+
+// Struct for the collision grid, rebuilt every frame from the sprites which can collide
+struct collision_grid
+{
+    int columns;                           // number of columns and rows covering the current level
+    int rows;
+    int num_colliders;                     // number of sprites placed in the grid
+    Sprite colliders[MAX_COLLIDERS];       // handles of the sprites placed in the grid
+    int min_col[MAX_COLLIDERS];            // range of grid cells covered by each sprite's bounding circle
+    int max_col[MAX_COLLIDERS];
+    int min_row[MAX_COLLIDERS];
+    int max_row[MAX_COLLIDERS];
+    int cell_start[GRID_CELLS + 1];        // offset of each cell's first entry (the last is the total)
+    int cell_fill[GRID_CELLS];             // next free entry in each cell while the grid is being built
+    int entries[MAX_COLLIDERS * 9];        // indices of the colliders in each cell, stored cell by cell
 };
 
-// Struct for a linked list of sprites
-typedef struct ele
+// Sprites in each chunk of a bucket handed out to the job system by the parallel phases (jobs.h). The buckets
+// are split the same way however many threads there are, so a tick plays out the same on any number of cores.
+#define CHUNK_SPRITES 256
+#define MAX_CHUNKS (NUM_SPRITES * MAX_SPRITES / CHUNK_SPRITES)
+
+// Fewest active sprites worth waking the worker threads for (with fewer, the chunks all run on this thread)
+#define PARALLEL_SPRITES 2048
+
+// Sprite spawned while a chunk is being updated, which is held until every chunk is done
+struct deferred_spawn
+{
+    int id;
+    double x, y, xv, yv;
+    bool dir;
+    int angle, spawning, life;
+};
+
+// Struct for one chunk of a bucket in a parallel phase
+typedef struct sprite_chunk
+{
+    int id;                                // identity of the bucket the chunk is part of
+    int start;                             // range of the bucket's sprites in the chunk [start, end)
+    int end;
+    Rng rng;                               // random stream for the chunk's sprites this tick
+    int num_spawns;                        // sprites spawned by the chunk's sprites this tick
+    struct deferred_spawn spawns[CHUNK_SPRITES];
+}* Chunk;
+
+// Timers which make something happen when they run out, and so are kept on the timer wheel (the rest of
+// a sprite's timers are just deadlines, compared against the current tick whenever they're checked)
+enum timer_kinds
+{ LAUNCH_TIMER, LIFETIME_TIMER, COLLISION_TIMER, NUM_TIMERS };
+#define TIMER_BIT(kind) (1 << (kind))
+
+// Number of slots in the timer wheel, which is longer than any timer so that each slot only holds timers
+// due on one tick (a longer timer would just be passed over until the wheel came round to its tick)
+#define WHEEL_SLOTS 64
+#define TIMER_NODES (NUM_SPRITES * MAX_SPRITES * NUM_TIMERS)
+
+// Struct for the timer wheel. Every sprite slot has a node for each kind of timer, which is linked into
+// the wheel slot for the tick it's due on while it's pending, so only timers which are due are visited.
+struct timer_wheel
 {
-    Sprite sp;                  // sprite at this node
-    struct ele* next;           // next node
-}* SpriteList;
+    int head[WHEEL_SLOTS];                 // first node in each slot (-1 if the slot is empty)
+    int next[TIMER_NODES];                 // next node in the same slot (-1 at the end)
+    int prev[TIMER_NODES];                 // previous node in the same slot (-1 at the start)
+    int due[TIMER_NODES];                  // tick each pending node is due on
+    bool pending[TIMER_NODES];             // whether each node is on the wheel
+};
+
+// Access a field of the sprite a handle refers to, or the sprite's meta info
+#define FIELD(sp, f) (buckets[(sp).id].f[(sp).idx])
+#define META(sp) (&sprite_info[(sp).id])
+
+// Find the timer wheel node for one of a sprite's timers
+#define TIMER_NODE(sp, kind) (((sp).id * MAX_SPRITES + (sp).idx) * NUM_TIMERS + (kind))
+
+struct sprite_bucket buckets[NUM_SPRITES]; // Active sprites, one bucket per identity (sprite.h)
+int frame_images[NUM_SPRITES];  // Atlas image of each sprite's first animation frame (the rest follow in order)
+int bounds_image;               // Atlas images of the pixels bounding boxes and sprite positions are drawn
+int position_image;             // with in debug mode
+
+// Meta info for sprites and spells, indexed by identities enum (sprite.h)
+static const struct sprite_metainfo sprite_info[NUM_SPRITES] = { SPRITE_TABLE(SPRITE_INFO) };
+static const struct spell_metainfo spell_info[NUM_SPELLS] = { SPELL_TABLE(SPELL_INFO) };
 
-SDL_Texture* sprite_sheet;       // Texture containing all sprites
-SpriteList active_sprites;       // Linked list of currently active sprites
-SpriteInfo* sprite_info;        // Array of meta info structs for sprites, indexed by identities enum (sprite.h)
-SpellInfo* spell_info;          // Array of meta info structs for spells, indexed by identities enum (sprite.h)
+Sprite guys[2] = {{GUY, 0}, {GUY, 1}}; // The guys always occupy the first two slots of the GUY bucket
+int cooldown_ends[2][NUM_SPELLS];      // Tick each guy's spells come off cooldown (only humans have cooldowns)
+struct collision_grid grid;            // Grid used to find potential collisions between sprites
+struct timer_wheel wheel;              // Pending timers which make something happen when they run out
+struct sprite_chunk chunks[MAX_CHUNKS]; // Chunks the buckets are split into for the current parallel phase
+int num_chunks = 0;
+int tick = 0;                          // Current tick of the match, which every timer counts towards
+Rng rng;                               // Random stream for spells and particles in the current match
+Rng cpu_rng;                           // Separate random stream for CPU decisions, so AI changes don't perturb spells
 
-Sprite guys[2] = {NULL, NULL};  // Permanent storage for the guy sprites
+/* TIMER WHEEL */
+
+// Take a node off the wheel, if it's pending
+static void cancelTimer(int node)
+{
+    if(!wheel.pending[node]) return;
+    int prev = wheel.prev[node];
+    int next = wheel.next[node];
+    if(prev != -1) wheel.next[prev] = next;
+    else           wheel.head[wheel.due[node] % WHEEL_SLOTS] = next;
+    if(next != -1) wheel.prev[next] = prev;
+    wheel.pending[node] = false;
+}
+
+// Put a node on the wheel, due on the given tick (replacing it if it's already pending)
+static void setTimer(int node, int due)
+{
+    cancelTimer(node);
+    int slot = due % WHEEL_SLOTS;
+    wheel.due[node] = due;
+    wheel.prev[node] = -1;
+    wheel.next[node] = wheel.head[slot];
+    if(wheel.head[slot] != -1) wheel.prev[wheel.head[slot]] = node;
+    wheel.head[slot] = node;
+    wheel.pending[node] = true;
+}
+
+// Take the timers of the given kinds (a mask of TIMER_BIT) which are due on the current tick off the wheel,
+// marking each one as fired on its sprite
+static void fireTimers(int kinds)
+{
+    int node = wheel.head[tick % WHEEL_SLOTS];
+    while(node != -1)
+    {
+        int next = wheel.next[node];
+        int kind = node % NUM_TIMERS;
+        if((kinds & TIMER_BIT(kind)) && wheel.due[node] == tick)
+        {
+            cancelTimer(node);
+            int sprite = node / NUM_TIMERS;
+            buckets[sprite / MAX_SPRITES].fired[sprite % MAX_SPRITES] |= TIMER_BIT(kind);
+        }
+        node = next;
+    }
+}
+
+// Move a sprite's pending timers from one slot in its bucket to another, cancelling any the sprite in the
+// slot it's moved to had (if the slots are the same, the sprite's timers are just cancelled)
+static void moveTimers(int id, int to, int from)
+{
+    for(int kind = 0; kind < NUM_TIMERS; kind++)
+    {
+        int to_node = TIMER_NODE(((Sprite) {id, to}), kind);
+        int from_node = TIMER_NODE(((Sprite) {id, from}), kind);
+        cancelTimer(to_node);
+        if(to == from || !wheel.pending[from_node]) continue;
+        setTimer(to_node, wheel.due[from_node]);
+        cancelTimer(from_node);
+    }
+}
+
+// Take every timer off the wheel
+static void clearTimers(void)
+{
+    for(int slot = 0; slot < WHEEL_SLOTS; slot++)
+    {
+        for(int node = wheel.head[slot]; node != -1; node = wheel.next[node]) wheel.pending[node] = false;
+        wheel.head[slot] = -1;
+    }
+}
 
 /* SPRITE CONSTRUCTOR */
 
 // Initialize a sprite with its on-screen location and stats
 void spawnSprite(int id, double x, double y, double xv, double yv, bool dir, int angle, int spawning, int life)
 {
+    // Take the next slot in this identity's bucket (if the bucket is full, the sprite is simply not spawned)
+    Bucket b = &buckets[id];
+    if(b->count == MAX_SPRITES) return;
+    int i = b->count++;
+
     // Set sprite fields
-    Sprite sp = (Sprite) malloc(sizeof(struct sprite));
-    sp->meta = sprite_info[id];
-    sp->hp = sp->meta->max_hp;
-    sp->angle = angle; sp->direction = dir;
-    sp->x_pos = x;     sp->y_pos = y;
-    sp->x_vel = xv;    sp->y_vel = yv;
-    sp->casting = 0;   sp->colliding = 0;
-    sp->spell = 0;     sp->spawning = spawning;
-    sp->frame = 0;     sp->action = SPAWN;
-    sp->lifetime = life;
-
-    // Only human sprites have cooldowns
-    sp->cooldowns = NULL;
-    if(sp->meta->type == HUMANOID) sp->cooldowns = (int*) calloc(NUM_SPELLS, sizeof(int));
-
-    // Add sprite to linked list of active sprites
-    struct ele* new_sprite = (struct ele*) malloc(sizeof(struct ele));
-    new_sprite->sp = sp;
-    new_sprite->next = NULL;
-    if(active_sprites != NULL) new_sprite->next = active_sprites;
-    active_sprites = new_sprite;
-
-    // If sprite is a guy store a reference to him
-    if(sp->meta->id == GUY)
+    b->hp[i] = sprite_info[id].max_hp;
+    b->angle[i] = angle; b->direction[i] = dir;
+    b->x_pos[i] = x;     b->y_pos[i] = y;
+    b->prev_x[i] = x;    b->prev_y[i] = y;
+    b->x_vel[i] = xv;    b->y_vel[i] = yv;
+    b->cast_end[i] = 0;  b->collide_end[i] = 0;
+    b->spell[i] = 0;     b->spawn_end[i] = tick + spawning;
+    b->frame[i] = 0;     b->action[i] = SPAWN;
+    b->fired[i] = 0;     b->life_end[i] = life ? tick + life : 0;
+    b->action_change[i] = false;
+
+    // A sprite dies as its lifetime ticks down to its last tick
+    if(life > 1) setTimer(TIMER_NODE(((Sprite) {id, i}), LIFETIME_TIMER), tick + life - 1);
+
+    // Guys start with all spells off cooldown
+    if(id == GUY && i < 2)
     {
-        if(!guys[0]) guys[0] = sp;
-        else         guys[1] = sp;
+        for(int s = 0; s < NUM_SPELLS; s++) cooldown_ends[i][s] = 0;
     }
 }
 
+// Copy every field of one sprite in a bucket over another
+static void copySprite(Bucket b, int to, int from)
+{
+    b->x_pos[to] = b->x_pos[from];         b->y_pos[to] = b->y_pos[from];
+    b->x_vel[to] = b->x_vel[from];         b->y_vel[to] = b->y_vel[from];
+    b->prev_x[to] = b->prev_x[from];       b->prev_y[to] = b->prev_y[from];
+    b->direction[to] = b->direction[from]; b->angle[to] = b->angle[from];
+    b->hp[to] = b->hp[from];               b->spawn_end[to] = b->spawn_end[from];
+    b->collide_end[to] = b->collide_end[from];
+    b->cast_end[to] = b->cast_end[from];   b->spell[to] = b->spell[from];
+    b->life_end[to] = b->life_end[from];
+    b->action[to] = b->action[from];       b->action_change[to] = b->action_change[from];
+    b->frame[to] = b->frame[from];         b->fired[to] = b->fired[from];
+}
+
 /* SETTERS */
 
+// Start a sprite's collision, which lasts a number of ticks (if it's out of hp, it dies as the collision ends)
+static void startCollision(Sprite sp, int duration)
+{
+    FIELD(sp, collide_end) = tick + duration;
+    setTimer(TIMER_NODE(sp, COLLISION_TIMER), tick + duration - 1);
+}
+
 // Set a sprite's action
-static void setAction(Sprite sp, int action)
+static void setAction(Bucket b, int i, int action)
 {
-    if(sp->action != action) sp->action_change = true;
-    sp->action = action;
+    if(b->action[i] != action) b->action_change[i] = true;
+    b->action[i] = action;
 }
 
-// Teleport a sprite to a different location
+// Teleport a sprite to a different location (without interpolating the jump when it's drawn)
 static void setPosition(Sprite sp, double x, double y)
 {
-    sp->x_pos = x;
-    sp->y_pos = y;
+    FIELD(sp, x_pos) = x;
+    FIELD(sp, y_pos) = y;
+    FIELD(sp, prev_x) = x;
+    FIELD(sp, prev_y) = y;
 }
 
 // Remove a sprite's velocity
 static void stopSprite(Sprite sp)
 {
-    sp->x_vel = 0;
-    sp->y_vel = 0;
+    FIELD(sp, x_vel) = 0;
+    FIELD(sp, y_vel) = 0;
 }
 
-// Hide a guy in the top right corner of the screen (Guys can't be despawned)
+// Hide a guy just past the top right corner of the level (Guys can't be despawned)
 void hideGuy(int guy)
 {
-    setPosition(guys[guy], SCREEN_WIDTH+20, 0);
+    setPosition(guys[guy], getLevelWidth()+20, 0);
     stopSprite(guys[guy]);
-    guys[guy]->hp = 1;
+    FIELD(guys[guy], hp) = 1;
 }
 
 // Reset the fields of the Guys after a match ends
 void resetGuy(int guy, int x_pos, int y_pos)
 {
-    guys[guy]->hp = 100;
-    guys[guy]->hp = 100;
-    for(int i = 0; i < NUM_SPELLS; i++) guys[guy]->cooldowns[i] = 0;
+    FIELD(guys[guy], hp) = 100;
+    for(int i = 0; i < NUM_SPELLS; i++) cooldown_ends[guy][i] = 0;
     setPosition(guys[guy], x_pos, y_pos);
     stopSprite(guys[guy]);
-    if(guy) guys[guy]->direction = LEFT;
-    else    guys[guy]->direction = RIGHT;
+    if(guy) FIELD(guys[guy], direction) = LEFT;
+    else    FIELD(guys[guy], direction) = RIGHT;
 }
 
 /* GETTERS */
 
+// Return true if a timer which runs out on the given tick is still running
+static bool running(int end)
+{
+    return tick < end;
+}
+
+// Return true if a guy has been spawned
+static bool guyExists(int guy)
+{
+    return guy < buckets[GUY].count;
+}
+
+// Return true if two handles refer to the same sprite
+static bool sameSprite(Sprite sp, Sprite other)
+{
+    return sp.id == other.id && sp.idx == other.idx;
+}
+
 // Get an array of percentages of a guy's cooldowns
 double* getCooldowns(int guy)
 {
-    // Make sure the malloc'd array is still collected even if the Guy doesn't exist
-    double* cooldown_percentages = (double*) malloc(sizeof(double) * (NUM_SPELLS + 1));
-    if(!guys[guy]) return cooldown_percentages;
+    // The array only lives for this frame (if the Guy doesn't exist, all his spells are cooled down)
+    double* cooldown_percentages = (double*) frameAlloc(sizeof(double) * (NUM_SPELLS + 1));
 
     // Get cooldown percentages
     for(int i = 0; i < NUM_SPELLS; i++)
     {
-        cooldown_percentages[i] = guys[guy]->cooldowns[i] / (double) spell_info[i]->cooldown;
+        int left = fmax(0, cooldown_ends[guy][i] - tick);
+        cooldown_percentages[i] = guyExists(guy) ? left / (double) spell_info[i].cooldown : 0;
     }
 
     // Hack to denote an end of the array
@@ -170,148 +430,192 @@ double* getCooldowns(int guy)
     return cooldown_percentages;
 }
 
+// Get the number of active sprites, across every bucket
+int getSpriteCount(void)
+{
+    int count = 0;
+    for(int id = 0; id < NUM_SPRITES; id++) count += buckets[id].count;
+    return count;
+}
+
 // Get a guy's health remaining
 int getHealth(int guy)
 {
     // Make sure something is returned even if the Guy doesn't exist
-    if(!guys[guy]) return 0;
-    return guys[guy]->hp;
+    if(!guyExists(guy)) return 0;
+    return FIELD(guys[guy], hp);
 }
 
 // Get the x coordinate of a sprite's center
 static double xCenter(Sprite sp)
 {
-    return (sp->x_pos + (double)sp->meta->width/2);
+    return (FIELD(sp, x_pos) + (double)META(sp)->width/2);
 }
 
 // Get the y coordinate of a sprite's center
 static double yCenter(Sprite sp)
 {
-    return (sp->y_pos + (double)sp->meta->height/2);
+    return (FIELD(sp, y_pos) + (double)META(sp)->height/2);
 }
 
 // Get which bounding boxes should be used by this sprite
-static SDL_Rect* getBounds(Sprite sp)
+static const SDL_Rect* getBounds(Sprite sp)
 {
-    if(sp->direction == RIGHT) return sp->meta->rbounds;
-    return sp->meta->lbounds;
+    if(FIELD(sp, direction) == RIGHT) return META(sp)->rbounds;
+    return META(sp)->lbounds;
 }
 
 // Return true if a sprite is touching the ground
 static bool onGround(Sprite sp, int* platforms)
 {
     int middle = xCenter(sp);
-    return (sp->y_pos + sp->meta->height >= platforms[1]) && (middle > platforms[2] && middle < platforms[3]);
+    return (FIELD(sp, y_pos) + META(sp)->height >= platforms[1]) && (middle > platforms[2] && middle < platforms[3]);
 }
 
 // Return -1 unless sprite has landed on a platform (including the ground)
-static int onPlatform(Sprite sp, int* platforms)
+static int onPlatform(Sprite sp, Terrain terrain)
 {
-    int numPlatforms = platforms[0];
+    int* platforms = terrain->platforms;
     int middle = xCenter(sp);
-    for(int i = 1; i < numPlatforms*3 + 1; i += 3)
+    double y_vel = FIELD(sp, y_vel);
+    double bottom = FIELD(sp, y_pos) + META(sp)->height;
+
+    // Only the platforms spanning the sprite's column can be under its middle
+    int col = terrainColumn(terrain, middle);
+    for(int e = terrain->platform_start[col]; e < terrain->platform_start[col + 1]; e++)
     {
         // Platform land check - AABB and a positive y-velocity
-        if(sp->y_vel >= 0 && fabs(platforms[i] - (sp->y_pos + sp->meta->height)) <= fabs(sp->y_vel)
+        int i = terrain->platform_entries[e];
+        if(y_vel >= 0 && fabs(platforms[i] - bottom) <= fabs(y_vel)
         && middle > platforms[i+1] && middle < platforms[i+2])
         {
             // Return a new position for the sprite such that it is directly on the platform
-            return platforms[i] - sp->meta->height;
+            return platforms[i] - META(sp)->height;
         }
     }
     return -1;
 }
 
 // Return -1 unless sprite is touching a wall
-static int touchingWall(Sprite sp, int* walls)
+static int touchingWall(Sprite sp, Terrain terrain)
 {
-    int numWalls = walls[0];
-    for(int i = 1; i < numWalls*3 + 1; i += 3)
+    int* walls = terrain->walls;
+    double x = FIELD(sp, x_pos);
+    double y = FIELD(sp, y_pos);
+    int width = META(sp)->width;
+
+    // Only walls in the columns the sprite covers can be touching it - of those, the first listed wins
+    int wall = -1;
+    int last_col = terrainColumn(terrain, x + width);
+    for(int col = terrainColumn(terrain, x); col <= last_col; col++)
     {
-        // AABB check - if it passes, there's a wall collision
-        if(walls[i] < sp->x_pos + sp->meta->width && walls[i] > sp->x_pos
-        && walls[i+1] < sp->y_pos + sp->meta->height && walls[i+2] > sp->y_pos)
+        for(int e = terrain->wall_start[col]; e < terrain->wall_start[col + 1]; e++)
         {
-            // Determine which side of the wall was collided with and return a new position
-            // for the sprite such that it would no longer be inside the wall
-            if(fabs(walls[i] - sp->x_pos) < fabs(walls[i] - (sp->x_pos + sp->meta->width)))
+            // AABB check - if it passes, there's a wall collision
+            int i = terrain->wall_entries[e];
+            if((wall == -1 || i < wall) && walls[i] < x + width && walls[i] > x
+            && walls[i+1] < y + META(sp)->height && walls[i+2] > y)
             {
-                return walls[i];
-            }
-            else
-            {
-                return walls[i] - sp->meta->width;
+                wall = i;
             }
         }
     }
-    return -1;
+    if(wall == -1) return -1;
+
+    // Determine which side of the wall was collided with and return a new position
+    // for the sprite such that it would no longer be inside the wall
+    if(fabs(walls[wall] - x) < fabs(walls[wall] - (x + width)))
+    {
+        return walls[wall];
+    }
+    else
+    {
+        return walls[wall] - width;
+    }
 }
 
 // Checks if an active sprite is dead and needs to be unloaded
-static bool isDead(Sprite sp)
+static bool isDead(Bucket b, int i, int world_right, int world_bottom)
 {
-    // If a sprite is too far off screen, it's dead
-    double x = sp->x_pos;
-    double y = sp->y_pos;
-    if(x < -500 || x > SCREEN_WIDTH+500 || y <= -500 || y >= SCREEN_HEIGHT+100) return 1;
+    // If a sprite is too far out of the level, it's dead
+    double x = b->x_pos[i];
+    double y = b->y_pos[i];
+    if(x < WORLD_LEFT || x > world_right || y <= WORLD_TOP || y >= world_bottom) return 1;
 
     // If a sprite is out of hp and has finished its collision animation, it's dead
-    if(sp->hp == 0 && sp->colliding == 1) return 1;
+    if(b->hp[i] == 0 && (b->fired[i] & TIMER_BIT(COLLISION_TIMER))) return 1;
 
     // If a sprite has run out of lifetime, it's dead
-    if(sp->lifetime == 1) return 1;
+    if(b->fired[i] & TIMER_BIT(LIFETIME_TIMER)) return 1;
 
     return 0;
 }
 
 /* SPRITE EVENTS */
 
-// In 1-player mode, process AI decisions
-void takeCPUAction(void)
+// Decide what a CPU-controlled guy (guy 1 in 1-player mode, or both in headless mode) does this tick,
+// as a mask of inputs, so that the decisions can be recorded and replayed
+Uint8 decideCPUAction(int cpu)
 {
-    // Human player
-    int player = 0;
-    Sprite player_guy = guys[player];
-
-    // Cpu player
-    int cpu = 1;
+    Sprite player_guy = guys[!cpu];
     Sprite cpu_guy = guys[cpu];
+    Uint8 input = 0;
 
     // Walk towards player, but maintain a healthy distance
-    int towards_player = cpu_guy->x_pos < player_guy->x_pos;
-    if(fabs(cpu_guy->x_pos - player_guy->x_pos) >= 150) walk(cpu, towards_player);
-
-    // Generally face the player
-    if(cpu_guy->action == IDLE) cpu_guy->direction = towards_player;
+    int towards_player = FIELD(cpu_guy, x_pos) < FIELD(player_guy, x_pos);
+    if(fabs(FIELD(cpu_guy, x_pos) - FIELD(player_guy, x_pos)) >= 150) input |= towards_player ? INPUT_RIGHT : INPUT_LEFT;
 
     // Randomly jump
-    if(get_rand() <= 0.003) jump(cpu);
+    if(nextRand(&cpu_rng) <= 0.003) input |= INPUT_JUMP;
 
     // Randomly cast spells
-    if(get_rand() <= 0.015) cast(cpu, (int) (get_rand() * NUM_SPELLS));
+    if(nextRand(&cpu_rng) <= 0.015) input |= INPUT_CAST((int) (nextRand(&cpu_rng) * NUM_SPELLS));
+    return input;
+}
+
+// Carry out the decisions of a CPU-controlled guy, who fights the other guy
+void takeCPUAction(int cpu, Uint8 input)
+{
+    Sprite player_guy = guys[!cpu];
+    Sprite cpu_guy = guys[cpu];
+
+    // Walk
+    if(input & INPUT_LEFT) walk(cpu, LEFT);
+    if(input & INPUT_RIGHT) walk(cpu, RIGHT);
+
+    // Generally face the player
+    if(FIELD(cpu_guy, action) == IDLE) FIELD(cpu_guy, direction) = FIELD(cpu_guy, x_pos) < FIELD(player_guy, x_pos);
+
+    // Jump and cast spells
+    if(input & INPUT_JUMP) jump(cpu);
+    for(int spell = 0; spell < NUM_SPELLS; spell++)
+    {
+        if(input & INPUT_CAST(spell)) cast(cpu, spell);
+    }
 }
 
 // Attempt to walk in a direction after a keyboard input
 bool walk(int guy, bool left_or_right)
 {
     // Guy can only walk if he's not casting or colliding (can still move left/right in midair)
-    if(!(guys[guy]->casting || guys[guy]->colliding))
+    Sprite sp = guys[guy];
+    if(!(running(FIELD(sp, cast_end)) || running(FIELD(sp, collide_end))))
     {
         // Guy has less control in midair
         double speed = 0.45;
-        if(guys[guy]->y_vel != 0) speed = 0.35;
+        if(FIELD(sp, y_vel) != 0) speed = 0.35;
         double top_speed = 4.5;
 
         // Update velocity and direction facing based on direction of walk
         if(left_or_right == LEFT)
         {
-            guys[guy]->x_vel = fmax(guys[guy]->x_vel - speed, -1 * top_speed);
+            FIELD(sp, x_vel) = fmax(FIELD(sp, x_vel) - speed, -1 * top_speed);
         }
         else
         {
-            guys[guy]->x_vel = fmin(guys[guy]->x_vel + speed, top_speed);
+            FIELD(sp, x_vel) = fmin(FIELD(sp, x_vel) + speed, top_speed);
         }
-        guys[guy]->direction = left_or_right;
+        FIELD(sp, direction) = left_or_right;
         return 1;
     }
     return 0;
@@ -321,9 +625,10 @@ bool walk(int guy, bool left_or_right)
 bool jump(int guy)
 {
     // Guy can only jump if he's not casting, colliding, or jumping
-    if(!(guys[guy]->casting || guys[guy]->colliding) && guys[guy]->action != JUMP)
+    Sprite sp = guys[guy];
+    if(!(running(FIELD(sp, cast_end)) || running(FIELD(sp, collide_end))) && FIELD(sp, action) != JUMP)
     {
-        guys[guy]->y_vel += -10.1;
+        FIELD(sp, y_vel) += -10.1;
         return 1;
     }
     return 0;
@@ -333,30 +638,35 @@ bool jump(int guy)
 bool cast(int guy, int spell)
 {
     // Guy can only cast a spell if it's off cooldown and he's not casting, colliding, or jumping
-    if(!(guys[guy]->casting || guys[guy]->colliding) && !guys[guy]->cooldowns[spell] && guys[guy]->action != JUMP)
+    Sprite sp = guys[guy];
+    bool busy = running(FIELD(sp, cast_end)) || running(FIELD(sp, collide_end));
+    if(!busy && !running(cooldown_ends[guy][spell]) && FIELD(sp, action) != JUMP)
     {
-        guys[guy]->casting = spell_info[spell]->cast_time;
-        guys[guy]->spell = spell;
+        // The spell launches when the casting animation reaches its finish time
+        FIELD(sp, cast_end) = tick + spell_info[spell].cast_time;
+        FIELD(sp, spell) = spell;
+        setTimer(TIMER_NODE(sp, LAUNCH_TIMER), FIELD(sp, cast_end) - spell_info[spell].finish_time);
 
         // For rockfall, guy should face in the direction of the other guy
-        if(spell == ROCKFALL) guys[guy]->direction = (guys[guy]->x_pos <= guys[(int)!guy]->x_pos);
+        if(spell == ROCKFALL) FIELD(sp, direction) = (FIELD(sp, x_pos) <= FIELD(guys[(int)!guy], x_pos));
         return 1;
     }
     return 0;
 }
 
-// Action function for launching a fireball (stored as fxn ptr in spellInfo)
+// Action function for launching a fireball (stored as fxn ptr in spell_launches)
 static void launchFireball(Sprite sp)
 {
     // Starting position and velocity of the fireball
-    double x = sp->x_pos;
-    double y = sp->y_pos + 28;
-    double xv = convert(sp->direction) * 1.2;
-    if(sp->direction == RIGHT) x += sp->meta->width - 4;
-    else                       x -= sprite_info[FIREBALL]->width - 4;
+    bool dir = FIELD(sp, direction);
+    double x = FIELD(sp, x_pos);
+    double y = FIELD(sp, y_pos) + 28;
+    double xv = convert(dir) * 1.2;
+    if(dir == RIGHT) x += META(sp)->width - 4;
+    else             x -= sprite_info[FIREBALL].width - 4;
 
     // Spawn the fireball
-    spawnSprite(FIREBALL, x, y, xv, 0, sp->direction, 0, 0, 0);
+    spawnSprite(FIREBALL, x, y, xv, 0, dir, 0, 0, 0);
 }
 
 // Helper function to launch a single ice missile
@@ -367,22 +677,24 @@ static void launchIceshockSingle(Sprite sp, double x_dist, double y_dist, double
     int angle = (int) (57.296 * atan(y_speed / (side * x_speed)));
 
     // Starting position of the missile
-    double ice_xpos = (side*x_dist)+sp->x_pos+sp->meta->width/4-3;
-    double ice_ypos = sp->y_pos-y_dist;
+    double ice_xpos = (side*x_dist)+FIELD(sp, x_pos)+META(sp)->width/4-3;
+    double ice_ypos = FIELD(sp, y_pos)-y_dist;
 
     // Spawn one missile and four small particles around it
     spawnSprite(ICESHOCK, ice_xpos, ice_ypos, side * x_speed, y_speed, dir, angle, 0, 0);
+    double r[4 * 4];
+    fillRand(&rng, r, 4 * 4);
     for(int j = 0; j < 4; j++)
     {
-        double ptc_x = ice_xpos + (get_rand() - 0.5) * 10;
-        double ptc_y = ice_ypos + (get_rand() - 0.5) * 10;
-        double ptc_xv = side * (x_speed * get_rand() + 2);
-        double ptc_yv = y_speed * get_rand() - x_speed;
+        double ptc_x = ice_xpos + (r[4*j] - 0.5) * 10;
+        double ptc_y = ice_ypos + (r[4*j+1] - 0.5) * 10;
+        double ptc_xv = side * (x_speed * r[4*j+2] + 2);
+        double ptc_yv = y_speed * r[4*j+3] - x_speed;
         spawnSprite(ICESHOCK_P1, ptc_x, ptc_y, ptc_xv, ptc_yv, dir, 0, 0, 0);
     }
 }
 
-// Action function for launching an iceshock (stored as fxn ptr in spellInfo)
+// Action function for launching an iceshock (stored as fxn ptr in spell_launches)
 static void launchIceshock(Sprite sp)
 {
     for(int dir = LEFT; dir <= RIGHT; dir++)
@@ -393,124 +705,148 @@ static void launchIceshock(Sprite sp)
     }
 }
 
-// Action function for launching rockfall (stored as fxn ptr in spellInfo)
+// Action function for launching rockfall (stored as fxn ptr in spell_launches)
 static void launchRockfall(Sprite sp)
 {
     // Get position of the other guy
-    int other_guy_idx = (sp == guys[0]);
+    int other_guy_idx = sameSprite(sp, guys[0]);
     Sprite other_guy = guys[other_guy_idx];
 
+    // Keep the rock away from the level's edges, and between its outer walls (so it doesn't spawn inside the
+    // trees on the forest map)
+    int left = ROCKFALL_EDGE_MARGIN, right = getLevelWidth() - ROCKFALL_EDGE_MARGIN;
+    int* walls = getWalls();
+    for(int i = 1; i < walls[0] * 3 + 1; i += 3)
+    {
+        if(walls[i] < getLevelWidth() / 2) left = fmax(left, walls[i]);
+        else                               right = fmin(right, walls[i]);
+    }
+
     // Set starting position of rock
-    int x = xCenter(other_guy) - sprite_info[ROCKFALL]->width / 2;
-    x = fmin(fmax(x, 60), 964 - sprite_info[ROCKFALL]->width); // Avoid spawning inside trees on forest map
-    int y = other_guy->y_pos - 250;
+    int x = xCenter(other_guy) - sprite_info[ROCKFALL].width / 2;
+    x = fmin(fmax(x, left), right - sprite_info[ROCKFALL].width);
+    int y = FIELD(other_guy, y_pos) - 250;
 
     // Spawn the rock
     spawnSprite(ROCKFALL, x, y, 0, -1, RIGHT, 0, 20, 0);
 }
 
-// Action function for launching darkedge (stored as fxn ptr in spellInfo)
+// Action function for launching darkedge (stored as fxn ptr in spell_launches)
 static void launchDarkedge(Sprite sp)
 {
     // base positions and velocity of spears
-    double x_pos = sp->x_pos - (!sp->direction * 33);
-    double y_pos = sp->y_pos - 45;
+    bool dir = FIELD(sp, direction);
+    double x_pos = FIELD(sp, x_pos) - (!dir * 33);
+    double y_pos = FIELD(sp, y_pos) - 45;
 
-    double x_vel = 0.1 * convert(sp->direction);
+    double x_vel = 0.1 * convert(dir);
     double y_vel = 0.025;
 
     // Spawn four dark spears above caster
     for(int i = 0; i < 4; i++)
     {
         int angle = (int) (57.296 * atan(y_vel / x_vel));
-        spawnSprite(DARKEDGE, x_pos, y_pos - i*45, x_vel, y_vel, sp->direction, angle, 33, 0);
+        spawnSprite(DARKEDGE, x_pos, y_pos - i*45, x_vel, y_vel, dir, angle, 33, 0);
     }
 }
 
-// Action function for launching arcsurge (stored as fxn ptr in spellInfo)
+// Action function for launching arcsurge (stored as fxn ptr in spell_launches)
 static void launchArcsurge(Sprite sp)
 {
     // Position of the lightning bolt
-    double x = sp->x_pos;
-    double y = sp->y_pos - 1;
-    if(sp->direction == RIGHT) x += sp->meta->width - 6;
-    else                       x -= sprite_info[ARCSURGE]->width - 6;
+    bool dir = FIELD(sp, direction);
+    double x = FIELD(sp, x_pos);
+    double y = FIELD(sp, y_pos) - 1;
+    if(dir == RIGHT) x += META(sp)->width - 6;
+    else             x -= sprite_info[ARCSURGE].width - 6;
 
     // Caster is blown back by the launch
-    sp->x_vel = -6 * convert(sp->direction);
+    FIELD(sp, x_vel) = -6 * convert(dir);
 
     // Spawn lightning next to sprite, on the side the sprite is facing
-    spawnSprite(ARCSURGE, x, y, 0, 0, sp->direction, 0, 0, 20);
+    spawnSprite(ARCSURGE, x, y, 0, 0, dir, 0, 0, 20);
 
     // Particles shoot out in the direction the spell was cast
-    double p_x = x + (sp->direction * sprite_info[ARCSURGE]->width);
-    double p_y = y + sprite_info[ARCSURGE]->height / 2;
+    double p_x = x + (dir * sprite_info[ARCSURGE].width);
+    double p_y = y + sprite_info[ARCSURGE].height / 2;
+    double r[30 * 3];
+    fillRand(&rng, r, 30 * 3);
     for(int i = 0; i < 30; i++)
     {
         double top_speed = 5;
-        double p_xv = (1 + get_rand()) * 3.5 * convert(sp->direction);
-        double p_yv = (top_speed - fabs(p_xv)) * ((get_rand() - 0.5) * 2);
-        spawnSprite(ARCSURGE_P1, p_x, p_y, p_xv, p_yv, sp->direction, 0, 0, 10 + get_rand() * 20);
+        double p_xv = (1 + r[3*i]) * 3.5 * convert(dir);
+        double p_yv = (top_speed - fabs(p_xv)) * ((r[3*i+1] - 0.5) * 2);
+        spawnSprite(ARCSURGE_P1, p_x, p_y, p_xv, p_yv, dir, 0, 0, 10 + r[3*i+2] * 20);
     }
 }
 
 // Generic actions for when any spell collides with something (always slows down and dies)
 static void collideGeneric(Sprite sp)
 {
-    sp->colliding = 20;
-    sp->hp = 0;
-    sp->x_vel *= 0.05;
-    sp->y_vel *= 0.05;
+    startCollision(sp, 20);
+    FIELD(sp, hp) = 0;
+    FIELD(sp, x_vel) *= 0.05;
+    FIELD(sp, y_vel) *= 0.05;
 }
 
-// Action function for a rockfall collision (stored as fxn ptr in spellInfo)
+// Action function for a rockfall collision (stored as fxn ptr in spell_collisions)
 static void collideRockfall(Sprite sp)
 {
     // Set collided and slow the sprite down
     collideGeneric(sp);
 
-    // Spawn particles
+    // Spawn particles (three per iteration, each using three random numbers)
+    double r[8 * 9];
+    fillRand(&rng, r, 8 * 9);
     for(int i = 0; i < 8; i++)
     {
         int x_dir = convert(i < 4);
         double x = xCenter(sp);
         double y = yCenter(sp);
-        double xv = x_dir * sp->y_vel;
-        double yv = sp->y_vel * -2;
-        int a = get_rand();
-        spawnSprite(ROCKFALL_P1, x+(get_rand()-0.5)*40, y, xv + x_dir*5*get_rand(), yv-7*get_rand(), 0, a, 0, 0);
-        spawnSprite(ROCKFALL_P2, x+(get_rand()-0.5)*40, y, xv + x_dir*5*get_rand(), yv-7*get_rand(), 0, a, 0, 0);
-        spawnSprite(ROCKFALL_P2, x+(get_rand()-0.5)*40, y, xv + x_dir*5*get_rand(), yv-7*get_rand(), 0, a, 0, 0);
+        double xv = x_dir * FIELD(sp, y_vel);
+        double yv = FIELD(sp, y_vel) * -2;
+        double* p = &r[9*i];
+        spawnSprite(ROCKFALL_P1, x+(p[0]-0.5)*40, y, xv + x_dir*5*p[1], yv-7*p[2], 0, 0, 0, 0);
+        spawnSprite(ROCKFALL_P2, x+(p[3]-0.5)*40, y, xv + x_dir*5*p[4], yv-7*p[5], 0, 0, 0, 0);
+        spawnSprite(ROCKFALL_P2, x+(p[6]-0.5)*40, y, xv + x_dir*5*p[7], yv-7*p[8], 0, 0, 0, 0);
     }
 }
 
-// Action function for an arcsurge collision (stored as fxn ptr in spellInfo)
+// Action function for an arcsurge collision (stored as fxn ptr in spell_collisions)
 static void collideArcsurge(Sprite sp)
 {
     // Arcsurge does not react to collisions
 }
 
+// What each spell does when it's launched and when it collides, indexed by identities enum (sprite.h)
+static void (*const spell_launches[NUM_SPELLS])(Sprite) =
+{ launchFireball, launchIceshock, launchRockfall, launchDarkedge, launchArcsurge };
+static void (*const spell_collisions[NUM_SPELLS])(Sprite) =
+{ collideGeneric, collideGeneric, collideRockfall, collideGeneric, collideArcsurge };
+
 /* PER FRAME UPDATES */
 
-// If a human sprite is ready to launch a casted spell, launch it
-static void launchSpell(Sprite sp)
+// Launch the spell a human sprite has finished casting, and start its cooldown
+static void launchSpell(int guy)
 {
-    // Set cooldown and launch the spell if sprite has finished its casting animation
-    int spell = sp->spell;
-    if(sp->casting == spell_info[spell]->finish_time)
-    {
-        sp->cooldowns[spell] = spell_info[spell]->cooldown;
-        spell_info[spell]->on_launch(sp);
-    }
+    Sprite sp = guys[guy];
+    int spell = FIELD(sp, spell);
+    cooldown_ends[guy][spell] = tick + (debug ? 0 : spell_info[spell].cooldown); // no cooldowns in debug mode
+    spell_launches[spell](sp);
+    playSoundEffectAt(SFX_CAST(spell), xCenter(sp));
 }
 
 // Human sprites launch any spells they are ready to launch
 void launchSpells(void)
 {
-    // Iterate over active sprites
-    for(struct ele* cursor = active_sprites; cursor != NULL; cursor = cursor->next)
+    // Only casts which have reached their finish time this tick are taken off the timer wheel, and the
+    // spells are then launched in guy order (the guys are the only humans)
+    fireTimers(TIMER_BIT(LAUNCH_TIMER));
+    for(int guy = 0; guy < buckets[GUY].count; guy++)
     {
-        if(cursor->sp->meta->type == HUMANOID) launchSpell(cursor->sp);
+        if(!(FIELD(guys[guy], fired) & TIMER_BIT(LAUNCH_TIMER))) continue;
+        FIELD(guys[guy], fired) &= ~TIMER_BIT(LAUNCH_TIMER);
+        launchSpell(guy);
     }
 }
 
@@ -523,7 +859,7 @@ static bool boundingCircleCheck(Sprite sp, Sprite other)
 
     // Compare the distance squared with the sum of the radii squared
     double distance_squared = x_dist * x_dist + y_dist * y_dist;
-    double rad_sum = sp->meta->radius + other->meta->radius;
+    double rad_sum = META(sp)->radius + META(other)->radius;
 
     // If they're close enough, return true so we can do bounding box check
     if((rad_sum * rad_sum) <= distance_squared) return false;
@@ -534,17 +870,17 @@ static bool boundingCircleCheck(Sprite sp, Sprite other)
 static bool boundingBoxesCheck(Sprite sp, Sprite other)
 {
     // Nested for loop to compare each box of sp with each box of other
-    SDL_Rect* b1 = getBounds(sp);
-    SDL_Rect* b2 = getBounds(other);
-    for(int i = 0; i < sp->meta->num_bounds; i++)
+    const SDL_Rect* b1 = getBounds(sp);
+    const SDL_Rect* b2 = getBounds(other);
+    for(int i = 0; i < META(sp)->num_bounds; i++)
     {
-        int x1 = b1[i].x + sp->x_pos;
-        int y1 = b1[i].y + sp->y_pos;
-        for(int j = 0; j < other->meta->num_bounds; j++)
+        int x1 = b1[i].x + FIELD(sp, x_pos);
+        int y1 = b1[i].y + FIELD(sp, y_pos);
+        for(int j = 0; j < META(other)->num_bounds; j++)
         {
             // AABB
-            int x2 = b2[j].x + other->x_pos;
-            int y2 = b2[j].y + other->y_pos;
+            int x2 = b2[j].x + FIELD(other, x_pos);
+            int y2 = b2[j].y + FIELD(other, y_pos);
             if((x1 < x2 + b2[j].w && x1 + b1[i].w > x2) && (y1 < y2 + b2[j].h && y1 + b1[i].h > y2))
             {
                 return true;
@@ -554,670 +890,770 @@ static bool boundingBoxesCheck(Sprite sp, Sprite other)
     return false;
 }
 
+// Run a spell's collision handler, with its collision sound
+static void collideSpell(Sprite sp)
+{
+    playSoundEffectAt(SFX_HIT(sp.id), xCenter(sp));
+    spell_collisions[sp.id](sp);
+}
+
 // Process a collision between two sprites
 static void applyCollision(Sprite sp, Sprite other)
 {
     // All sprites take damage from collisions
-    sp->hp = fmax(0, sp->hp - other->meta->power);
+    FIELD(sp, hp) = fmax(0, FIELD(sp, hp) - META(other)->power);
 
     // Humans are knocked back by collisions, and spellcasts are cancelled
-    if(sp->meta->type == HUMANOID)
+    if(META(sp)->type == HUMANOID)
     {
         // Get which direction the collision is coming from
         int direction = convert(xCenter(other) >= xCenter(sp));
 
         // Special case: Arcsurge always hits target in the direction that it is cast
-        if(other->meta->id == ARCSURGE) direction = convert(!other->direction);
+        if(other.id == ARCSURGE) direction = convert(!FIELD(other, direction));
 
         // Apply collision
-        sp->colliding = 20;
-        sp->x_vel = -5 * direction;
-        sp->y_vel = -3;
-        sp->casting = 0;
+        startCollision(sp, 20);
+        FIELD(sp, x_vel) = -5 * direction;
+        FIELD(sp, y_vel) = -3;
+        FIELD(sp, cast_end) = tick;
+        cancelTimer(TIMER_NODE(sp, LAUNCH_TIMER));
     }
 
     // Spells have specialized collision handlers
-    if(sp->meta->type == SPELL) spell_info[sp->meta->id]->on_collide(sp);
+    if(META(sp)->type == SPELL) collideSpell(sp);
+}
+
+// Return true if a sprite can currently collide with other sprites
+static bool canCollide(Sprite sp)
+{
+    // Colliding sprites, spawning sprites, and particles don't interact
+    return META(sp)->type != PARTICLE && !running(FIELD(sp, collide_end)) && !running(FIELD(sp, spawn_end));
+}
+
+// Work out which grid cells a sprite's bounding circle covers and add it to the grid's colliders
+static void addCollider(Sprite sp)
+{
+    int r = META(sp)->radius;
+    int x = xCenter(sp) - WORLD_LEFT;
+    int y = yCenter(sp) - WORLD_TOP;
+    int c = grid.num_colliders++;
+    grid.colliders[c] = sp;
+    grid.min_col[c] = fmin(fmax((x - r) / GRID_CELL_SIZE, 0), grid.columns - 1);
+    grid.max_col[c] = fmin(fmax((x + r) / GRID_CELL_SIZE, 0), grid.columns - 1);
+    grid.min_row[c] = fmin(fmax((y - r) / GRID_CELL_SIZE, 0), grid.rows - 1);
+    grid.max_row[c] = fmin(fmax((y + r) / GRID_CELL_SIZE, 0), grid.rows - 1);
+}
+
+// Rebuild the collision grid from every sprite which can currently collide
+static void buildCollisionGrid(void)
+{
+    // Lay the grid over the current level
+    grid.columns = (WORLD_RIGHT_MARGIN - WORLD_LEFT + getLevelWidth()) / GRID_CELL_SIZE + 1;
+    grid.rows = (WORLD_BOTTOM_MARGIN - WORLD_TOP + getLevelHeight()) / GRID_CELL_SIZE + 1;
+    int cells = grid.columns * grid.rows;
+
+    // Gather colliders - only spells and humans collide, so particle buckets are never visited
+    grid.num_colliders = 0;
+    for(int id = 0; id < NUM_SPRITES; id++)
+    {
+        if(sprite_info[id].type == PARTICLE) continue;
+        for(int i = 0; i < buckets[id].count; i++)
+        {
+            Sprite sp = {id, i};
+            if(canCollide(sp)) addCollider(sp);
+        }
+    }
+
+    // Count how many colliders land in each cell, then turn the counts into starting offsets
+    for(int cell = 0; cell <= cells; cell++) grid.cell_start[cell] = 0;
+    for(int c = 0; c < grid.num_colliders; c++)
+    {
+        for(int row = grid.min_row[c]; row <= grid.max_row[c]; row++)
+        {
+            for(int col = grid.min_col[c]; col <= grid.max_col[c]; col++) grid.cell_start[row * grid.columns + col + 1]++;
+        }
+    }
+    for(int cell = 0; cell < cells; cell++)
+    {
+        grid.cell_start[cell + 1] += grid.cell_start[cell];
+        grid.cell_fill[cell] = grid.cell_start[cell];
+    }
+
+    // Place each collider in every cell it covers
+    for(int c = 0; c < grid.num_colliders; c++)
+    {
+        for(int row = grid.min_row[c]; row <= grid.max_row[c]; row++)
+        {
+            for(int col = grid.min_col[c]; col <= grid.max_col[c]; col++) grid.entries[grid.cell_fill[row * grid.columns + col]++] = c;
+        }
+    }
 }
 
 // Detect and handle all collisions between sprites in this frame
 void spriteCollisions(void)
 {
-    // Iterate over all active sprites
-    for(struct ele* cursor = active_sprites; cursor != NULL; cursor = cursor->next)
-    {
-        // Colliding sprites, spawning sprites, and particles don't interact
-        Sprite sp = cursor->sp;
-        if(sp->meta->type == PARTICLE || sp->colliding || sp->spawning) continue;
+    // Bucket the sprites which can collide into grid cells, so only sprites sharing a cell are compared
+    buildCollisionGrid();
 
-        // Otherwise, need to check for a collision against every other sprite
-        for(struct ele* cursor = active_sprites; cursor != NULL; cursor = cursor->next)
+    // Iterate over every pair of colliders sharing a cell
+    for(int cell = 0; cell < grid.columns * grid.rows; cell++)
+    {
+        int row = cell / grid.columns;
+        int col = cell % grid.columns;
+        for(int e = grid.cell_start[cell]; e < grid.cell_start[cell + 1]; e++)
         {
-            // Colliding sprites, spawning sprites, and particles don't interact
-            Sprite other = cursor->sp;
-            if(other->meta->type == PARTICLE || other->colliding || other->spawning) continue;
+            int a = grid.entries[e];
+            for(int f = e + 1; f < grid.cell_start[cell + 1]; f++)
+            {
+                // A pair that shares several cells is only checked in the top-left cell they share
+                int b = grid.entries[f];
+                if(fmax(grid.min_col[a], grid.min_col[b]) != col || fmax(grid.min_row[a], grid.min_row[b]) != row) continue;
 
-            // Sprites don't collide with themselves and humans don't collide with other humans
-            if(sp == other || (other->meta->type == HUMANOID && sp->meta->type == HUMANOID)) continue;
+                // Sprites which have already collided this frame don't interact again
+                Sprite sp = grid.colliders[a];
+                Sprite other = grid.colliders[b];
+                if(!canCollide(sp) || !canCollide(other)) continue;
 
-            // Bounding circle check – if two sprites aren't even close to each other, don't bother
-            if(!boundingCircleCheck(sp, other)) continue;
+                // Humans don't collide with other humans
+                if(META(other)->type == HUMANOID && META(sp)->type == HUMANOID) continue;
 
-            // If circle check passes, do more precise bounding box array check
-            if(!boundingBoxesCheck(sp, other)) continue;
+                // Bounding circle check – if two sprites aren't even close to each other, don't bother
+                if(!boundingCircleCheck(sp, other)) continue;
 
-            // Apply the effects of the collision to both sprites
-            applyCollision(sp, other);
-            applyCollision(other, sp);
+                // If circle check passes, do more precise bounding box array check
+                if(!boundingBoxesCheck(sp, other)) continue;
+
+                // Apply the effects of the collision to both sprites
+                applyCollision(sp, other);
+                applyCollision(other, sp);
+            }
         }
     }
 }
 
 // Detect and handle terrain collisions in this frame for a sprite
-static void terrainCollision(Sprite sp, int* platforms, int* walls)
+static void terrainCollision(Sprite sp, Terrain terrain)
 {
     // Precomputation
-    int touching_wall = touchingWall(sp, walls);
-    int on_platform = onPlatform(sp, platforms);
-    int on_ground = onGround(sp, platforms);
+    int touching_wall = touchingWall(sp, terrain);
+    int on_platform = onPlatform(sp, terrain);
+    int on_ground = onGround(sp, terrain->platforms);
 
     // Different sprite types handle terrain collisions differently
-    switch(sp->meta->type)
+    switch(META(sp)->type)
     {
         case HUMANOID:
             // Humans are stopped by walls
             if(touching_wall != -1)
             {
-                sp->x_vel = 0;
-                sp->x_pos = touching_wall;
+                FIELD(sp, x_vel) = 0;
+                FIELD(sp, x_pos) = touching_wall;
             }
 
             // (Falling) humans are stopped by platforms
             if(on_platform != -1)
             {
-                sp->y_vel = 0;
-                sp->y_pos = on_platform;
+                FIELD(sp, y_vel) = 0;
+                FIELD(sp, y_pos) = on_platform;
             }
             break;
 
         case SPELL:
             // Spells collide with ground and walls
-            if(!sp->colliding && !sp->spawning && (on_ground || touching_wall != -1))
+            if(!running(FIELD(sp, collide_end)) && !running(FIELD(sp, spawn_end)) && (on_ground || touching_wall != -1))
             {
                 // Spells have specialized collision handlers
-                spell_info[sp->meta->id]->on_collide(sp);
+                collideSpell(sp);
             }
             break;
 
         case PARTICLE:
             // Particles collide with ground and walls
-            if(!sp->colliding && (on_ground || touching_wall != -1))
+            if(!running(FIELD(sp, collide_end)) && (on_ground || touching_wall != -1))
             {
                 // Particles die immediately on terrain contact
-                sp->hp = 0;
-                sp->colliding = 2;
+                FIELD(sp, hp) = 0;
+                startCollision(sp, 2);
             }
             break;
     }
 }
 
 // Check for and handle terrain collisions for all active sprites
-void terrainCollisions(int* platforms, int* walls)
+void terrainCollisions(Terrain terrain)
+{
+    for(int id = 0; id < NUM_SPRITES; id++)
+    {
+        int n = buckets[id].count;
+        for(int i = 0; i < n; i++)
+        {
+            terrainCollision((Sprite) {id, i}, terrain);
+        }
+    }
+}
+
+// Split the active sprites of every bucket into chunks for a parallel phase
+static void splitChunks(void)
 {
-    for(struct ele* cursor = active_sprites; cursor != NULL; cursor = cursor->next)
+    num_chunks = 0;
+    for(int id = 0; id < NUM_SPRITES; id++)
     {
-        terrainCollision(cursor->sp, platforms, walls);
+        for(int start = 0; start < buckets[id].count; start += CHUNK_SPRITES)
+        {
+            Chunk c = &chunks[num_chunks++];
+            c->id = id;
+            c->start = start;
+            c->end = fmin(start + CHUNK_SPRITES, buckets[id].count);
+            c->num_spawns = 0;
+        }
     }
 }
 
+// Run work for every chunk, across the job system's threads if there are enough sprites to be worth it
+static void runChunks(JobWork work)
+{
+    if(getSpriteCount() >= PARALLEL_SPRITES) parallelFor(num_chunks, work, NULL);
+    else for(int c = 0; c < num_chunks; c++) work(NULL, c);
+}
+
+// Hold a sprite spawned while a chunk is being updated, to be spawned once every chunk is done (a chunk holds
+// one spawn per sprite it can have, and any more are simply not spawned)
+static void deferSpawn(Chunk c, int id, double x, double y, double xv, double yv, bool dir, int angle, int spawning,
+                       int life)
+{
+    if(c->num_spawns == CHUNK_SPRITES) return;
+    c->spawns[c->num_spawns++] = (struct deferred_spawn) {id, x, y, xv, yv, dir, angle, spawning, life};
+}
+
 // Update which animation action the sprite is currently in based on its state
-static void updateAction(Sprite sp)
-{
-    double xv = sp->x_vel;
-    double yv = sp->y_vel;
-    int type = sp->meta->type;
-    if(type == HUMANOID && sp->hp == 0)             setAction(sp, DIE);
-    else if(sp->spawning)                           setAction(sp, SPAWN);
-    else if(sp->colliding)                          setAction(sp, COLLIDE);
-    else if(sp->casting)                            setAction(sp, spell_info[sp->spell]->action);
-    else if(type == HUMANOID && xv == 0 && yv == 0) setAction(sp, IDLE);
-    else if(type == HUMANOID && yv != 0)            setAction(sp, JUMP);
-    else                                            setAction(sp, MOVE);
-}
-
-// Update the animation frame (picture that gets drawn) for a sprite
-static void updateAnimationFrame(Sprite sp)
-{
-    // Update which action the sprite is currently taking based on its state
-    updateAction(sp);
-
-    // Sprite proceeds through animation frames faster during certain actions
-    int a = sp->action;
-    double increment = ANIMATION_SPEED * 0.1;
-    if(a == MOVE && sp->meta->id == GUY) increment *= 2;
-    if(a == JUMP || a == COLLIDE || a == SPAWN || sp->meta->id == ARCSURGE) increment *= 1.5;
-    if(a >= CAST_FIREBALL) increment *= 2.5;
-    sp->frame += increment;
-
-    // If the sprite's action has just changed, reset to first animation frame of that action
-    if(sp->action_change) sp->frame = sp->meta->frame_sections[a];
-    sp->action_change = false;
-
-    // Wraparound to first animation frame of an action if we reach the last frame for that action
-    if(sp->frame >= sp->meta->frame_sections[a+1])
+static void updateAction(Bucket b, int i, int type)
+{
+    double xv = b->x_vel[i];
+    double yv = b->y_vel[i];
+    if(type == HUMANOID && b->hp[i] == 0)           setAction(b, i, DIE);
+    else if(running(b->spawn_end[i]))               setAction(b, i, SPAWN);
+    else if(running(b->collide_end[i]))             setAction(b, i, COLLIDE);
+    else if(running(b->cast_end[i]))                setAction(b, i, spell_info[b->spell[i]].action);
+    else if(type == HUMANOID && xv == 0 && yv == 0) setAction(b, i, IDLE);
+    else if(type == HUMANOID && yv != 0)            setAction(b, i, JUMP);
+    else                                            setAction(b, i, MOVE);
+}
+
+// Update the animation frame (picture that gets drawn) for the sprites in one chunk (run by the job system)
+static void animateChunk(void* data, int item)
+{
+    // Sprite proceeds through animation frames faster during certain actions - this
+    // only depends on the identity and the action, so it's worked out once per chunk
+    Chunk c = &chunks[item];
+    int id = c->id;
+    Bucket b = &buckets[id];
+    double increments[DIE + 1];
+    for(int a = 0; a <= DIE; a++)
     {
-        sp->frame = sp->meta->frame_sections[a];
+        increments[a] = ANIMATION_SPEED * 0.1;
+        if(a == MOVE && id == GUY) increments[a] *= 2;
+        if(a == JUMP || a == COLLIDE || a == SPAWN || id == ARCSURGE) increments[a] *= 1.5;
+        if(a >= CAST_FIREBALL) increments[a] *= 2.5;
+    }
+
+    int type = sprite_info[id].type;
+    const int* fs = sprite_info[id].frame_sections;
+    for(int i = c->start; i < c->end; i++)
+    {
+        // Update which action the sprite is currently taking based on its state
+        updateAction(b, i, type);
+        int a = b->action[i];
+        b->frame[i] += increments[a];
+
+        // If the sprite's action has just changed, reset to first animation frame of that action
+        if(b->action_change[i]) b->frame[i] = fs[a];
+        b->action_change[i] = false;
+
+        // Wraparound to first animation frame of an action if we reach the last frame for that action
+        if(b->frame[i] >= fs[a+1]) b->frame[i] = fs[a];
     }
 }
 
 // Update the animation frame which is drawn for all active sprites
 void updateAnimationFrames(void)
 {
-    for(struct ele* cursor = active_sprites; cursor != NULL; cursor = cursor->next)
+    splitChunks();
+    runChunks(animateChunk);
+}
+
+// Physics for guys
+static void moveGuys(Bucket b, Chunk c)
+{
+    for(int i = c->start; i < c->end; i++)
     {
-        updateAnimationFrame(cursor->sp);
+        // Update x velocity (friction / air resistance)
+        double xv = b->x_vel[i];
+        b->x_vel[i] = (fabs(xv) <= 0.3) ? 0 : xv + convert(xv < 0.0f) * 0.15;
+
+        // Update y velocity (terminal velocity of 50)
+        b->y_vel[i] = fmin(b->y_vel[i] + 0.5, 50);
     }
 }
 
-// Calculate physics and update position/velocity/orientation for a sprite
-static void moveSprite(Sprite sp)
+// Physics for fireballs
+static void moveFireballs(Bucket b, Chunk c)
 {
-    // Update the sprite's position
-    sp->x_pos += sp->x_vel;
-    sp->y_pos += sp->y_vel;
-
-    // Update the sprite's velocity and orientation (the physics are different for different spells)
-    switch(sp->meta->id)
+    for(int i = c->start; i < c->end; i++)
     {
-        case GUY:
-            // Update x velocity (friction / air resistance)
-            if(fabs(sp->x_vel) <= 0.3) sp->x_vel = 0;
-            else                       sp->x_vel += convert(sp->x_vel < 0.0f) * 0.15;
-
-            // Update y velocity (terminal velocity of 50)
-            sp->y_vel = fmin(sp->y_vel + 0.5, 50);
-            break;
+        // Fireball accelerates over time and spawns a particle trail
+        if(!running(b->collide_end[i]))
+        {
+            b->x_vel[i] += convert(b->x_vel[i] > 0) * 0.15;
 
-        case FIREBALL:
-            // Fireball accelerates over time and spawns a particle trail
-            if(!sp->colliding)
+            if(nextRand(&c->rng) <= fabs(b->x_vel[i]) * 0.05)
             {
-                sp->x_vel += convert(sp->x_vel > 0) * 0.15;
-
-                if(get_rand() <= fabs(sp->x_vel) * 0.05)
-                {
-                    double x = sp->x_pos + (!sp->direction * 15);
-                    double y = sp->y_pos + get_rand() * 8;
-                    double xv = convert(sp->direction) * fmin(fabs(sp->x_vel - convert(sp->direction) * 0.7), 5);
-                    xv += get_rand() - 0.5;
-                    double yv = get_rand() - 0.5;
-                    spawnSprite(FIREBALL_P1, x, y, xv, yv, RIGHT, 0, 0, 10);
-                }
+                int dir = b->direction[i];
+                double x = b->x_pos[i] + (!dir * 15);
+                double y = b->y_pos[i] + nextRand(&c->rng) * 8;
+                double xv = convert(dir) * fmin(fabs(b->x_vel[i] - convert(dir) * 0.7), 5);
+                xv += nextRand(&c->rng) - 0.5;
+                double yv = nextRand(&c->rng) - 0.5;
+                deferSpawn(c, FIREBALL_P1, x, y, xv, yv, RIGHT, 0, 0, 10);
             }
+        }
 
-            // Fireball faces in the direction of x-velocity (LEFT and RIGHT are in an enum so this works)
-            sp->direction = (sp->x_vel >= 0);
-            break;
-
-        case ICESHOCK:
-        case ICESHOCK_P1:
-            // Iceshock is affected by gravity and air resistance
-            if(!sp->colliding) sp->y_vel += 0.3;
-            sp->x_vel += convert(sp->x_vel < 0.0f) * 0.03;
-
-            // Iceshock faces in the direction of xy-velocity
-            sp->direction = (sp->x_vel >= 0);
-            sp->angle = (int) (57.296 * atan(sp->y_vel / sp->x_vel));
-            break;
-
-        case ROCKFALL:
-            // Rockfall falls quickly after it's done spawning
-            if(!sp->colliding && !sp->spawning) sp->y_vel += 1.2;
+        // Fireball faces in the direction of x-velocity (LEFT and RIGHT are in an enum so this works)
+        b->direction[i] = (b->x_vel[i] >= 0);
+    }
+}
 
-            // Rockfall rotates slowly as it falls
-            sp->direction = (sp->x_vel >= 0);
-            sp->angle += 2;
-            if(sp->colliding) sp->angle = 0;
-            break;
+// Physics for iceshock and its particles
+static void moveIceshocks(Bucket b, Chunk c)
+{
+    for(int i = c->start; i < c->end; i++)
+    {
+        // Iceshock is affected by gravity and air resistance
+        b->y_vel[i] += 0.3 * !running(b->collide_end[i]);
+        b->x_vel[i] += convert(b->x_vel[i] < 0.0f) * 0.03;
 
-        case ROCKFALL_P1:
-        case ROCKFALL_P2:
-            // Rockfall particles rotate and fall
-            sp->direction = (sp->x_vel >= 0);
-            sp->angle += 5;
-            sp->y_vel += 0.3;
-            break;
+        // Iceshock faces in the direction of xy-velocity
+        b->direction[i] = (b->x_vel[i] >= 0);
+        b->angle[i] = (int) (57.296 * atan(b->y_vel[i] / b->x_vel[i]));
+    }
+}
 
-        case DARKEDGE:
-            // Darkedge accelerates over time and spawns a particle trail
-            if(!sp->colliding && !sp->spawning)
-            {
-                sp->x_vel += convert(sp->x_vel > 0) * 0.4;
-                sp->y_vel += 0.1;
-
-                if(get_rand() <= fabs(sp->x_vel) * 0.1)
-                {
-                    double x = sp->x_pos + (!sp->direction * 60);
-                    double y = sp->y_pos + (get_rand() - 0.2) * 20;
-                    double xv = (0.5 * sp->x_vel) + (get_rand() - 0.5) / 2;
-                    double yv = (0.5 * sp->y_vel) + (get_rand() - 0.5) / 2;
-                    spawnSprite(DARKEDGE_P1, x, y, xv, yv, RIGHT, 0, 0, 10);
-                }
-            }
+// Physics for rockfall
+static void moveRockfalls(Bucket b, Chunk c)
+{
+    for(int i = c->start; i < c->end; i++)
+    {
+        // Rockfall falls quickly after it's done spawning
+        b->y_vel[i] += 1.2 * (!running(b->collide_end[i]) && !running(b->spawn_end[i]));
 
-            // Darkedge faces in the direction of xy-velocity
-            sp->direction = (sp->x_vel >= 0);
-            sp->angle = (int) (57.296 * atan(sp->y_vel / sp->x_vel));
-            break;
+        // Rockfall rotates slowly as it falls
+        b->direction[i] = (b->x_vel[i] >= 0);
+        b->angle[i] = running(b->collide_end[i]) ? 0 : b->angle[i] + 2;
+    }
+}
 
-        case DARKEDGE_P1:
-            // Darkedge/Fireball particles wobble around randomly
-            if(get_rand() <= 0.05)
-            {
-                sp->x_vel = (get_rand() - 0.5) / 2;
-                sp->y_vel = (get_rand() - 0.5) / 2;
-            }
-            break;
+// Physics for rockfall particles
+static void moveRockfallParticles(Bucket b, Chunk c)
+{
+    for(int i = c->start; i < c->end; i++)
+    {
+        // Rockfall particles rotate and fall
+        b->direction[i] = (b->x_vel[i] >= 0);
+        b->angle[i] += 5;
+        b->y_vel[i] += 0.3;
+    }
+}
 
-        case ARCSURGE:
-        case FIREBALL_P1:
-            // The electric shock of Arcsurge doesn't move
-            break;
+// Physics for darkedge
+static void moveDarkedges(Bucket b, Chunk c)
+{
+    for(int i = c->start; i < c->end; i++)
+    {
+        // Darkedge accelerates over time and spawns a particle trail
+        if(!running(b->collide_end[i]) && !running(b->spawn_end[i]))
+        {
+            b->x_vel[i] += convert(b->x_vel[i] > 0) * 0.4;
+            b->y_vel[i] += 0.1;
 
-        case ARCSURGE_P1:
-            // Arcsurge particles randomly change direction
-            if(get_rand() <= 0.2)
+            if(nextRand(&c->rng) <= fabs(b->x_vel[i]) * 0.1)
             {
-                double tmp = fabs(sp->x_vel) * convert(get_rand() - 0.5 > 0);
-                sp->x_vel = sp->y_vel;
-                sp->y_vel = tmp;
-                sp->x_vel += (get_rand() - 0.5)*3;
+                double x = b->x_pos[i] + (!b->direction[i] * 60);
+                double y = b->y_pos[i] + (nextRand(&c->rng) - 0.2) * 20;
+                double xv = (0.5 * b->x_vel[i]) + (nextRand(&c->rng) - 0.5) / 2;
+                double yv = (0.5 * b->y_vel[i]) + (nextRand(&c->rng) - 0.5) / 2;
+                deferSpawn(c, DARKEDGE_P1, x, y, xv, yv, RIGHT, 0, 0, 10);
             }
+        }
 
-            // Arcsurge particles slow down heavily but do not fall
-            sp->x_vel += convert(sp->x_vel < 0) * 0.1;
-            sp->y_vel += convert(sp->y_vel < 0) * 0.1;
-            break;
+        // Darkedge faces in the direction of xy-velocity
+        b->direction[i] = (b->x_vel[i] >= 0);
+        b->angle[i] = (int) (57.296 * atan(b->y_vel[i] / b->x_vel[i]));
     }
 }
 
-// Calculate physics and update position and orientation for all active sprites
-void moveSprites(void)
+// Physics for darkedge particles
+static void moveDarkedgeParticles(Bucket b, Chunk c)
 {
-    for(struct ele* cursor = active_sprites; cursor != NULL; cursor = cursor->next)
+    for(int i = c->start; i < c->end; i++)
     {
-        moveSprite(cursor->sp);
+        // Darkedge/Fireball particles wobble around randomly
+        if(nextRand(&c->rng) <= 0.05)
+        {
+            b->x_vel[i] = (nextRand(&c->rng) - 0.5) / 2;
+            b->y_vel[i] = (nextRand(&c->rng) - 0.5) / 2;
+        }
     }
 }
 
-// Advance timed variables for this sprite
-static void advanceTime(Sprite sp)
+// Physics for arcsurge particles
+static void moveArcsurgeParticles(Bucket b, Chunk c)
 {
-    // Update casting time
-    if(sp->casting) sp->casting--;
-
-    // Update spawning animation duration
-    if(sp->spawning) sp->spawning--;
-
-    // Update cooldowns
-    if(sp->meta->type == HUMANOID)
+    for(int i = c->start; i < c->end; i++)
     {
-        for(int i = 0; i < NUM_SPELLS; i++)
+        // Arcsurge particles randomly change direction
+        if(nextRand(&c->rng) <= 0.2)
         {
-            if(sp->cooldowns[i]) sp->cooldowns[i]--;
+            double tmp = fabs(b->x_vel[i]) * convert(nextRand(&c->rng) - 0.5 > 0);
+            b->x_vel[i] = b->y_vel[i];
+            b->y_vel[i] = tmp;
+            b->x_vel[i] += (nextRand(&c->rng) - 0.5)*3;
         }
+
+        // Arcsurge particles slow down heavily but do not fall
+        b->x_vel[i] += convert(b->x_vel[i] < 0) * 0.1;
+        b->y_vel[i] += convert(b->y_vel[i] < 0) * 0.1;
     }
+}
 
-    // Update collision time
-    if(sp->colliding) sp->colliding--;
+// Physics for each identity, indexed by identities enum (sprite.h). The electric shock of
+// Arcsurge and the fireball trail don't move on their own, so they have no physics.
+static void (*const move_kernels[NUM_SPRITES])(Bucket, Chunk) =
+{
+    [FIREBALL] = moveFireballs,            [ICESHOCK] = moveIceshocks,
+    [ROCKFALL] = moveRockfalls,            [DARKEDGE] = moveDarkedges,
+    [ARCSURGE] = NULL,                     [FIREBALL_P1] = NULL,
+    [ICESHOCK_P1] = moveIceshocks,         [ROCKFALL_P1] = moveRockfallParticles,
+    [ROCKFALL_P2] = moveRockfallParticles, [DARKEDGE_P1] = moveDarkedgeParticles,
+    [ARCSURGE_P1] = moveArcsurgeParticles, [GUY] = moveGuys
+};
+
+// Update position and orientation for the sprites in one chunk (run by the job system)
+static void moveChunk(void* data, int item)
+{
+    // Update every sprite's position, remembering where it was for interpolated rendering
+    Chunk c = &chunks[item];
+    Bucket b = &buckets[c->id];
+    for(int i = c->start; i < c->end; i++)
+    {
+        b->prev_x[i] = b->x_pos[i];
+        b->prev_y[i] = b->y_pos[i];
+        b->x_pos[i] += b->x_vel[i];
+        b->y_pos[i] += b->y_vel[i];
+    }
 
-    // Update sprite lifetime
-    if(sp->lifetime) sp->lifetime--;
+    // Update velocity and orientation (the physics are different for different spells)
+    if(move_kernels[c->id]) move_kernels[c->id](b, c);
 }
 
-// Advance timed sprite variables which update every frame
-void advanceTimers(void)
+// Calculate physics and update position and orientation for all active sprites
+void moveSprites(void)
 {
-    // Iterate over active sprites
-    for(struct ele* cursor = active_sprites; cursor != NULL; cursor = cursor->next)
+    // The buckets are split up front so that particles spawned this frame don't move until the next, and
+    // each chunk's random stream is seeded from the match's stream
+    splitChunks();
+    uint64_t seed = nextRand(&rng) * 0x1.0p53;
+    for(int c = 0; c < num_chunks; c++) seedRng(&chunks[c].rng, seed + c);
+    runChunks(moveChunk);
+
+    // Spawn what each chunk spawned, in chunk order - the order they'd be spawned in on one thread
+    for(int c = 0; c < num_chunks; c++)
     {
-        advanceTime(cursor->sp);
+        for(int i = 0; i < chunks[c].num_spawns; i++)
+        {
+            struct deferred_spawn* d = &chunks[c].spawns[i];
+            spawnSprite(d->id, d->x, d->y, d->xv, d->yv, d->dir, d->angle, d->spawning, d->life);
+        }
     }
 }
 
-// Render a sprite's bounding boxes on top of the sprite (only in debug)
-static void renderBounds(Sprite sp)
+// Advance the tick every timer counts towards, and fire the lifetimes and collisions which run out on it (only
+// the sprites whose timers are due are visited - they're unloaded by unloadSprites)
+void advanceTimers(void)
 {
-    // For each box, render 4 lines to create the rectangle
-    SDL_Rect* bounds = getBounds(sp);
-    for(int i = 0; i < sp->meta->num_bounds; i++)
+    tick++;
+    fireTimers(TIMER_BIT(LIFETIME_TIMER) | TIMER_BIT(COLLISION_TIMER));
+}
+
+// Get where a sprite should be drawn, a fraction alpha of the way between its last two positions
+static void interpolatePosition(Sprite sp, double alpha, int* x, int* y)
+{
+    double prev_x = FIELD(sp, prev_x);
+    double prev_y = FIELD(sp, prev_y);
+    *x = prev_x + (FIELD(sp, x_pos) - prev_x) * alpha;
+    *y = prev_y + (FIELD(sp, y_pos) - prev_y) * alpha;
+}
+
+// Add a sprite's bounding boxes to the batch, on top of the sprite (only in debug)
+static void renderBounds(Sprite sp, int x, int y)
+{
+    // Every line is the bounds pixel, stretched
+    SDL_Rect clip = {0, 0, 1, 1};
+    SDL_Rect pixel = {0, 0, 1, 1};
+    if(!clipAtlas(bounds_image, &clip, &pixel, false)) return;
+
+    // For each box, draw 4 lines to create the rectangle
+    const SDL_Rect* bounds = getBounds(sp);
+    for(int i = 0; i < META(sp)->num_bounds; i++)
     {
         // Line 1
         SDL_Rect box = bounds[i];
-        SDL_Rect clip = {739, 77, box.w, 1};
-        SDL_Rect renderQuad = {(int)sp->x_pos + box.x, (int)sp->y_pos + box.y, box.w, 1};
-        SDL_RenderCopyEx(renderer, sprite_sheet, &clip, &renderQuad, 0, NULL, SDL_FLIP_NONE);
+        SDL_Rect renderQuad = {x + box.x, y + box.y, box.w, 1};
+        batchQuad(&clip, &renderQuad, 0, NULL, false);
 
         // Line 2
-        renderQuad = (SDL_Rect) {(int)sp->x_pos + box.x, (int)sp->y_pos + box.y + box.h, box.w, 1};
-        SDL_RenderCopyEx(renderer, sprite_sheet, &clip, &renderQuad, 0, NULL, SDL_FLIP_NONE);
+        renderQuad = (SDL_Rect) {x + box.x, y + box.y + box.h, box.w, 1};
+        batchQuad(&clip, &renderQuad, 0, NULL, false);
 
         // Line 3
-        clip = (SDL_Rect) {739, 77, 1, box.h};
-        renderQuad = (SDL_Rect) {(int)sp->x_pos+ box.x, (int)sp->y_pos + box.y, 1, box.h};
-        SDL_RenderCopyEx(renderer, sprite_sheet, &clip, &renderQuad, 0, NULL, SDL_FLIP_NONE);
+        renderQuad = (SDL_Rect) {x + box.x, y + box.y, 1, box.h};
+        batchQuad(&clip, &renderQuad, 0, NULL, false);
 
         // Line 4
-        renderQuad = (SDL_Rect) {(int)sp->x_pos + box.x + box.w, (int)sp->y_pos + box.y, 1, box.h};
-        SDL_RenderCopyEx(renderer, sprite_sheet, &clip, &renderQuad, 0, NULL, SDL_FLIP_NONE);
+        renderQuad = (SDL_Rect) {x + box.x + box.w, y + box.y, 1, box.h};
+        batchQuad(&clip, &renderQuad, 0, NULL, false);
     }
 }
 
-// Render a sprite from the sprite sheet to the screen
-static void renderSprite(Sprite sp)
+// Add a sprite from the atlas to the batch, unless it's out of view
+static void renderSprite(Sprite sp, double alpha, SDL_Rect view)
 {
-    // Make sure sprite is facing the proper direction
-    SDL_RendererFlip flipType = SDL_FLIP_NONE;
-    if (sp->direction == LEFT) flipType = SDL_FLIP_HORIZONTAL;
-
-    // Grab the sprite at it's current frame from the spritesheet
-    SDL_Rect clip = {sp->meta->width * (int) sp->frame, sp->meta->sheet_position, sp->meta->width, sp->meta->height};
-
-    // Draw the sprite at its current x and y position
-    SDL_Rect renderQuad = {(int)sp->x_pos, (int)sp->y_pos, sp->meta->width, sp->meta->height};
-    SDL_RenderCopyEx(renderer, sprite_sheet, &clip, &renderQuad, sp->angle, NULL, flipType);
+    // Skip sprites entirely outside the view (with room for them to be rotated)
+    SpriteInfo meta = META(sp);
+    int x, y;
+    interpolatePosition(sp, alpha, &x, &y);
+    int reach = meta->width + meta->height;
+    if(x + reach < view.x || x - reach > view.x + view.w || y + reach < view.y || y - reach > view.y + view.h) return;
+
+    // Draw the sprite's current frame at its interpolated x and y position relative to the view, facing the
+    // proper direction (the frame is trimmed in the atlas, but still turns about the whole frame's center)
+    x -= view.x;
+    y -= view.y;
+    bool flip = FIELD(sp, direction) == LEFT;
+    SDL_Rect clip = {0, 0, meta->width, meta->height};
+    SDL_Rect renderQuad = {x, y, meta->width, meta->height};
+    if(clipAtlas(frame_images[sp.id] + (int) FIELD(sp, frame), &clip, &renderQuad, flip))
+    {
+        SDL_FPoint center = {x + meta->width / 2.0f - renderQuad.x, y + meta->height / 2.0f - renderQuad.y};
+        batchQuad(&clip, &renderQuad, FIELD(sp, angle), &center, flip);
+    }
 
     // In debug mode, render bounding boxes and sprite positions
-    if(debug && sp->meta->type != PARTICLE)
+    if(debug && meta->type != PARTICLE)
     {
-        renderBounds(sp);
-        clip = (SDL_Rect) {743, 81, 3, 3};
-        renderQuad = (SDL_Rect) {(int)sp->x_pos, (int)sp->y_pos, 3, 3};
-        SDL_RenderCopyEx(renderer, sprite_sheet, &clip, &renderQuad, 0, NULL, SDL_FLIP_NONE);
+        renderBounds(sp, x, y);
+        clip = (SDL_Rect) {0, 0, 3, 3};
+        renderQuad = (SDL_Rect) {x, y, 3, 3};
+        if(clipAtlas(position_image, &clip, &renderQuad, false)) batchQuad(&clip, &renderQuad, 0, NULL, false);
     }
 }
 
-// Render all active sprites to the screen
-void renderSprites(void)
+// Get the point the camera should follow - midway between the guys in the level, at their interpolated
+// positions (returns false if neither guy is in the level)
+bool getFocus(double alpha, double* x, double* y)
 {
-    for(struct ele* cursor = active_sprites; cursor != NULL; cursor = cursor->next)
+    int n = 0;
+    *x = 0;
+    *y = 0;
+    for(int guy = 0; guy < 2; guy++)
     {
-        renderSprite(cursor->sp);
+        if(!guyExists(guy) || FIELD(guys[guy], x_pos) > getLevelWidth()) continue;
+        int gx, gy;
+        interpolatePosition(guys[guy], alpha, &gx, &gy);
+        *x += gx + META(guys[guy])->width / 2.0;
+        *y += gy + META(guys[guy])->height / 2.0;
+        n++;
     }
+    if(!n) return false;
+    *x /= n;
+    *y /= n;
+    return true;
 }
 
-/* DATA ALLOCATION / INITIALIZATION */
+// Render all active sprites to the screen, alpha of the way from their previous to current positions
+void renderSprites(double alpha)
+{
+    // Every sprite comes from the atlas, so they are all drawn in one batch
+    SDL_Rect view = getView();
+    beginBatch(getAtlas());
+
+    // Buckets are drawn in identity order, so the guys are drawn on top of spells and particles
+    for(int id = 0; id < NUM_SPRITES; id++)
+    {
+        for(int i = 0; i < buckets[id].count; i++)
+        {
+            renderSprite((Sprite) {id, i}, alpha, view);
+        }
+    }
+    flushBatch();
+}
 
-// Reflect bounding boxes across the y-axis of a sprite to create lbounds
-static SDL_Rect* reflectBounds(SDL_Rect* rbounds, int num_bounds, int width)
+/* WORLD STATE */
+
+// Copy size bytes from data to buf, or from buf to data if load is set (if buf is NULL, nothing is copied)
+static size_t copyBytes(char* buf, void* data, size_t size, bool load)
 {
-    // If there are no rbounds, there are no lbounds either
-    if(!rbounds) return NULL;
+    if(buf && load) memcpy(data, buf, size);
+    else if(buf)    memcpy(buf, data, size);
+    return size;
+}
 
-    // Iterate over all given bounds
-    SDL_Rect* lbounds = malloc(sizeof(SDL_Rect) * num_bounds);
-    double sprite_center = width / 2.0;
-    for(int i = 0; i < num_bounds; i++)
+// Copy the state of all active sprites, the current tick, cooldowns, and the spell random stream to buf, or from buf if load is set,
+// returning the number of bytes copied (if buf is NULL, nothing is copied and the size is just measured). When loading, no more
+// than size bytes are read, and 0 is returned if the state doesn't fit in them or a bucket's count is out of range.
+static size_t copyWorldState(char* buf, size_t size, bool load)
+{
+    size_t n = 0;
+    #define COPY(data, bytes) if(load && n + (bytes) > size) return 0; n += copyBytes(buf ? buf + n : NULL, (data), (bytes), load)
+
+    // Only the active part of each bucket is copied (the count always comes first, so when
+    // loading, the rest of the bucket is sized by the loaded count)
+    for(int id = 0; id < NUM_SPRITES; id++)
     {
-        // Width, height, and y-coordinate don't change
-        SDL_Rect rbox = rbounds[i];
-        lbounds[i].w = rbox.w;
-        lbounds[i].h = rbox.h;
-        lbounds[i].y = rbox.y;
-
-        // reflect box i onto lbounds[i]
-        double box_center = rbox.x + rbox.w / 2.0;
-        double translation = 2 * (sprite_center - box_center);
-        lbounds[i].x = rbox.x + (int) translation;
+        Bucket b = &buckets[id];
+        COPY(&b->count, sizeof(int));
+        if(load && (b->count < 0 || b->count > MAX_SPRITES)) return 0;
+        COPY(b->x_pos, b->count * sizeof(double));       COPY(b->y_pos, b->count * sizeof(double));
+        COPY(b->x_vel, b->count * sizeof(double));       COPY(b->y_vel, b->count * sizeof(double));
+        COPY(b->prev_x, b->count * sizeof(double));      COPY(b->prev_y, b->count * sizeof(double));
+        COPY(b->direction, b->count * sizeof(bool));     COPY(b->angle, b->count * sizeof(int));
+        COPY(b->hp, b->count * sizeof(int));             COPY(b->spawn_end, b->count * sizeof(int));
+        COPY(b->collide_end, b->count * sizeof(int));    COPY(b->cast_end, b->count * sizeof(int));
+        COPY(b->life_end, b->count * sizeof(int));       COPY(b->spell, b->count * sizeof(int));
+        COPY(b->action, b->count * sizeof(int));         COPY(b->action_change, b->count * sizeof(bool));
+        COPY(b->frame, b->count * sizeof(double));       COPY(b->fired, b->count * sizeof(int));
     }
-    return lbounds;
-}
-
-// Assign meta info fields for a spell
-static SpellInfo initSpell(int act, int cast, int finish, int cd,
-                           void (*launch)(Sprite), void (*collide)(Sprite))
-{
-    SpellInfo this_spell = (SpellInfo) malloc(sizeof(struct spell_metainfo));
-    this_spell->action = act;
-    this_spell->cast_time = cast;
-    this_spell->finish_time = finish;
-    this_spell->cooldown = cd;
-    if(debug) this_spell->cooldown = 0; // no cooldowns in debug mode
-    this_spell->on_launch = launch;
-    this_spell->on_collide = collide;
-    return this_spell;
-}
-
-// Assign meta info fields for a sprite
-static SpriteInfo initSprite(int id, int type, int power, int hp, int width, int height,
-                             int sheet_pos, int* fs, int num_bounds, SDL_Rect* bounds)
-{
-    SpriteInfo this_sprite = (SpriteInfo) malloc(sizeof(struct sprite_metainfo));
-    this_sprite->id = id;
-    this_sprite->type = type;
-    this_sprite->power = power;
-    this_sprite->max_hp = hp;
-    this_sprite->width = width;
-    this_sprite->height = height;
-    this_sprite->radius = sqrt((width*width/4.0) + (height*height/4.0));
-    this_sprite->num_bounds = num_bounds;
-    this_sprite->rbounds = bounds;
-    this_sprite->lbounds = reflectBounds(bounds, num_bounds, width);
-    this_sprite->sheet_position = sheet_pos;
-    this_sprite->frame_sections = fs;
-    return this_sprite;
-}
-
-// Fill the meta info lists with complete meta info for each sprite in the game
-void loadSpriteInfo(void)
+    COPY(&tick, sizeof(int));
+    COPY(cooldown_ends, sizeof(cooldown_ends));
+    COPY(&rng, sizeof(Rng));
+
+    // The CPU's random stream isn't part of the world - its decisions are recorded as inputs instead, and the
+    // timer wheel is rebuilt from the sprites' deadlines once they're loaded
+
+    #undef COPY
+    return n;
+}
+
+// Save the state of all active sprites to buf, returning its size in bytes (if buf is NULL, just return the size)
+size_t saveSprites(char* buf)
 {
-    // Load the spritesheet texture into memory
-    sprite_sheet = loadTexture("art/Spritesheet.bmp");
-
-    // Make space for meta info structs
-    sprite_info = (SpriteInfo*) malloc(sizeof(SpriteInfo) * NUM_SPRITES);
-    spell_info = (SpellInfo*) malloc(sizeof(SpellInfo) * NUM_SPELLS);
-
-    // HUMANS
-
-    // Sprite metadata: Guy
-    int numBounds = 2;
-    int* fs = (int*) malloc(sizeof(int) * 12);
-    memcpy(fs, (int[]) {0, 0, 4, 5, 10, 14, 22, 30, 40, 51, 64, 69}, sizeof(int) * 12);
-    SDL_Rect* bounds = malloc(sizeof(SDL_Rect) * numBounds);
-    bounds[0] = (SDL_Rect) {9, 5, 15, 14};
-    bounds[1] = (SDL_Rect) {10, 23, 10, 35};
-    sprite_info[GUY] = initSprite(GUY, HUMANOID, 10, 100, 28, 58, 0, fs, numBounds, bounds);
-
-    // SPELLS
-
-    // Sprite/Spell metadata: Fireball
-    numBounds = 1;
-    fs = (int*) malloc(sizeof(int) * 4);
-    memcpy(fs, (int[]) {0, 0, 2, 5}, sizeof(int) * 4);
-    bounds = malloc(sizeof(SDL_Rect) * numBounds);
-    bounds[0] = (SDL_Rect) {6, 2, 12, 6};
-    spell_info[FIREBALL] = initSpell(CAST_FIREBALL, 32, 8, 120, launchFireball, collideGeneric);
-    sprite_info[FIREBALL] = initSprite(FIREBALL, SPELL, 15, 1, 23, 10, 60, fs, numBounds, bounds);
-
-    // Sprite/Spell metadata: Iceshock
-    numBounds = 1;
-    fs = (int*) malloc(sizeof(int) * 4);
-    memcpy(fs, (int[]) {0, 0, 2, 5}, sizeof(int) * 4);
-    bounds = malloc(sizeof(SDL_Rect) * numBounds);
-    bounds[0] = (SDL_Rect) {6, 1, 13, 7};
-    spell_info[ICESHOCK] = initSpell(CAST_ICESHOCK, 32, 8, 240, launchIceshock, collideGeneric);
-    sprite_info[ICESHOCK] = initSprite(ICESHOCK, SPELL, 20, 1, 23, 10, 70, fs, numBounds, bounds);
-
-    // Sprite/Spell metadata: Rockfall
-    numBounds = 3;
-    fs = (int*) malloc(sizeof(int) * 4);
-    memcpy(fs, (int[]) {0, 3, 4, 7}, sizeof(int) * 4);
-    bounds = malloc(sizeof(SDL_Rect) * numBounds);
-    bounds[0] = (SDL_Rect) {40, 5, 20, 90};
-    bounds[1] = (SDL_Rect) {20, 20, 60, 60};
-    bounds[2] = (SDL_Rect) {5, 40, 90, 20};
-    spell_info[ROCKFALL] = initSpell(CAST_ROCKFALL, 40, 40, 420, launchRockfall, collideRockfall);
-    sprite_info[ROCKFALL] = initSprite(ROCKFALL, SPELL, 30, 1, 100, 100, 85, fs, numBounds, bounds);
-
-    // Sprite/Spell metadata: Darkedge
-    numBounds = 2;
-    fs = (int*) malloc(sizeof(int) * 4);
-    memcpy(fs, (int[]) {0, 5, 8, 11}, sizeof(int) * 4);
-    bounds = malloc(sizeof(SDL_Rect) * numBounds);
-    bounds[0] = (SDL_Rect) {5, 8, 25, 10};
-    bounds[1] = (SDL_Rect) {30, 15, 25, 10};
-    spell_info[DARKEDGE] = initSpell(CAST_DARKEDGE, 44, 24, 420, launchDarkedge, collideGeneric);
-    sprite_info[DARKEDGE] = initSprite(DARKEDGE, SPELL, 25, 1, 60, 30, 215, fs, numBounds, bounds);
-
-    // Sprite/Spell metadata: Arcsurge
-    numBounds = 1;
-    fs = (int*) malloc(sizeof(int) * 4);
-    memcpy(fs, (int[]) {0, 0, 3, 3}, sizeof(int) * 4);
-    bounds = malloc(sizeof(SDL_Rect) * numBounds);
-    bounds[0] = (SDL_Rect) {5, 20, 92, 20};
-    spell_info[ARCSURGE] = initSpell(CAST_ARCSURGE, 52, 40, 600, launchArcsurge, collideArcsurge);
-    sprite_info[ARCSURGE] = initSprite(ARCSURGE, SPELL, 35, 1, 120, 60, 250, fs, numBounds, bounds);
-
-    // PARTICLES
-
-    numBounds = 0;
-    bounds = NULL;
-
-    // Sprite metadata: Fireball Particle 1
-    fs = (int*) malloc(sizeof(int) * 4);
-    memcpy(fs, (int[]) {0, 0, 2, 2}, sizeof(int) * 4);
-    sprite_info[FIREBALL_P1] = initSprite(FIREBALL_P1, PARTICLE, 0, 1, 5, 5, 315, fs, numBounds, bounds);
-
-    // Sprite metadata: Iceshock Particle 1
-    fs = (int*) malloc(sizeof(int) * 4);
-    memcpy(fs, (int[]) {0, 0, 2, 2}, sizeof(int) * 4);
-    sprite_info[ICESHOCK_P1] = initSprite(ICESHOCK_P1, PARTICLE, 0, 1, 5, 5, 80, fs, numBounds, bounds);
-
-    // Sprite metadata: Rockfall Particle 1
-    fs = (int*) malloc(sizeof(int) * 4);
-    memcpy(fs, (int[]) {0, 0, 1, 1}, sizeof(int) * 4);
-    sprite_info[ROCKFALL_P1] = initSprite(ROCKFALL_P1, PARTICLE, 0, 1, 25, 25, 185, fs, numBounds, bounds);
-
-    // Sprite metadata: Rockfall Particle 2
-    fs = (int*) malloc(sizeof(int) * 4);
-    memcpy(fs, (int[]) {0, 0, 2, 2}, sizeof(int) * 4);
-    sprite_info[ROCKFALL_P2] = initSprite(ROCKFALL_P2, PARTICLE, 0, 1, 5, 5, 210, fs, numBounds, bounds);
-
-    // Sprite metadata: Darkedge Particle 1
-    fs = (int*) malloc(sizeof(int) * 4);
-    memcpy(fs, (int[]) {0, 0, 2, 2}, sizeof(int) * 4);
-    sprite_info[DARKEDGE_P1] = initSprite(DARKEDGE_P1, PARTICLE, 0, 1, 5, 5, 245, fs, numBounds, bounds);
-
-    // Sprite metadata: Arcsurge Particle 1
-    fs = (int*) malloc(sizeof(int) * 4);
-    memcpy(fs, (int[]) {0, 0, 2, 2}, sizeof(int) * 4);
-    sprite_info[ARCSURGE_P1] = initSprite(ARCSURGE_P1, PARTICLE, 0, 1, 5, 5, 310, fs, numBounds, bounds);
+    return copyWorldState(buf, 0, false);
 }
 
-/* DATA UNLOADING */
+// Put every pending timer of the active sprites back on the timer wheel, from their deadlines
+static void rebuildTimers(void)
+{
+    // Launches are fired before the tick advances and the rest after, so a launch due on the current
+    // tick is still pending
+    clearTimers();
+    for(int id = 0; id < NUM_SPRITES; id++)
+    {
+        Bucket b = &buckets[id];
+        for(int i = 0; i < b->count; i++)
+        {
+            Sprite sp = {id, i};
+            int launch = b->cast_end[i] - spell_info[b->spell[i]].finish_time;
+            if(id == GUY && launch >= tick)      setTimer(TIMER_NODE(sp, LAUNCH_TIMER), launch);
+            if(b->life_end[i] - 1 > tick)        setTimer(TIMER_NODE(sp, LIFETIME_TIMER), b->life_end[i] - 1);
+            if(b->collide_end[i] - 1 > tick)     setTimer(TIMER_NODE(sp, COLLISION_TIMER), b->collide_end[i] - 1);
+        }
+    }
+}
+
+// Restore the state of all active sprites from the size bytes at buf, returning the number of bytes read
+// (0 if the state is invalid, in which case there are no active sprites left)
+size_t loadSprites(const char* buf, size_t size)
+{
+    size_t n = copyWorldState((char*) buf, size, true);
+    if(!n)
+    {
+        freeActiveSprites();
+        return 0;
+    }
+    rebuildTimers();
+    return n;
+}
 
-// Free a sprite
-static void freeSprite(struct ele* e)
+/* DATA ALLOCATION / INITIALIZATION */
+
+// Seed the random streams used by the current match
+void seedMatch(unsigned long long seed)
 {
-    if(e->sp->meta->type == HUMANOID)
+    seedRng(&rng, seed);
+    seedRng(&cpu_rng, seed ^ 0x5DEECE66DULL);
+}
+
+// Add each sprite's animation frames to the atlas, and start with no active sprites (the meta info itself is
+// all in the tables at the top)
+void loadSpriteInfo(void)
+{
+    // Each sprite's frames are in its row of the sprite sheet (the last frame section ends after the last frame),
+    // along with the pixels debug mode draws with
+    for(int i = 0; i < NUM_SPRITES; i++)
     {
-        free(e->sp->cooldowns);
+        SpriteInfo meta = &sprite_info[i];
+        int frames = meta->frame_sections[meta->type == HUMANOID ? DIE + 1 : COLLIDE + 1];
+        frame_images[i] = addAtlasImages("art/Spritesheet.bmp", 0, meta->sheet_position, meta->width,
+                                         meta->height, frames);
     }
-    free(e->sp);
-    free(e);
+    bounds_image = addAtlasImages("art/Spritesheet.bmp", 739, 77, 1, 1, 1);
+    position_image = addAtlasImages("art/Spritesheet.bmp", 743, 81, 3, 3, 1);
+
+    // Start with every bucket empty, and nothing on the timer wheel
+    for(int slot = 0; slot < WHEEL_SLOTS; slot++) wheel.head[slot] = -1;
+    freeActiveSprites();
+    seedMatch(DEFAULT_SEED);
 }
 
+/* DATA UNLOADING */
+
 // Free any active sprites which have died
 int unloadSprites(void)
 {
-    // Iterate over active sprites
-    struct ele* prev = NULL;
+    int world_right = getLevelWidth() + WORLD_RIGHT_MARGIN;
+    int world_bottom = getLevelHeight() + WORLD_BOTTOM_MARGIN;
     int game_over = 0;
-    for(struct ele* cursor = active_sprites; cursor != NULL;)
+    for(int id = 0; id < NUM_SPRITES; id++)
     {
-        // Check if the sprite is dead
-        if(isDead(cursor->sp))
+        // Iterate backwards over the bucket, so that the last sprite (which fills the hole left
+        // by a dead one) has always been checked already
+        Bucket b = &buckets[id];
+        for(int i = b->count - 1; i >= 0; i--)
         {
-            if(cursor->sp->meta->id == GUY)
+            // Check if the sprite is dead (the timers which fired this tick have then been dealt with)
+            bool dead = isDead(b, i, world_right, world_bottom);
+            b->fired[i] = 0;
+            if(!dead) continue;
+
+            if(id == GUY)
             {
                 // If the dead sprite is a Guy, just hide it and signal game over
-                if(cursor->sp == guys[0])
-                {
-                    hideGuy(0);
-                    game_over = 1;
-                }
-                else
-                {
-                    hideGuy(1);
-                    game_over = 2;
-                }
-
+                hideGuy(i);
+                game_over = i + 1;
             }
             else
             {
-                // Otherwise remove the sprite from the active sprites and free it
-                if(prev == NULL)
-                {
-                    prev = cursor;
-                    cursor = cursor->next;
-                    freeSprite(prev);
-                    active_sprites = cursor;
-                    prev = NULL;
-                }
-                else
-                {
-                    struct ele* e = cursor;
-                    cursor = cursor->next;
-                    freeSprite(e);
-                    prev->next = cursor;
-                }
+                // Otherwise move the last sprite in the bucket (and its timers) into its place
+                copySprite(b, i, --b->count);
+                moveTimers(id, i, b->count);
             }
         }
-        else
-        {
-            // If the sprite isn't dead, continue
-            prev = cursor;
-            cursor = cursor->next;
-        }
     }
     return game_over;
 }
 
-// Free all active sprites
+// Free all active sprites by emptying every bucket, and taking their timers off the wheel
 void freeActiveSprites(void)
 {
-    for(struct ele* cursor = active_sprites; cursor != NULL;)
-    {
-        struct ele* e = cursor;
-        cursor = cursor->next;
-        freeSprite(e);
-    }
-}
-
-// Free all sprite and spell meta info
-void freeSpriteInfo(void)
-{
-    // Free sprite metainfo
-    for(int i = 0; i < NUM_SPRITES; i++)
-    {
-        free(sprite_info[i]->frame_sections);
-        if(sprite_info[i]->type != PARTICLE)
-        {
-            free(sprite_info[i]->rbounds);
-            free(sprite_info[i]->lbounds);
-        }
-        free(sprite_info[i]);
-    }
-    free(sprite_info);
-
-    // Free spell metainfo
-    for(int i = 0; i < NUM_SPELLS; i++)
-    {
-        free(spell_info[i]);
-    }
-    free(spell_info);
-
-    // Free the sprite sheet texture
-    SDL_DestroyTexture(sprite_sheet);
+    for(int id = 0; id < NUM_SPRITES; id++) buckets[id].count = 0;
+    clearTimers();
 }